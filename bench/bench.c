@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_DEFAULT_RUNS 15
+
+struct Bench {
+  int runs;
+  const char *filter;
+  FILE *out;
+  int count;
+  int failures;
+};
+
+volatile uint64_t bench_sink;
+
+uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t bench_rand(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+int bench_selected(const Bench *b, const char *name) {
+  return !b->filter || strstr(name, b->filter) != NULL;
+}
+
+void bench_measure(Bench *b, const char *name, int64_t items, BenchFn setup,
+                   BenchFn fn, void *arg) {
+  if (!bench_selected(b, name)) return;
+
+  uint64_t *samples = (uint64_t *)calloc((size_t)b->runs, sizeof(uint64_t));
+  if (!samples) return;
+
+  if (setup) setup(arg);
+  fn(arg);
+
+  for (int i = 0; i < b->runs; ++i) {
+    if (setup) setup(arg);
+    uint64_t t0 = bench_now_ns();
+    fn(arg);
+    samples[i] = bench_now_ns() - t0;
+  }
+
+  qsort(samples, (size_t)b->runs, sizeof(uint64_t), cmp_u64);
+  uint64_t median = samples[b->runs / 2];
+  if (b->runs % 2 == 0) median = (samples[b->runs / 2 - 1] + median) / 2;
+
+  fprintf(b->out,
+          "%s    {\"name\": \"%s\", \"items\": %lld, \"median_ns\": %llu, "
+          "\"min_ns\": %llu, \"max_ns\": %llu, \"ns_per_item\": %.3f}",
+          b->count ? ",\n" : "", name, (long long)items,
+          (unsigned long long)median, (unsigned long long)samples[0],
+          (unsigned long long)samples[b->runs - 1],
+          items > 0 ? (double)median / (double)items : 0.0);
+  fflush(b->out);
+  b->count++;
+
+  fprintf(stderr, "bench: %-32s %12.3f ms\n", name, (double)median / 1e6);
+  free(samples);
+}
+
+void bench_check(Bench *b, const char *name, int ok) {
+  fprintf(stderr, "bench: %-32s %s\n", name, ok ? "ok" : "FAILED");
+  if (!ok) b->failures++;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [--runs N] [--filter SUBSTR] [--out FILE]\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  Bench b;
+  memset(&b, 0, sizeof(b));
+  b.runs = BENCH_DEFAULT_RUNS;
+  b.out = stdout;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      b.runs = atoi(argv[++i]);
+      if (b.runs < 1) b.runs = 1;
+    } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      b.filter = argv[++i];
+    } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      b.out = fopen(argv[++i], "w");
+      if (!b.out) {
+        fprintf(stderr, "bench: cannot write %s\n", argv[i]);
+        return 1;
+      }
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  fprintf(b.out, "{\n  \"runs\": %d,\n  \"results\": [\n", b.runs);
+
+  bench_suite_common(&b);
+  bench_suite_video(&b);
+  bench_suite_ui(&b);
+
+  fprintf(b.out, "\n  ]\n}\n");
+  if (b.out != stdout) fclose(b.out);
+  return b.failures ? 1 : 0;
+}
\ No newline at end of file
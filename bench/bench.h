@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Micro-benchmark harness. Every case is run once to warm up and then
+ * `runs` times; the median, min and max wall time are reported as JSON. */
+
+typedef struct Bench Bench;
+
+typedef void (*BenchFn)(void *arg);
+
+int bench_selected(const Bench *b, const char *name);
+
+/* `setup` (may be NULL) runs before every timed iteration and is excluded
+ * from the measurement. `items` is the number of units processed per run
+ * and is used to derive ns_per_item. */
+void bench_measure(Bench *b, const char *name, int64_t items, BenchFn setup,
+                   BenchFn fn, void *arg);
+
+/* Records a correctness check; any failure makes the run exit non-zero. */
+void bench_check(Bench *b, const char *name, int ok);
+
+uint64_t bench_now_ns(void);
+uint32_t bench_rand(uint32_t *state);
+
+extern volatile uint64_t bench_sink;
+
+void bench_suite_common(Bench *b);
+void bench_suite_video(Bench *b);
+void bench_suite_ui(Bench *b);
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "browser.h"
+#include "common.h"
+#include "lfqueue.h"
+
+#define NAME_COUNT 1000000
+#define SORT_COUNT 100000
+
+typedef struct {
+  char **names;
+  char *storage;
+  int count;
+
+  char **sorted;
+  BrowserEntry *entries;
+  BrowserEntry *entries_sorted;
+} StringsCtx;
+
+static const char *const k_exts[] = {".mp4", ".MKV", ".avi", ".mov",
+                                     ".txt", ".jpg", ".srt", ".Mp4"};
+
+static int strings_init(StringsCtx *c) {
+  const size_t slot = 48;
+  c->count = NAME_COUNT;
+  c->names = (char **)malloc((size_t)c->count * sizeof(char *));
+  c->storage = (char *)malloc((size_t)c->count * slot);
+  c->sorted = (char **)malloc(SORT_COUNT * sizeof(char *));
+  c->entries = (BrowserEntry *)malloc(SORT_COUNT * sizeof(BrowserEntry));
+  c->entries_sorted = (BrowserEntry *)malloc(SORT_COUNT * sizeof(BrowserEntry));
+  if (!c->names || !c->storage || !c->sorted || !c->entries ||
+      !c->entries_sorted)
+    return 0;
+
+  uint32_t seed = 0x12345678u;
+  for (int i = 0; i < c->count; ++i) {
+    char *s = c->storage + (size_t)i * slot;
+    uint32_t r = bench_rand(&seed);
+    snprintf(s, slot, "recording_%08x_cam%02u%s", r, r % 17u,
+             k_exts[(r >> 8) % (sizeof(k_exts) / sizeof(k_exts[0]))]);
+    c->names[i] = s;
+  }
+
+  for (int i = 0; i < SORT_COUNT; ++i) {
+    c->entries[i].name = c->names[i];
+    c->entries[i].path = c->names[i];
+    c->entries[i].is_dir = (bench_rand(&seed) % 10u) == 0;
+  }
+  return 1;
+}
+
+static void strings_free(StringsCtx *c) {
+  free(c->names);
+  free(c->storage);
+  free(c->sorted);
+  free(c->entries);
+  free(c->entries_sorted);
+}
+
+static void run_is_video_file(void *arg) {
+  StringsCtx *c = (StringsCtx *)arg;
+  uint64_t hits = 0;
+  for (int i = 0; i < c->count; ++i)
+    hits += (uint64_t)is_video_file(c->names[i]);
+  bench_sink += hits;
+}
+
+static void run_ends_with_ci(void *arg) {
+  StringsCtx *c = (StringsCtx *)arg;
+  uint64_t hits = 0;
+  for (int i = 0; i < c->count; ++i)
+    hits += (uint64_t)ends_with_ci(c->names[i], ".mkv");
+  bench_sink += hits;
+}
+
+static void setup_sort_str(void *arg) {
+  StringsCtx *c = (StringsCtx *)arg;
+  memcpy(c->sorted, c->names, SORT_COUNT * sizeof(char *));
+}
+
+static void run_sort_str(void *arg) {
+  StringsCtx *c = (StringsCtx *)arg;
+  qsort(c->sorted, SORT_COUNT, sizeof(char *), cmp_str);
+  bench_sink += (uint64_t)(uintptr_t)c->sorted[0];
+}
+
+static void setup_sort_entries(void *arg) {
+  StringsCtx *c = (StringsCtx *)arg;
+  memcpy(c->entries_sorted, c->entries, SORT_COUNT * sizeof(BrowserEntry));
+}
+
+static void run_sort_entries(void *arg) {
+  StringsCtx *c = (StringsCtx *)arg;
+  qsort(c->entries_sorted, SORT_COUNT, sizeof(BrowserEntry), cmp_entries);
+  bench_sink += (uint64_t)(uintptr_t)c->entries_sorted[0].name;
+}
+
+#define LFQ_PRODUCERS 4
+#define LFQ_CONSUMERS 4
+#define LFQ_PER_PRODUCER 50000
+#define LFQ_CAPACITY 64
+
+typedef struct {
+  LfQueue *q;
+  atomic_int next_producer;
+  atomic_llong popped;
+  atomic_ullong pushed_sum;
+  atomic_ullong popped_sum;
+  /* Totals over every run, checked once measuring is done. */
+  uint64_t items;
+  uint64_t lost;
+  uint64_t mismatched;
+} LfqCtx;
+
+/* Spinning on a full or empty queue yields, so the case also completes on
+ * a single core. */
+static void *lfq_producer(void *arg) {
+  LfqCtx *c = (LfqCtx *)arg;
+  uint64_t id = (uint64_t)atomic_fetch_add(&c->next_producer, 1);
+  uint64_t sum = 0;
+  for (uint64_t i = 1; i <= LFQ_PER_PRODUCER; ++i) {
+    uint64_t v = id * LFQ_PER_PRODUCER + i;
+    while (!lfqueue_push(c->q, &v)) sched_yield();
+    sum += v;
+  }
+  atomic_fetch_add(&c->pushed_sum, sum);
+  return NULL;
+}
+
+static void *lfq_consumer(void *arg) {
+  LfqCtx *c = (LfqCtx *)arg;
+  const long long total = (long long)LFQ_PRODUCERS * LFQ_PER_PRODUCER;
+  uint64_t sum = 0;
+  while (atomic_load(&c->popped) < total) {
+    uint64_t v;
+    if (lfqueue_pop(c->q, &v)) {
+      sum += v;
+      atomic_fetch_add(&c->popped, 1);
+    } else {
+      sched_yield();
+    }
+  }
+  atomic_fetch_add(&c->popped_sum, sum);
+  return NULL;
+}
+
+static void run_lfqueue_mpmc(void *arg) {
+  LfqCtx *c = (LfqCtx *)arg;
+  atomic_store(&c->next_producer, 0);
+  atomic_store(&c->popped, 0);
+  atomic_store(&c->pushed_sum, 0);
+  atomic_store(&c->popped_sum, 0);
+
+  pthread_t threads[LFQ_PRODUCERS + LFQ_CONSUMERS];
+  int started = 0;
+  for (int i = 0; i < LFQ_CONSUMERS; ++i) {
+    if (pthread_create(&threads[started], NULL, lfq_consumer, c) == 0)
+      started++;
+  }
+  for (int i = 0; i < LFQ_PRODUCERS; ++i) {
+    if (pthread_create(&threads[started], NULL, lfq_producer, c) == 0)
+      started++;
+  }
+  for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+
+  /* Nothing may be left behind or popped twice. */
+  uint64_t v;
+  if (lfqueue_pop(c->q, &v)) c->lost++;
+  if (started != LFQ_PRODUCERS + LFQ_CONSUMERS ||
+      atomic_load(&c->pushed_sum) != atomic_load(&c->popped_sum))
+    c->mismatched++;
+  c->items += (uint64_t)atomic_load(&c->popped);
+}
+
+/* The lock-free queue behind the engine and control commands, with four
+ * threads on each end. */
+static void bench_lfqueue(Bench *b) {
+  const char *name = "lfqueue_mpmc_4x4";
+  if (!bench_selected(b, name)) return;
+
+  LfqCtx c;
+  memset(&c, 0, sizeof(c));
+  c.q = lfqueue_create(LFQ_CAPACITY, sizeof(uint64_t));
+  if (!c.q) return;
+  bench_measure(b, name, (int64_t)LFQ_PRODUCERS * LFQ_PER_PRODUCER, NULL,
+                run_lfqueue_mpmc, &c);
+  bench_check(b, name, c.items > 0 && c.lost == 0 && c.mismatched == 0);
+  lfqueue_destroy(c.q);
+}
+
+void bench_suite_common(Bench *b) {
+  bench_lfqueue(b);
+
+  if (!bench_selected(b, "is_video_file") &&
+      !bench_selected(b, "ends_with_ci") && !bench_selected(b, "sort_"))
+    return;
+
+  StringsCtx c;
+  memset(&c, 0, sizeof(c));
+  if (!strings_init(&c)) {
+    fprintf(stderr, "bench: out of memory\n");
+    strings_free(&c);
+    return;
+  }
+
+  bench_measure(b, "is_video_file_1m", c.count, NULL, run_is_video_file, &c);
+  bench_measure(b, "ends_with_ci_1m", c.count, NULL, run_ends_with_ci, &c);
+  bench_measure(b, "sort_cmp_str_100k", SORT_COUNT, setup_sort_str,
+                run_sort_str, &c);
+  bench_measure(b, "sort_cmp_entries_100k", SORT_COUNT, setup_sort_entries,
+                run_sort_entries, &c);
+
+  strings_free(&c);
+}
\ No newline at end of file
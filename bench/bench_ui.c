@@ -0,0 +1,127 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "browser.h"
+#include "common.h"
+#include "ui.h"
+
+#define BROWSER_ENTRIES 10000
+#define BENCH_FONT "fonts/DejaVuSans.ttf"
+
+typedef struct {
+  UiContext ui;
+  FileBrowser browser;
+} BrowserCtx;
+
+static void run_draw_browser(void *arg) {
+  BrowserCtx *c = (BrowserCtx *)arg;
+  ui_draw_browser(&c->ui, &c->browser);
+  bench_sink += (uint64_t)c->browser.scroll;
+}
+
+typedef struct {
+  UiContext *ui;
+  VideoState vid;
+  int frames;
+} ControlsCtx;
+
+/* One control bar per simulated frame, with the progress moving. */
+static void run_draw_controls(void *arg) {
+  ControlsCtx *c = (ControlsCtx *)arg;
+  for (int i = 0; i < c->frames; ++i) {
+    UiPlayerLayout lay;
+    ui_compute_player_layout(c->ui, &lay);
+    c->vid.cur_pts_ms = (c->vid.cur_pts_ms + 40) % c->vid.duration_ms;
+    ui_draw_player_controls(c->ui, &lay, &c->vid, 0, 0);
+  }
+  SDL_RenderFlush(c->ui->ren);
+  bench_sink += (uint64_t)c->vid.cur_pts_ms;
+}
+
+/* The same with the cache dropped every frame, as when it is rebuilt
+ * constantly; close to the old immediate-mode cost. */
+static void run_draw_controls_rebuild(void *arg) {
+  ControlsCtx *c = (ControlsCtx *)arg;
+  for (int i = 0; i < c->frames; ++i) {
+    ui_invalidate_cache(c->ui);
+    UiPlayerLayout lay;
+    ui_compute_player_layout(c->ui, &lay);
+    c->vid.cur_pts_ms = (c->vid.cur_pts_ms + 40) % c->vid.duration_ms;
+    ui_draw_player_controls(c->ui, &lay, &c->vid, 0, 0);
+  }
+  SDL_RenderFlush(c->ui->ren);
+  bench_sink += (uint64_t)c->vid.cur_pts_ms;
+}
+
+static void bench_controls(Bench *b, UiContext *ui) {
+  ControlsCtx c;
+  memset(&c, 0, sizeof(c));
+  c.ui = ui;
+  c.vid.duration_ms = 3600 * 1000;
+  c.vid.volume = 0.7;
+  c.frames = 100;
+
+  bench_measure(b, "ui_draw_controls_100_sw", c.frames, NULL,
+                run_draw_controls, &c);
+  bench_measure(b, "ui_draw_controls_rebuild_100_sw", c.frames, NULL,
+                run_draw_controls_rebuild, &c);
+}
+
+void bench_suite_ui(Bench *b) {
+  if (!bench_selected(b, "ui_draw_browser_10k_sw") &&
+      !bench_selected(b, "ui_draw_controls_100_sw") &&
+      !bench_selected(b, "ui_draw_controls_rebuild_100_sw"))
+    return;
+
+  SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(0, 1280, 720, 32,
+                                                     SDL_PIXELFORMAT_ARGB8888);
+  SDL_Renderer *ren = surf ? SDL_CreateSoftwareRenderer(surf) : NULL;
+  if (!ren) {
+    fprintf(stderr, "bench: software renderer unavailable: %s\n",
+            SDL_GetError());
+    if (surf) SDL_FreeSurface(surf);
+    return;
+  }
+
+  BrowserCtx c;
+  memset(&c, 0, sizeof(c));
+  if (!ui_init(&c.ui, ren, BENCH_FONT) || !ui_load_fonts(&c.ui)) {
+    fprintf(stderr, "bench: cannot load %s (run from the repo root)\n",
+            BENCH_FONT);
+    SDL_DestroyRenderer(ren);
+    SDL_FreeSurface(surf);
+    return;
+  }
+
+  bench_controls(b, &c.ui);
+
+  c.browser.ren = ren;
+  strcpy(c.browser.cwd, "/srv/recordings");
+  c.browser.items =
+      (BrowserEntry *)calloc(BROWSER_ENTRIES, sizeof(BrowserEntry));
+  if (c.browser.items) {
+    char name[64];
+    for (int i = 0; i < BROWSER_ENTRIES; ++i) {
+      snprintf(name, sizeof(name), "camera_%05d.mp4", i);
+      c.browser.items[i].name = str_dupe(name);
+      c.browser.items[i].path = c.browser.items[i].name;
+      c.browser.items[i].is_dir = i < 100;
+    }
+    c.browser.count = BROWSER_ENTRIES;
+    c.browser.selected = BROWSER_ENTRIES / 2;
+    c.browser.scroll = BROWSER_ENTRIES / 2 - 5;
+
+    bench_measure(b, "ui_draw_browser_10k_sw", 1, NULL, run_draw_browser, &c);
+
+    for (int i = 0; i < BROWSER_ENTRIES; ++i) free(c.browser.items[i].name);
+    free(c.browser.items);
+  }
+
+  ui_shutdown(&c.ui);
+  SDL_DestroyRenderer(ren);
+  SDL_FreeSurface(surf);
+}
\ No newline at end of file
@@ -0,0 +1,689 @@
+#include <SDL2/SDL.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "depth.h"
+#include "engine.h"
+#include "framesink.h"
+#include "scaler.h"
+#include "video.h"
+#include "wall.h"
+#include "workpool.h"
+
+#define GAIN_SAMPLES (48000 * 2 * 10)
+
+typedef struct {
+  int16_t *src;
+  int16_t *work;
+} GainCtx;
+
+static void setup_gain(void *arg) {
+  GainCtx *c = (GainCtx *)arg;
+  memcpy(c->work, c->src, GAIN_SAMPLES * sizeof(int16_t));
+}
+
+static void run_gain(void *arg) {
+  GainCtx *c = (GainCtx *)arg;
+  video_apply_gain(c->work, GAIN_SAMPLES, 0.8);
+  bench_sink += (uint64_t)c->work[GAIN_SAMPLES / 2];
+}
+
+static void bench_gain(Bench *b) {
+  if (!bench_selected(b, "audio_gain")) return;
+
+  GainCtx c;
+  c.src = (int16_t *)malloc(GAIN_SAMPLES * sizeof(int16_t));
+  c.work = (int16_t *)malloc(GAIN_SAMPLES * sizeof(int16_t));
+  if (c.src && c.work) {
+    uint32_t seed = 42;
+    for (int i = 0; i < GAIN_SAMPLES; ++i)
+      c.src[i] = (int16_t)(bench_rand(&seed) & 0xffff);
+    bench_measure(b, "audio_gain_10s_stereo", GAIN_SAMPLES, setup_gain,
+                  run_gain, &c);
+  }
+  free(c.src);
+  free(c.work);
+}
+
+typedef struct {
+  struct SwsContext *sws;
+  AVFrame *src;
+  AVFrame *dst;
+} SwsCtx;
+
+static void run_sws(void *arg) {
+  SwsCtx *c = (SwsCtx *)arg;
+  sws_scale(c->sws, (const uint8_t *const *)c->src->data, c->src->linesize, 0,
+            c->src->height, c->dst->data, c->dst->linesize);
+  bench_sink += c->dst->data[0][0];
+}
+
+static AVFrame *bench_alloc_frame(enum AVPixelFormat fmt, int w, int h) {
+  AVFrame *f = av_frame_alloc();
+  if (!f) return NULL;
+  f->format = fmt;
+  f->width = w;
+  f->height = h;
+  if (av_frame_get_buffer(f, 32) < 0) {
+    av_frame_free(&f);
+    return NULL;
+  }
+
+  uint32_t seed = 7;
+  for (int i = 0; i < AV_NUM_DATA_POINTERS && f->buf[i]; ++i) {
+    for (size_t j = 0; j < f->buf[i]->size; ++j)
+      f->buf[i]->data[j] = (uint8_t)(bench_rand(&seed) >> 24);
+  }
+
+  /* Keep high-bit-depth samples inside their nominal range. */
+  if (fmt == AV_PIX_FMT_YUV420P10LE || fmt == AV_PIX_FMT_P010LE) {
+    uint16_t mask = fmt == AV_PIX_FMT_P010LE ? 0xffc0 : 0x03ff;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && f->buf[i]; ++i) {
+      uint16_t *px = (uint16_t *)f->buf[i]->data;
+      for (size_t j = 0; j < f->buf[i]->size / 2; ++j) px[j] &= mask;
+    }
+  }
+  return f;
+}
+
+static void bench_sws(Bench *b) {
+  static const struct {
+    enum AVPixelFormat fmt;
+    const char *name;
+  } formats[] = {
+      {AV_PIX_FMT_YUV420P, "yuv420p"},
+      {AV_PIX_FMT_NV12, "nv12"},
+      {AV_PIX_FMT_YUV422P, "yuv422p"},
+      {AV_PIX_FMT_YUV420P10LE, "yuv420p10"},
+      {AV_PIX_FMT_P010LE, "p010"},
+      {AV_PIX_FMT_BGRA, "bgra"},
+  };
+  static const struct {
+    int w, h;
+    const char *name;
+  } sizes[] = {{1920, 1080, "1080p"}, {3840, 2160, "4k"}};
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+      char name[64];
+      snprintf(name, sizeof(name), "sws_%s_to_yuv420p_%s", formats[f].name,
+               sizes[s].name);
+      if (!bench_selected(b, name)) continue;
+
+      int w = sizes[s].w, h = sizes[s].h;
+      SwsCtx c;
+      c.src = bench_alloc_frame(formats[f].fmt, w, h);
+      c.dst = bench_alloc_frame(AV_PIX_FMT_YUV420P, w, h);
+      c.sws = sws_getContext(w, h, formats[f].fmt, w, h, AV_PIX_FMT_YUV420P,
+                             SWS_BILINEAR, NULL, NULL, NULL);
+      if (c.src && c.dst && c.sws) {
+        bench_measure(b, name, (int64_t)w * h, NULL, run_sws, &c);
+      }
+      sws_freeContext(c.sws);
+      av_frame_free(&c.src);
+      av_frame_free(&c.dst);
+    }
+  }
+}
+
+typedef struct {
+  Scaler scaler;
+  AVFrame *src;
+  AVFrame *dst;
+} ScalerCtx;
+
+static void run_scaler(void *arg) {
+  ScalerCtx *c = (ScalerCtx *)arg;
+  scaler_scale(&c->scaler, c->src, c->dst->data, c->dst->linesize);
+  bench_sink += c->dst->data[0][0];
+}
+
+static int frames_equal(const AVFrame *a, const AVFrame *b, int h) {
+  for (int p = 0; p < 3; ++p) {
+    int lines = p == 0 ? h : (h + 1) / 2;
+    int bytes = a->linesize[p] < b->linesize[p] ? a->linesize[p]
+                                                : b->linesize[p];
+    for (int y = 0; y < lines; ++y) {
+      if (memcmp(a->data[p] + (ptrdiff_t)y * a->linesize[p],
+                 b->data[p] + (ptrdiff_t)y * b->linesize[p],
+                 (size_t)bytes) != 0)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+/* Scaling of the sliced converter from one thread to every core, checked
+ * against the single-threaded output. */
+static void bench_scaler_threads(Bench *b) {
+  static const struct {
+    enum AVPixelFormat fmt;
+    int src_w, src_h, dst_w, dst_h;
+    const char *name;
+  } cases[] = {
+      {AV_PIX_FMT_YUV420P10LE, 7680, 4320, 7680, 4320, "yuv420p10_8k"},
+      {AV_PIX_FMT_NV12, 7680, 4320, 7680, 4320, "nv12_8k"},
+      {AV_PIX_FMT_YUV422P, 7680, 4320, 3840, 2160, "yuv422p_8k_to_4k"},
+  };
+  int cores = workpool_cpu_count();
+
+  /* Powers of two below the core count, then the core count itself. */
+  int counts[32];
+  int ncounts = 0;
+  for (int t = 1; t < cores && ncounts < 31; t *= 2) counts[ncounts++] = t;
+  counts[ncounts++] = cores > 1 ? cores : 1;
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "scaler_%s_t", cases[i].name);
+    if (!bench_selected(b, prefix)) continue;
+
+    AVFrame *src = bench_alloc_frame(cases[i].fmt, cases[i].src_w,
+                                     cases[i].src_h);
+    AVFrame *ref = bench_alloc_frame(AV_PIX_FMT_YUV420P, cases[i].dst_w,
+                                     cases[i].dst_h);
+    if (!src || !ref) {
+      av_frame_free(&src);
+      av_frame_free(&ref);
+      continue;
+    }
+
+    for (int k = 0; k < ncounts; ++k) {
+      int t = counts[k];
+      char name[80];
+      snprintf(name, sizeof(name), "%s%d", prefix, t);
+
+      ScalerCtx c;
+      memset(&c, 0, sizeof(c));
+      c.src = src;
+      c.dst = t == 1 ? ref
+                     : bench_alloc_frame(AV_PIX_FMT_YUV420P, cases[i].dst_w,
+                                         cases[i].dst_h);
+      if (c.dst &&
+          scaler_configure(&c.scaler, cases[i].src_w, cases[i].src_h,
+                           cases[i].fmt, cases[i].dst_w, cases[i].dst_h,
+                           AV_PIX_FMT_YUV420P, SWS_BILINEAR, t)) {
+        bench_measure(b, name, (int64_t)cases[i].src_w * cases[i].src_h, NULL,
+                      run_scaler, &c);
+        if (t > 1)
+          bench_check(b, name, frames_equal(ref, c.dst, cases[i].dst_h));
+      }
+      scaler_free(&c.scaler);
+      if (c.dst != ref) av_frame_free(&c.dst);
+    }
+
+    av_frame_free(&src);
+    av_frame_free(&ref);
+  }
+}
+
+typedef struct {
+  AVFrame *src;
+  AVFrame *dst;
+} DepthCtx;
+
+static void run_depth(void *arg) {
+  DepthCtx *c = (DepthCtx *)arg;
+  depth_convert(c->src, c->dst->data, c->dst->linesize);
+  bench_sink += c->dst->data[0][0];
+}
+
+static void run_depth_t1(void *arg) {
+  DepthCtx *c = (DepthCtx *)arg;
+  depth_convert_rows(c->src, c->dst->data, c->dst->linesize, 0,
+                     c->src->height);
+  bench_sink += c->dst->data[0][0];
+}
+
+/* Every luma sample is its value shifted down to 8 bits, or one above that
+ * where the dither rounded it up. */
+static int depth_luma_ok(const AVFrame *src, const AVFrame *dst) {
+  int shift = src->format == AV_PIX_FMT_P010LE ? 8 : 2;
+  for (int y = 0; y < src->height; ++y) {
+    const uint16_t *s =
+        (const uint16_t *)(src->data[0] + (ptrdiff_t)y * src->linesize[0]);
+    const uint8_t *d = dst->data[0] + (ptrdiff_t)y * dst->linesize[0];
+    for (int x = 0; x < src->width; ++x) {
+      int ref = s[x] >> shift;
+      if (d[x] < ref || d[x] > ref + 1) return 0;
+    }
+  }
+  return 1;
+}
+
+/* The 10-bit reduction kernel at 4K, on one thread and on the pool; the
+ * sws_p010_* and sws_yuv420p10_* cases are the swscale equivalent. */
+static void bench_depth(Bench *b) {
+  static const struct {
+    enum AVPixelFormat fmt;
+    const char *name;
+  } formats[] = {
+      {AV_PIX_FMT_YUV420P10LE, "yuv420p10"},
+      {AV_PIX_FMT_P010LE, "p010"},
+  };
+  int w = 3840, h = 2160;
+
+  for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+    char name[64];
+    snprintf(name, sizeof(name), "depth_%s_to_yuv420p_4k", formats[f].name);
+    if (!bench_selected(b, name)) continue;
+
+    DepthCtx c;
+    c.src = bench_alloc_frame(formats[f].fmt, w, h);
+    c.dst = bench_alloc_frame(AV_PIX_FMT_YUV420P, w, h);
+    if (c.src && c.dst) {
+      char t1[80];
+      snprintf(t1, sizeof(t1), "%s_t1", name);
+      bench_measure(b, t1, (int64_t)w * h, NULL, run_depth_t1, &c);
+      bench_measure(b, name, (int64_t)w * h, NULL, run_depth, &c);
+      bench_check(b, name, depth_luma_ok(c.src, c.dst));
+    }
+    av_frame_free(&c.src);
+    av_frame_free(&c.dst);
+  }
+}
+
+typedef struct {
+  SDL_Renderer *ren;
+  SDL_Texture *tex;
+  SDL_Rect dst;
+  int yuv;
+  int tex_h;
+  Scaler scaler;
+  AVFrame *src;
+} SwRenderCtx;
+
+/* One presented frame as the player does it: convert into the locked
+ * streaming texture, then let the software renderer draw it letterboxed. */
+static void run_swrender(void *arg) {
+  SwRenderCtx *c = (SwRenderCtx *)arg;
+  void *pixels = NULL;
+  int pitch = 0;
+  if (SDL_LockTexture(c->tex, NULL, &pixels, &pitch) != 0) return;
+
+  uint8_t *planes[4] = {(uint8_t *)pixels, NULL, NULL, NULL};
+  int strides[4] = {pitch, 0, 0, 0};
+  if (c->yuv) {
+    int cpitch = (pitch + 1) / 2;
+    uint8_t *vp = planes[0] + (size_t)pitch * c->tex_h;
+    planes[1] = vp + (size_t)cpitch * ((c->tex_h + 1) / 2);
+    planes[2] = vp;
+    strides[1] = strides[2] = cpitch;
+  }
+  scaler_scale(&c->scaler, c->src, planes, strides);
+  SDL_UnlockTexture(c->tex);
+
+  SDL_RenderCopy(c->ren, c->tex, NULL, &c->dst);
+  bench_sink += (uint64_t)pitch;
+}
+
+/* The software renderer fallback: the YV12 texture SDL converts and scales
+ * itself, against converting to the surface's RGB format at the displayed
+ * size. */
+static void bench_swrender(Bench *b) {
+  static const struct {
+    int src_w, src_h, win_w, win_h;
+    const char *name;
+  } cases[] = {
+      {1920, 1080, 1280, 800, "1080p_in_1280x800"},
+      {1280, 720, 1920, 1080, "720p_in_1920x1080"},
+  };
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    for (int yuv = 1; yuv >= 0; --yuv) {
+      char name[80];
+      snprintf(name, sizeof(name), "swrender_%s_%s",
+               yuv ? "yv12" : "rgb", cases[i].name);
+      if (!bench_selected(b, name)) continue;
+
+      int sw = cases[i].src_w, sh = cases[i].src_h;
+      int ww = cases[i].win_w, wh = cases[i].win_h;
+      double sc = (double)ww / sw < (double)wh / sh ? (double)ww / sw
+                                                    : (double)wh / sh;
+      SDL_Rect dst = {0, 0, (int)(sw * sc), (int)(sh * sc)};
+      dst.x = (ww - dst.w) / 2;
+      dst.y = (wh - dst.h) / 2;
+
+      /* The YV12 path only ever downscales, to even sizes. */
+      int tw = dst.w, th = dst.h;
+      if (yuv) {
+        tw = sw < dst.w ? sw : dst.w & ~1;
+        th = sh < dst.h ? sh : dst.h & ~1;
+      }
+
+      SwRenderCtx c;
+      memset(&c, 0, sizeof(c));
+      SDL_Surface *surf = SDL_CreateRGBSurfaceWithFormat(
+          0, ww, wh, 32, SDL_PIXELFORMAT_ARGB8888);
+      c.ren = surf ? SDL_CreateSoftwareRenderer(surf) : NULL;
+      c.tex = c.ren ? SDL_CreateTexture(c.ren,
+                                        yuv ? SDL_PIXELFORMAT_YV12
+                                            : SDL_PIXELFORMAT_ARGB8888,
+                                        SDL_TEXTUREACCESS_STREAMING, tw, th)
+                    : NULL;
+      c.dst = dst;
+      c.yuv = yuv;
+      c.tex_h = th;
+      c.src = bench_alloc_frame(AV_PIX_FMT_YUV420P, sw, sh);
+
+      if (c.tex && c.src &&
+          scaler_configure(&c.scaler, sw, sh, AV_PIX_FMT_YUV420P, tw, th,
+                           yuv ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_RGB32,
+                           SWS_BILINEAR, 0)) {
+        bench_measure(b, name, (int64_t)dst.w * dst.h, NULL, run_swrender,
+                      &c);
+      } else {
+        fprintf(stderr, "bench: %s unavailable: %s\n", name, SDL_GetError());
+      }
+
+      scaler_free(&c.scaler);
+      av_frame_free(&c.src);
+      if (c.tex) SDL_DestroyTexture(c.tex);
+      if (c.ren) SDL_DestroyRenderer(c.ren);
+      if (surf) SDL_FreeSurface(surf);
+    }
+  }
+}
+
+#define WALL_CLIP "player_bench_wall.mkv"
+#define WALL_CLIP_W 1280
+#define WALL_CLIP_H 720
+#define WALL_CLIP_FRAMES 50
+/* Frames decoded per tile in one run. */
+#define WALL_RUN_FRAMES 25
+
+static int encode_clip(AVFormatContext *fmt, AVCodecContext *enc,
+                       AVStream *st, AVFrame *f, AVPacket *pkt) {
+  enc->width = f->width;
+  enc->height = f->height;
+  enc->pix_fmt = AV_PIX_FMT_YUV420P;
+  enc->time_base = (AVRational){1, 25};
+  enc->framerate = (AVRational){25, 1};
+  enc->gop_size = 12;
+  enc->bit_rate = 4000000;
+  if (fmt->oformat->flags & AVFMT_GLOBALHEADER)
+    enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  if (avcodec_open2(enc, enc->codec, NULL) < 0 ||
+      avcodec_parameters_from_context(st->codecpar, enc) < 0) {
+    return 0;
+  }
+  st->time_base = enc->time_base;
+  if (avio_open(&fmt->pb, WALL_CLIP, AVIO_FLAG_WRITE) < 0 ||
+      avformat_write_header(fmt, NULL) < 0) {
+    return 0;
+  }
+
+  for (int i = 0; i <= WALL_CLIP_FRAMES; ++i) {
+    AVFrame *in = NULL;
+    /* A diagonal ramp drifting across the picture. */
+    if (i < WALL_CLIP_FRAMES && av_frame_make_writable(f) >= 0) {
+      for (int y = 0; y < f->height; ++y) {
+        uint8_t *row = f->data[0] + (size_t)y * f->linesize[0];
+        for (int x = 0; x < f->width; ++x)
+          row[x] = (uint8_t)(x + 2 * y + 6 * i);
+      }
+      f->pts = i;
+      in = f;
+    }
+    if (avcodec_send_frame(enc, in) < 0) return 0;
+    while (avcodec_receive_packet(enc, pkt) >= 0) {
+      av_packet_rescale_ts(pkt, enc->time_base, st->time_base);
+      pkt->stream_index = st->index;
+      if (av_interleaved_write_frame(fmt, pkt) < 0) return 0;
+    }
+  }
+  return av_write_trailer(fmt) >= 0;
+}
+
+/* Writes a short 720p MPEG-4 clip for the wall to decode. */
+static int write_wall_clip(void) {
+  const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+  AVFormatContext *fmt = NULL;
+  if (!codec ||
+      avformat_alloc_output_context2(&fmt, NULL, "matroska", WALL_CLIP) < 0)
+    return 0;
+
+  AVStream *st = avformat_new_stream(fmt, NULL);
+  AVCodecContext *enc = avcodec_alloc_context3(codec);
+  AVFrame *f = bench_alloc_frame(AV_PIX_FMT_YUV420P, WALL_CLIP_W, WALL_CLIP_H);
+  AVPacket *pkt = av_packet_alloc();
+  int ok = st && enc && f && pkt && encode_clip(fmt, enc, st, f, pkt);
+
+  av_packet_free(&pkt);
+  av_frame_free(&f);
+  avcodec_free_context(&enc);
+  if (fmt->pb) avio_closep(&fmt->pb);
+  avformat_free_context(fmt);
+  return ok;
+}
+
+typedef struct {
+  VideoWall wall;
+  Uint32 now;
+} WallCtx;
+
+/* Advances a virtual clock one frame interval per batch, so every tile is
+ * due each time and none is ever late. */
+static void run_wall(void *arg) {
+  WallCtx *c = (WallCtx *)arg;
+  for (int i = 0; i < WALL_RUN_FRAMES; ++i) {
+    c->now += (Uint32)c->wall.tiles[0].frame_ms;
+    wall_decode(&c->wall, c->now);
+  }
+  bench_sink += c->wall.tiles[0].decoded;
+}
+
+static void bench_wall(Bench *b) {
+  static const int tiles[] = {1, 2, 4, 9, 16};
+
+  int wanted = 0;
+  char name[80];
+  for (size_t i = 0; i < sizeof(tiles) / sizeof(tiles[0]); ++i) {
+    snprintf(name, sizeof(name), "wall_%d_tiles", tiles[i]);
+    wanted |= bench_selected(b, name);
+  }
+  if (!wanted) return;
+  if (!write_wall_clip()) {
+    fprintf(stderr, "bench: wall_ unavailable: cannot encode a clip\n");
+    return;
+  }
+
+  const char *paths[WALL_MAX_TILES];
+  for (int i = 0; i < WALL_MAX_TILES; ++i) paths[i] = WALL_CLIP;
+
+  for (size_t i = 0; i < sizeof(tiles) / sizeof(tiles[0]); ++i) {
+    snprintf(name, sizeof(name), "wall_%d_tiles", tiles[i]);
+    if (!bench_selected(b, name)) continue;
+
+    WallCtx c;
+    if (!wall_open(&c.wall, paths, tiles[i], 1920, 1080)) continue;
+    /* Measure the full decode cost at every tile count. */
+    c.wall.degrade_on = 0;
+    c.now = c.wall.tiles[0].due_ticks - (Uint32)c.wall.tiles[0].frame_ms;
+    bench_measure(b, name, (int64_t)tiles[i] * WALL_RUN_FRAMES, NULL,
+                  run_wall, &c);
+    wall_close(&c.wall);
+  }
+  remove(WALL_CLIP);
+}
+
+#define FRAMESINK_SHM "/player_bench_frames"
+#define FRAMESINK_RUN_FRAMES 16
+
+typedef struct {
+  AVFrame *src;
+  int64_t pts_ms;
+} FrameSinkCtx;
+
+/* Submits as fast as the export thread takes frames, so nothing is dropped
+ * and the time per item is the export throughput. */
+static void run_framesink(void *arg) {
+  FrameSinkCtx *c = (FrameSinkCtx *)arg;
+  for (int i = 0; i < FRAMESINK_RUN_FRAMES; ++i) {
+    while (!framesink_submit(c->src, c->pts_ms)) framesink_flush();
+    c->pts_ms += 40;
+  }
+  framesink_flush();
+}
+
+/* Reads the newest frame back the way an outside reader would and compares
+ * its luma with the source. */
+static int framesink_roundtrip_ok(const AVFrame *src, int64_t pts_ms) {
+  int fd = shm_open(FRAMESINK_SHM, O_RDONLY, 0);
+  if (fd < 0) return 0;
+  FrameSinkHeader probe;
+  if (read(fd, &probe, sizeof(probe)) != (ssize_t)sizeof(probe)) {
+    close(fd);
+    return 0;
+  }
+  size_t size = probe.header_size + probe.slot_count * probe.slot_size;
+  unsigned char *map =
+      (unsigned char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return 0;
+
+  FrameSinkHeader *hdr = (FrameSinkHeader *)map;
+  uint64_t n = atomic_load(&hdr->published);
+  const unsigned char *base = map + hdr->header_size +
+                              ((n - 1) % hdr->slot_count) * hdr->slot_size;
+  FrameSinkSlot *slot = (FrameSinkSlot *)base;
+
+  int ok = hdr->magic == FRAMESINK_MAGIC && n > 0 &&
+           atomic_load(&slot->seq) == 2 * n && slot->pts_ms == pts_ms &&
+           slot->format == FRAMESINK_FORMAT_I420 &&
+           slot->width == (uint32_t)src->width &&
+           slot->height == (uint32_t)src->height;
+  for (int y = 0; ok && y < src->height; ++y) {
+    ok = memcmp(base + slot->offset[0] + (size_t)y * slot->pitch[0],
+                src->data[0] + (ptrdiff_t)y * src->linesize[0],
+                (size_t)src->width) == 0;
+  }
+  munmap(map, size);
+  return ok;
+}
+
+/* Publishing into the shared-memory ring: a plain copy for 4:2:0 sources,
+ * a conversion for NV12. */
+static void bench_framesink(Bench *b) {
+  static const struct {
+    enum AVPixelFormat fmt;
+    int w, h;
+    const char *name;
+  } cases[] = {
+      {AV_PIX_FMT_YUV420P, 1920, 1080, "framesink_yuv420p_1080p"},
+      {AV_PIX_FMT_NV12, 1920, 1080, "framesink_nv12_1080p"},
+      {AV_PIX_FMT_YUV420P, 3840, 2160, "framesink_yuv420p_4k"},
+  };
+
+  int wanted = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    wanted |= bench_selected(b, cases[i].name);
+  }
+  if (!wanted) return;
+  if (!framesink_init(FRAMESINK_SHM, 4)) {
+    fprintf(stderr, "bench: framesink_ unavailable\n");
+    return;
+  }
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    if (!bench_selected(b, cases[i].name)) continue;
+
+    FrameSinkCtx c;
+    c.src = bench_alloc_frame(cases[i].fmt, cases[i].w, cases[i].h);
+    c.pts_ms = 0;
+    if (c.src) {
+      bench_measure(b, cases[i].name, FRAMESINK_RUN_FRAMES, NULL,
+                    run_framesink, &c);
+      if (cases[i].fmt == AV_PIX_FMT_YUV420P) {
+        bench_check(b, cases[i].name,
+                    framesink_roundtrip_ok(c.src, c.pts_ms - 40));
+      }
+    }
+    av_frame_free(&c.src);
+  }
+  framesink_shutdown();
+}
+
+/* Longest the engine check waits for each event. */
+#define ENGINE_CHECK_MS 5000
+
+static void engine_count_frame(void *opaque, const uint8_t *pixels,
+                               int pitch, int width, int height,
+                               int64_t pts_ms) {
+  (void)pixels;
+  (void)pitch;
+  (void)width;
+  (void)height;
+  (void)pts_ms;
+  atomic_fetch_add((atomic_int *)opaque, 1);
+}
+
+/* Waits for an event of `type`; other events are skipped. */
+static int engine_wait_event(Engine *e, EngineEventType type) {
+  Uint32 start = SDL_GetTicks();
+  while (SDL_GetTicks() - start < ENGINE_CHECK_MS) {
+    EngineEvent ev;
+    if (!engine_poll_event(e, &ev)) {
+      SDL_Delay(5);
+    } else if (ev.type == type) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* libdummyplayer end to end: a missing file reports an error, the clip
+ * opens and delivers frames, and the engine shuts down cleanly. */
+static void bench_engine(Bench *b) {
+  const char *name = "engine_open_play";
+  if (!bench_selected(b, name)) return;
+  if (!write_wall_clip()) {
+    fprintf(stderr, "bench: %s unavailable: cannot encode a clip\n", name);
+    return;
+  }
+  /* The check needs no sound card. */
+  SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+
+  atomic_int frames;
+  atomic_init(&frames, 0);
+  Engine *e = engine_create(320, 180, engine_count_frame, &frames);
+  int ok = e != NULL;
+  if (ok) {
+    ok = engine_open(e, "player_bench_missing.mkv") &&
+         engine_wait_event(e, ENGINE_EVENT_ERROR);
+    ok = ok && engine_open(e, WALL_CLIP) &&
+         engine_wait_event(e, ENGINE_EVENT_OPENED);
+
+    Uint32 start = SDL_GetTicks();
+    while (ok && atomic_load(&frames) == 0 &&
+           SDL_GetTicks() - start < ENGINE_CHECK_MS) {
+      SDL_Delay(5);
+    }
+    ok = ok && atomic_load(&frames) > 0;
+    engine_destroy(e);
+  }
+  bench_check(b, name, ok);
+  remove(WALL_CLIP);
+}
+
+void bench_suite_video(Bench *b) {
+  bench_gain(b);
+  bench_sws(b);
+  bench_scaler_threads(b);
+  bench_depth(b);
+  bench_swrender(b);
+  bench_wall(b);
+  bench_engine(b);
+  bench_framesink(b);
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <stdint.h>
+
+/* The session's audio output. It is opened once at a fixed format and every
+ * file is resampled to it, so track changes never reopen the device.
+ *
+ * Samples are handed to the device from a ring buffer in the SDL audio
+ * callback, which also times the device's pulls: the measured period is the
+ * latency the device adds on top of what is still queued. The queue is kept
+ * between a low and a high watermark; in adaptive mode both are widened
+ * each time the device runs dry. */
+
+#define AUDIO_OUT_RATE 48000
+#define AUDIO_OUT_CHANNELS 2
+#define AUDIO_OUT_RING_MS 8000
+#define AUDIO_OUT_MAX_WATERMARK_MS 2000
+
+typedef struct AudioOutStats {
+  int underruns;
+  uint64_t dropped_bytes;
+  int low_ms, high_ms;
+  double queue_ms;
+  double device_ms;
+  double nominal_device_ms;
+} AudioOutStats;
+
+typedef struct AudioOut {
+  SDL_AudioDeviceID dev;
+  int sample_rate;
+  int channels;
+  int bytes_per_sample;
+  int buffer_samples;
+
+  int low_ms, high_ms;
+  int adaptive;
+  int refilling;
+
+  /* Shared with the callback; guarded by SDL_LockAudioDevice. */
+  uint8_t *ring;
+  Uint32 ring_size;
+  Uint32 ring_read;
+  Uint32 ring_fill;
+  int primed;
+  int starved;
+  Uint64 last_pull;
+  double pull_period_ms;
+
+  int underruns;
+  uint64_t dropped_bytes;
+} AudioOut;
+
+int audio_out_open(AudioOut *a, int buffer_samples, int low_ms, int high_ms,
+                   int adaptive);
+void audio_out_close(AudioOut *a);
+int audio_out_is_open(const AudioOut *a);
+
+/* Interleaved signed 16-bit samples in the device's rate and layout. */
+void audio_out_queue(AudioOut *a, const void *data, Uint32 bytes);
+void audio_out_clear(AudioOut *a);
+void audio_out_set_paused(AudioOut *a, int paused);
+
+Uint32 audio_out_queued_bytes(AudioOut *a);
+int audio_out_bytes_per_second(const AudioOut *a);
+
+/* Whether more audio should be decoded: true once the queue falls below
+ * the low watermark, until it is back above the high one. */
+int audio_out_wants_data(AudioOut *a);
+
+/* Time until a sample queued now is heard: the queue plus the device. */
+double audio_out_latency_ms(AudioOut *a);
+
+void audio_out_get_stats(AudioOut *a, AudioOutStats *out);
+void audio_out_report(AudioOut *a);
@@ -37,5 +37,7 @@ typedef struct FileBrowser {
 FileBrowser *browser_create(SDL_Renderer *ren, const char *start_dir);
 void browser_destroy(FileBrowser *b);
 
+int cmp_entries(const void *a, const void *b);
+
 BrowserResult browser_handle_event(FileBrowser *b, const SDL_Event *e);
 char *browser_take_selected_path(FileBrowser *b);
\ No newline at end of file
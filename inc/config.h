@@ -0,0 +1,56 @@
+#pragma once
+
+/* Runtime knobs, read once from the environment at startup. */
+
+typedef enum {
+  IO_MODE_DEFAULT = 0, /* FFmpeg's own file protocol */
+  IO_MODE_PREAD,       /* custom AVIO, synchronous pread + fadvise */
+  IO_MODE_PREFETCH,    /* custom AVIO fed by a read-ahead thread */
+  IO_MODE_MMAP         /* custom AVIO over a private read-only mapping */
+} IoMode;
+
+typedef struct PlayerConfig {
+  const char *trace_path;
+  /* Unix-domain socket for remote control, or NULL. */
+  const char *control_socket;
+  /* Shared-memory object presented frames are exported to, or NULL. */
+  const char *frame_export;
+  int frame_export_slots;
+
+  IoMode io_mode;
+  int io_buffer_kb;
+  int io_prefetch_mb;
+
+  int huge_pages;
+
+  /* Reduced demuxer probing, backed by the stream info cache. */
+  int fast_open;
+  int probe_kb;
+  int analyze_ms;
+
+  /* Audio device buffer in sample frames, and the queue watermarks. */
+  int audio_samples;
+  int audio_low_ms;
+  int audio_high_ms;
+  int audio_adaptive;
+
+  int gop_cache_mb;
+
+  /* Lower decode quality while frames take longer than their interval. */
+  int degrade;
+
+  /* Convert to RGB at the displayed size when SDL renders in software. */
+  int sw_fast_path;
+
+  /* Reduce 10-bit 4:2:0 frames with the dithering kernel, not swscale. */
+  int hbd_fast_path;
+
+  /* Play audio only, without decoding video, while the window is hidden. */
+  int background_audio;
+
+  /* Play this many playlist entries at once in a grid; 0 plays one. */
+  int wall_tiles;
+} PlayerConfig;
+
+void config_load_env(void);
+const PlayerConfig *player_config(void);
\ No newline at end of file
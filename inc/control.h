@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Remote control over a Unix-domain socket (PLAYER_CONTROL_SOCKET). Each
+ * request is one JSON object per line, answered by one line:
+ *
+ *   {"cmd":"pause"}                  {"ok":true}
+ *   {"cmd":"seek","ms":90000}        {"ok":true}
+ *   {"cmd":"stats"}                  {"ok":true,"fps":25.0,...}
+ *
+ * A thread of its own accepts clients and parses requests. Commands reach
+ * the render thread through a lock-free queue that it drains once per
+ * frame, and "ok" means queued. Metrics go the other way through a
+ * seqlock the render thread writes without ever waiting. */
+
+#define CONTROL_PATH_MAX 1024
+
+typedef enum {
+  CONTROL_PLAY = 1,
+  CONTROL_PAUSE,
+  CONTROL_TOGGLE,
+  CONTROL_SEEK,
+  CONTROL_NEXT,
+  CONTROL_PREV,
+  CONTROL_VOLUME,
+  CONTROL_OPEN
+} ControlAction;
+
+typedef struct ControlCommand {
+  ControlAction action;
+  int64_t ms;
+  double value;
+  char path[CONTROL_PATH_MAX];
+} ControlCommand;
+
+/* Published by the player for "stats" requests. */
+typedef struct ControlMetrics {
+  /* "browse", "loading", "play" or "wall". */
+  const char *state;
+  int paused;
+  int64_t position_ms;
+  int64_t duration_ms;
+  double volume;
+
+  double fps;
+  uint64_t frames_shown;
+  uint64_t frames_dropped;
+  uint64_t frames_late;
+  int has_drift;
+  double av_drift_ms;
+  int quality_level;
+
+  double audio_queue_ms;
+  double audio_device_ms;
+  int audio_underruns;
+
+  /* Open to first frame of the current file. */
+  double first_frame_ms;
+} ControlMetrics;
+
+typedef struct ControlServer ControlServer;
+
+/* Replaces a stale socket file at `path`. Returns NULL on failure. */
+ControlServer *control_open(const char *path);
+void control_close(ControlServer *c);
+
+/* Render thread: takes the oldest queued command; returns 0 if none. */
+int control_poll(ControlServer *c, ControlCommand *out);
+
+/* Render thread: replaces the published metrics. Never blocks. */
+void control_publish(ControlServer *c, const ControlMetrics *m);
\ No newline at end of file
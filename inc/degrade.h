@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Decode quality levels, each adding to the one before:
+ *   1  no loop filter on non-reference frames
+ *   2  no loop filter at all
+ *   3  no IDCT on non-reference frames, fast bilinear scaling
+ *   4  non-reference frames not decoded */
+#define DEGRADE_MAX_LEVEL 4
+
+/* Watches the decode and convert cost of each shown frame against its
+ * frame interval. Sustained lateness raises the level one step at a time;
+ * a few seconds of headroom lowers it again. A level that had to be raised
+ * again soon after being lowered is held longer before the next try. */
+typedef struct Degrade {
+  int level;
+  uint32_t level_since;
+
+  /* Smoothed cost / frame interval. */
+  double load;
+
+  uint32_t window_start;
+  int window_frames;
+  int window_late;
+
+  uint32_t headroom_since;
+  uint32_t lowered_at;
+  uint32_t hold_ms;
+
+  uint32_t ms_at_level[DEGRADE_MAX_LEVEL + 1];
+  int changes;
+} Degrade;
+
+void degrade_reset(Degrade *d, uint32_t now);
+
+/* Feeds one shown frame that took `cost_ms` of a `frame_ms` interval.
+ * Returns the new level when it changed, -1 otherwise. */
+int degrade_update(Degrade *d, double cost_ms, int frame_ms, uint32_t now);
+
+/* Time spent at each level so far, including the current one. */
+void degrade_totals(const Degrade *d, uint32_t now,
+                    uint32_t out[DEGRADE_MAX_LEVEL + 1]);
+
+const char *degrade_level_name(int level);
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+struct AVFrame;
+
+/* 10-bit 4:2:0 frames (P010, YUV420P10) reduced to 8-bit YUV420P without
+ * libswscale: each sample gets a 2x2 ordered dither offset, is shifted
+ * down and saturated, sixteen at a time with SSE2 where available. Large
+ * frames are split into bands across the shared WorkPool. */
+
+int depth_supported(int pix_fmt);
+
+/* Converts luma rows [y0, y1) and the chroma rows under them; y0 must be
+ * even. `dst` holds the Y, U and V planes. */
+void depth_convert_rows(const struct AVFrame *src, uint8_t *const dst[3],
+                        const int dst_stride[3], int y0, int y1);
+
+void depth_convert(const struct AVFrame *src, uint8_t *const dst[3],
+                   const int dst_stride[3]);
\ No newline at end of file
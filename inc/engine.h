@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Playback engine for embedding in other programs, built as libdummyplayer
+ * (`make lib`). Decoding, the media clock and audio output run on the
+ * engine's own thread. Any host thread may queue commands, and the host
+ * polls for events whenever it likes. Both queues are lock-free, so
+ * neither side ever waits for the other.
+ *
+ * Video is optional: with a frame callback, every shown frame is rendered
+ * in software, letterboxed into a `width` x `height` ARGB8888 buffer, and
+ * handed to the callback on the engine thread. The buffer is only valid
+ * during the call. */
+
+#define ENGINE_MESSAGE_MAX 256
+#define ENGINE_POSITION_MS 250
+
+typedef struct Engine Engine;
+
+typedef enum {
+  /* A file is open and playing; `duration_ms` is set and `message` holds
+   * the path. */
+  ENGINE_EVENT_OPENED = 1,
+  /* Sent every ENGINE_POSITION_MS while playing, and after each seek. */
+  ENGINE_EVENT_POSITION,
+  ENGINE_EVENT_EOF,
+  /* `message` says what failed. */
+  ENGINE_EVENT_ERROR
+} EngineEventType;
+
+typedef struct EngineEvent {
+  EngineEventType type;
+  int64_t position_ms;
+  int64_t duration_ms;
+  char message[ENGINE_MESSAGE_MAX];
+} EngineEvent;
+
+typedef void (*EngineFrameFn)(void *opaque, const uint8_t *pixels, int pitch,
+                              int width, int height, int64_t pts_ms);
+
+/* `on_frame` may be NULL for audio-only use. */
+Engine *engine_create(int width, int height, EngineFrameFn on_frame,
+                      void *opaque);
+/* Destroying the last engine also stops the worker threads and frees the
+ * caches all engines share, so the library can then be unloaded. */
+void engine_destroy(Engine *e);
+
+/* Each returns 0 when the command queue is full. */
+int engine_open(Engine *e, const char *path);
+int engine_seek(Engine *e, int64_t ms);
+int engine_pause(Engine *e, int paused);
+int engine_set_volume(Engine *e, double volume);
+
+/* Takes the oldest event. Returns 0 when there is none. Events that find
+ * the queue full are dropped and counted. */
+int engine_poll_event(Engine *e, EngineEvent *ev);
\ No newline at end of file
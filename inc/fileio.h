@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+struct AVIOContext;
+
+#define FILEIO_CHUNK_BYTES (1024 * 1024)
+
+typedef struct FileIoStats {
+  uint64_t bytes_read;
+  uint64_t syscalls;
+  uint64_t seeks;
+  uint64_t stall_ns;
+} FileIoStats;
+
+typedef struct FileIo FileIo;
+
+/* Custom AVIOContext for local files. Returns NULL when `path` is not a
+ * regular local file or `mode` is IO_MODE_DEFAULT. */
+FileIo *fileio_open(const char *path, IoMode mode, size_t buffer_size,
+                    size_t prefetch_bytes);
+void fileio_close(FileIo *f);
+
+struct AVIOContext *fileio_avio(FileIo *f);
+void fileio_get_stats(FileIo *f, FileIoStats *out);
+
+int fileio_is_local_path(const char *path);
+const char *fileio_mode_name(IoMode mode);
\ No newline at end of file
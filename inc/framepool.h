@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+struct AVCodecContext;
+
+#define FRAMEPOOL_ALIGN 64
+#define FRAMEPOOL_MAX_POOLS 4
+#define FRAMEPOOL_HUGE_PAGE (2 * 1024 * 1024)
+
+typedef struct FramePoolStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t resident_bytes;
+  int pools;
+} FramePoolStats;
+
+/* Routes the decoder's frame allocations through a process-wide set of
+ * AVBufferPools keyed by pixel format and aligned geometry, so consecutive
+ * files of the same resolution reuse the same buffers. Formats the pool
+ * does not handle (hwaccel, palettes) use FFmpeg's default allocator. */
+void framepool_attach(struct AVCodecContext *dec, int huge_pages);
+
+void framepool_get_stats(FramePoolStats *out);
+void framepool_shutdown(void);
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+struct AVFrame;
+
+/* Exports every presented frame into a POSIX shared-memory ring
+ * (PLAYER_FRAME_EXPORT) for other processes to analyse.
+ *
+ * The render thread only queues a reference to the decoded frame; a thread
+ * of its own writes it into the next slot as I420, converting and scaling
+ * down to FRAMESINK_MAX_WIDTH x FRAMESINK_MAX_HEIGHT only when needed. When
+ * that thread falls behind, frames are dropped rather than waited for.
+ *
+ * Readers map the object read-only and never write to it, so any number of
+ * them can follow the ring without the player knowing. To read the newest
+ * frame:
+ *
+ *   n = published (acquire); if 0 or already seen, wait and retry.
+ *   slot = slot (n - 1) % slot_count; s = slot->seq (acquire).
+ *   s != 2 * n: the slot has moved on to a later frame; start over.
+ *   use the pixels in place, then re-read slot->seq after an acquire fence.
+ *   changed: the writer lapped the reader, discard what was read.
+ *
+ * A frame stays intact until slot_count - 1 newer frames have been
+ * published, which is how long a reader has to finish with it. */
+
+#define FRAMESINK_MAGIC 0x4b4e5346u /* "FSNK" */
+#define FRAMESINK_VERSION 1
+/* Planar 8-bit 4:2:0, Y then U then V. */
+#define FRAMESINK_FORMAT_I420 0x30323449u /* "I420" */
+
+#define FRAMESINK_MAX_WIDTH 3840
+#define FRAMESINK_MAX_HEIGHT 2160
+#define FRAMESINK_MIN_SLOTS 2
+#define FRAMESINK_MAX_SLOTS 64
+/* Pixels start this far into their slot. */
+#define FRAMESINK_SLOT_HEADER 64
+
+/* At offset 0 of the shared object; slots follow at header_size. */
+typedef struct FrameSinkHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t slot_count;
+  uint64_t slot_size;
+  uint32_t max_width;
+  uint32_t max_height;
+  /* Frames published so far. Frame n, counting from 1, is in slot
+   * (n - 1) % slot_count. */
+  _Atomic uint64_t published;
+} FrameSinkHeader;
+
+/* At the start of every slot. */
+typedef struct FrameSinkSlot {
+  /* 2n - 1 while frame n is written into the slot, 2n once complete. */
+  _Atomic uint64_t seq;
+  int64_t pts_ms;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  /* Planes, from the start of the slot. */
+  uint32_t offset[3];
+  uint32_t pitch[3];
+} FrameSinkSlot;
+
+/* Creates the shared object `name` (e.g. "/player-frames"), replacing a
+ * stale one, with `slots` frames. Returns 0 on failure. */
+int framesink_init(const char *name, int slots);
+/* Unlinks the object; readers keep their mapping until they unmap it. */
+void framesink_shutdown(void);
+int framesink_enabled(void);
+
+/* Render thread: queues `f` for export without copying its pixels. Never
+ * blocks; returns 0 when the frame was dropped or export is off. */
+int framesink_submit(const struct AVFrame *f, int64_t pts_ms);
+
+/* Waits until every submitted frame has been published or dropped. */
+void framesink_flush(void);
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct AVFrame;
+
+#define GOPCACHE_END (-1)
+#define GOPCACHE_PENDING 0
+#define GOPCACHE_HIT 1
+
+typedef struct GopCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t gops_decoded;
+  uint64_t frames_decoded;
+  size_t bytes;
+  size_t peak_bytes;
+  int spans;
+} GopCacheStats;
+
+typedef struct GopCache GopCache;
+
+/* Decoded frames around the playhead, for frame stepping and reverse
+ * playback. A worker thread with its own demuxer and decoder fills the
+ * cache one whole GOP at a time; the cache holds spans of consecutive
+ * frames and evicts the span farthest from the playhead once more than
+ * `budget_bytes` are held. Timestamps are in the stream's time base. */
+GopCache *gopcache_open(const char *path, int stream_index, int lowres,
+                        size_t budget_bytes);
+void gopcache_close(GopCache *c);
+
+/* References into `out` the frame shown at `pts` (dir == 0), or the frame
+ * right after (dir > 0) or before (dir < 0) it. Returns GOPCACHE_HIT,
+ * GOPCACHE_PENDING while the worker decodes the GOP (ask again later), or
+ * GOPCACHE_END past either end of the stream. */
+int gopcache_find(GopCache *c, int64_t pts, int dir, struct AVFrame *out);
+
+void gopcache_get_stats(GopCache *c, GopCacheStats *out);
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+
+/* Bounded lock-free queue of fixed-size items, safe for any number of
+ * producer and consumer threads. Each slot carries a sequence number that
+ * tells a producer whether it is free and a consumer whether it is filled,
+ * so neither side ever blocks or takes a lock: a full queue rejects the
+ * push and an empty one the pop. */
+typedef struct LfQueue LfQueue;
+
+/* `capacity` is rounded up to a power of two. */
+LfQueue *lfqueue_create(int capacity, size_t item_size);
+void lfqueue_destroy(LfQueue *q);
+
+/* Copies `item` in. Returns 0 when the queue is full. */
+int lfqueue_push(LfQueue *q, const void *item);
+
+/* Copies the oldest item into `out`. Returns 0 when the queue is empty. */
+int lfqueue_pop(LfQueue *q, void *out);
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include "video.h"
+
+/* Opens files on a background thread so the UI keeps running while a
+ * demuxer probes a large or remote file. Only the most recent request is
+ * live: starting another one abandons the previous open, whose thread is
+ * reaped once the interrupt callback has let it return. */
+
+typedef enum {
+  LOADER_IDLE = 0,
+  LOADER_LOADING,
+  LOADER_READY,
+  LOADER_FAILED
+} LoaderState;
+
+typedef struct Loader Loader;
+
+Loader *loader_create(void);
+void loader_destroy(Loader *l);
+
+void loader_start(Loader *l, const char *path);
+void loader_cancel(Loader *l);
+
+/* State of the current request; also reaps abandoned ones. */
+LoaderState loader_poll(Loader *l);
+
+/* Hands over the opened input once the state is LOADER_READY and returns the
+ * loader to idle. Returns 0 otherwise. */
+int loader_take(Loader *l, VideoInput *out);
+
+/* Clears a LOADER_FAILED request. */
+void loader_reset(Loader *l);
+
+const char *loader_path(const Loader *l);
+Uint32 loader_elapsed_ms(const Loader *l);
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+struct AVFormatContext;
+
+#define PROBECACHE_MAX_ENTRIES 64
+
+/* Process-wide cache of what avformat_find_stream_info() learned about a
+ * file, keyed by path, size and modification time. A hit fills in the
+ * streams of a freshly opened demuxer so the analysis can be skipped. */
+int probecache_lookup(const char *path, struct AVFormatContext *fmt);
+void probecache_store(const char *path, const struct AVFormatContext *fmt);
+
+void probecache_shutdown(void);
\ No newline at end of file
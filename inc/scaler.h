@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+struct SwsContext;
+struct AVFrame;
+
+#define SCALER_MAX_SLICES 16
+#define SCALER_SLICE_ALIGN 16
+#define SCALER_MIN_PARALLEL_PIXELS (2560 * 1440)
+
+/* Pixel conversion split across threads for large frames.
+ *
+ * With libswscale >= 6.1 the context's own slice threads are used. Older
+ * versions fall back to one SwsContext per horizontal band run on the shared
+ * WorkPool, which is only done for unscaled conversions that keep the
+ * vertical chroma layout, so the result always matches a single-threaded
+ * sws_scale() bit for bit. */
+typedef struct Scaler {
+  int src_w, src_h, src_fmt;
+  int dst_w, dst_h, dst_fmt;
+  int flags;
+  int threads;
+
+  struct SwsContext *sws;
+  struct AVFrame *src_frame;
+  struct AVFrame *dst_frame;
+  int threaded_api;
+
+  struct SwsContext *slice[SCALER_MAX_SLICES];
+  int slice_y[SCALER_MAX_SLICES + 1];
+  int nslices;
+} Scaler;
+
+/* Cheap when nothing changed. `threads` <= 0 picks the CPU count. */
+int scaler_configure(Scaler *s, int src_w, int src_h, int src_fmt, int dst_w,
+                     int dst_h, int dst_fmt, int flags, int threads);
+void scaler_free(Scaler *s);
+
+int scaler_scale(Scaler *s, const struct AVFrame *src, uint8_t *const dst[],
+                 const int dst_stride[]);
+
+int scaler_thread_count(const Scaler *s);
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+struct AVFrame;
+
+typedef struct ScrubStats {
+  uint64_t requests;
+  uint64_t coalesced;
+  uint64_t previews;
+  uint64_t reused;
+  uint64_t shown;
+  double latency_total_ms;
+  double latency_max_ms;
+} ScrubStats;
+
+typedef struct Scrubber Scrubber;
+
+/* Keyframe previews while dragging the seek bar. A worker thread with its
+ * own demuxer and decoder services a single pending target: requests made
+ * while it is busy replace each other, so only the latest one is decoded
+ * and a drag never queues a backlog of seeks. Timestamps are in the
+ * stream's time base. */
+Scrubber *scrub_open(const char *path, int stream_index, int lowres);
+void scrub_close(Scrubber *s);
+
+void scrub_request(Scrubber *s, int64_t pts);
+
+/* References into `out` the preview finished since the last call, if any,
+ * and counts the time from its request to now as seek-to-display latency.
+ * Returns 1 when `out` was filled. */
+int scrub_take(Scrubber *s, struct AVFrame *out);
+
+void scrub_get_stats(Scrubber *s, ScrubStats *out);
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+/* Opt-in timeline tracing. Each thread records complete (begin/end) spans
+ * into its own ring buffer; trace_dump() writes them as Chrome trace-event
+ * JSON that can be loaded into chrome://tracing or ui.perfetto.dev.
+ *
+ * When tracing is off trace_begin()/trace_end() return immediately. */
+
+#define TRACE_RING_EVENTS 65536
+#define TRACE_MAX_DEPTH 32
+
+int trace_init(const char *out_path);
+void trace_shutdown(void);
+
+int trace_enabled(void);
+const char *trace_output_path(void);
+
+void trace_set_thread_name(const char *name);
+
+/* `name` must be a string literal or otherwise outlive the trace. */
+void trace_begin(const char *name);
+void trace_end(void);
+
+int trace_dump(const char *path);
\ No newline at end of file
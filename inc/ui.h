@@ -27,13 +27,6 @@ typedef struct UiPalette {
   SDL_Color scrollbar_handle;
 } UiPalette;
 
-typedef struct UiContext {
-  SDL_Renderer *ren;
-  const UiPalette *pal;
-  TTF_Font *font_regular;
-  TTF_Font *font_small;
-} UiContext;
-
 typedef struct {
   SDL_Rect bar;
   SDL_Rect btn_play;
@@ -44,17 +37,54 @@ typedef struct {
   SDL_Rect vol_bar;
 } UiPlayerLayout;
 
+typedef struct UiContext {
+  SDL_Renderer *ren;
+  const UiPalette *pal;
+  /* Opened by ui_load_fonts(), not ui_init(), so a file given on the command
+   * line can be on screen before any glyph is rasterised. Text is skipped
+   * until then. */
+  char *font_path;
+  int fonts_tried;
+  TTF_Font *font_regular;
+  TTF_Font *font_small;
+
+  /* Player layout; recomputed only after the output size changes. */
+  UiPlayerLayout layout;
+  int layout_valid;
+
+  /* Everything on the control bar that only changes with the layout or the
+   * play/mute state, rendered once into a target texture. */
+  SDL_Texture *bar_tex;
+  int bar_paused;
+  int bar_muted;
+  int bar_valid;
+
+  SDL_Texture *time_tex;
+  char time_str[64];
+  int time_w, time_h;
+} UiContext;
+
 int ui_init(UiContext *ui, SDL_Renderer *ren, const char *font_path);
 void ui_shutdown(UiContext *ui);
 
-void ui_compute_player_layout(const UiContext *ui, UiPlayerLayout *layout);
+/* Opens the fonts on the first call; returns whether they are usable. */
+int ui_load_fonts(UiContext *ui);
+
+/* Drops cached layout and textures on resize or renderer reset. */
+void ui_handle_event(UiContext *ui, const SDL_Event *e);
+void ui_invalidate_cache(UiContext *ui);
+
+void ui_compute_player_layout(UiContext *ui, UiPlayerLayout *layout);
 void ui_draw_video(const UiContext *ui, VideoState *vid);
-void ui_draw_player_controls(const UiContext *ui, const UiPlayerLayout *layout,
+void ui_draw_player_controls(UiContext *ui, const UiPlayerLayout *layout,
                              const VideoState *vid, int paused, int muted);
+void ui_draw_loading(const UiContext *ui, const char *path, Uint32 elapsed_ms);
 
 void ui_draw_browser(const UiContext *ui, const FileBrowser *b);
 
 int ui_hit_test_rect(const SDL_Rect *r, int mx, int my);
+/* Position along the progress bar for pointer x `mx`, clamped to 0..1. */
+double ui_progress_ratio(const UiPlayerLayout *layout, int mx);
 int ui_progress_hit_test(const UiPlayerLayout *layout, int mx, int my,
                          double *ratio);
 int ui_volume_bar_hit_test(const UiPlayerLayout *layout, int mx, int my,
@@ -3,27 +3,65 @@
 #include <SDL2/SDL.h>
 #include <stdint.h>
 
+#include "audio.h"
+#include "degrade.h"
+#include "scaler.h"
+
 struct AVFormatContext;
+struct AVCodec;
 struct AVCodecContext;
+struct AVCodecParameters;
 struct AVStream;
-struct SwsContext;
 struct SwrContext;
 struct AVFrame;
 struct AVPacket;
+struct FileIo;
+struct GopCache;
+struct Scrubber;
+
+#define VIDEO_RESIZE_DEBOUNCE_MS 250
+#define VIDEO_TEX_RING 3
+
+/* Contexts carried over from the previous file by video_open(). */
+#define VIDEO_REUSED_DECODER 0x1
+#define VIDEO_REUSED_TEXTURES 0x2
+#define VIDEO_REUSED_AUDIO 0x4
+
+#define VIDEO_RATE_MAX 32
+/* Forward rates from here on decode keyframes only. */
+#define VIDEO_RATE_NONKEY 8
+
+/* A demuxer opened and probed for one file. Producing one is the slow part
+ * of opening a file and may run on any thread. */
+typedef struct VideoInput {
+  char *path;
+  struct FileIo *io;
+  struct AVFormatContext *fmt;
+  Uint64 open_start;
+} VideoInput;
 
 typedef struct VideoState {
+  char *path;
+  struct FileIo *io;
   struct AVFormatContext *fmt;
   struct AVCodecContext *vdec;
   struct AVCodecContext *adec;
   struct AVStream *vst;
   struct AVStream *ast;
 
-  struct SwsContext *sws;
+  /* Parameters the decoders were opened with, to decide whether the next
+   * file can reuse them. */
+  struct AVCodecParameters *vpar;
+  struct AVCodecParameters *apar;
+
+  Scaler scaler;
   struct SwrContext *swr;
 
   struct AVFrame *vframe;
   struct AVFrame *yuv;
   uint8_t *yuv_buf;
+  /* 8-bit copy of a 10-bit frame that still needs scaling. */
+  struct AVFrame *depth_frame;
   int yuv_buf_size;
 
   struct AVFrame *aframe;
@@ -32,31 +70,205 @@ typedef struct VideoState {
   int v_stream_index;
   int a_stream_index;
 
+  /* Frames are converted into the next texture of the ring so the one being
+   * presented is never written to; `tex` is the most recent. */
+  SDL_Texture *tex_ring[VIDEO_TEX_RING];
+  int tex_index;
   SDL_Texture *tex;
   int tex_w, tex_h;
+  SDL_Renderer *ren;
+
+  /* Texture and converter output format. With SDL's software renderer the
+   * converter writes the window's own RGB format at the on-screen size, so
+   * presenting is a plain copy instead of a generic YUV conversion and
+   * scale; otherwise YV12. */
+  int software;
+  Uint32 tex_format;
+  int dst_fmt;
+
+  /* Decoded size, and the size the converter should target. The latter
+   * follows the on-screen rect when the source is larger than it. */
+  int src_w, src_h;
+  int out_w, out_h;
+  Uint32 out_changed_ticks;
 
-  SDL_AudioDeviceID audio_dev;
-  int audio_sample_rate;
-  int audio_channels;
-  int audio_bytes_per_sample;
+  /* Owned by the caller and shared by every file; audio is resampled to
+   * its format. */
+  AudioOut *audio;
 
   int frame_ms;
   Uint32 last_ticks;
 
   int64_t duration_ms;
   int64_t cur_pts_ms;
+  int64_t cur_pts;
+
+  /* Created on the first frame step. `stepped` makes the next video_step()
+   * resync the main demuxer to the stepped-to position. */
+  struct GopCache *gop;
+  struct AVFrame *step_frame;
+  int stepped;
+  /* Frames before this are decoded unseen, VIDEO_RESYNC_FRAMES per
+   * video_step(). */
+  int64_t resync_pts;
+
+  /* Trick-play rate: 1 is normal playback, 2..32 fast-forward and -2..-32
+   * rewind. While it is not 1 only keyframes (reference frames at low
+   * forward rates) are decoded and audio is not demuxed; the shown frame
+   * chases the media clock `trick_ms`. `trick_held` is set while a decoded
+   * frame waits for the clock to reach it. */
+  int rate;
+  int64_t trick_ms;
+  Uint32 trick_ticks;
+  int trick_held;
+
+  /* Keyframe previews while the seek bar is dragged, from a worker opened
+   * on the first drag. */
+  struct Scrubber *scrub;
+  int scrubbing;
+
+  /* Decode quality controller, fed with the decode and convert time of
+   * each frame played at normal rate. `sws_flags` is what the converter is
+   * configured with at the current level. */
+  Degrade degrade;
+  double work_ms;
+  int sws_flags;
+
+  /* Seek-to-display latency of the seeks made on this file. */
+  Uint64 seek_start;
+  int seeks;
+  double seek_total_ms;
+  double seek_max_ms;
+
+  /* Where the audio queued so far ends, and the position before which
+   * decoded audio is dropped (both AV_NOPTS_VALUE when unknown or unset). */
+  int64_t audio_end_ms;
+  int64_t audio_skip_ms;
+
+  /* Audio-only playback while the window cannot be seen: video packets are
+   * demuxed and dropped undecoded, and `bg_skipped` counts them
+   * (`bg_mark` at the time background playback started). */
+  int background;
+  uint64_t bg_skipped;
+  uint64_t bg_mark;
+  int64_t bg_video_ms;
 
   double volume;
   int eof;
+
+  Uint64 open_start;
+  int first_frame_pending;
+  int reused;
+
+  /* Since video_open(); what video_get_stats() reports. */
+  uint64_t frames_decoded;
+  uint64_t frames_shown;
+  uint64_t frames_late;
+  double first_frame_ms;
+  /* Process-wide frame pool counters at video_open(), so the counts
+   * reported at close are this file's own. */
+  uint64_t pool_hits;
+  uint64_t pool_misses;
 } VideoState;
 
-int video_open(VideoState *v, SDL_Renderer *ren, const char *path);
+typedef struct VideoStats {
+  uint64_t decoded;
+  uint64_t shown;
+  /* Decoded but replaced before their turn, or skipped while seeking. */
+  uint64_t dropped;
+  /* Shown a whole interval or more after they were due. */
+  uint64_t late;
+  /* Open to first frame of the current file. */
+  double first_frame_ms;
+  /* Shown video position minus the audio being heard, when both are
+   * known; positive when video is ahead. */
+  int has_drift;
+  double drift_ms;
+  int quality_level;
+} VideoStats;
+
+/* Options for video_input_open(). */
+/* Read alongside a main input (frame cache, scrubbing, wall tiles): plain
+ * reads instead of a read-ahead thread and buffer of its own. */
+#define VIDEO_INPUT_NO_PREFETCH 0x1
+
+/* `interrupt` may be NULL; when it returns nonzero the open is abandoned. */
+int video_input_open(VideoInput *in, const char *path, int flags,
+                     int (*interrupt)(void *), void *opaque);
+void video_input_close(VideoInput *in);
+
+/* Options for video_open_worker_decoder(). */
+/* Decode keyframes only. */
+#define VIDEO_WORKER_KEYFRAMES 0x1
+/* Slice threads only: frame threads hold output back by a frame each. */
+#define VIDEO_WORKER_LOW_DELAY 0x2
+
+/* Opens `path` into `in` for a worker thread with its own demuxer and
+ * decoder (frame cache, scrubbing): streams other than `stream_index` are
+ * discarded, and the returned decoder uses every core and the frame pools.
+ * Returns NULL on failure; `in` is closed by the caller either way. */
+struct AVCodecContext *video_open_worker_decoder(VideoInput *in,
+                                                 const char *path,
+                                                 int stream_index, int lowres,
+                                                 int flags,
+                                                 int (*interrupt)(void *),
+                                                 void *opaque);
+
+/* Largest lowres whose `w` x `h` picture still covers `min_w` x `min_h`. */
+int video_pick_lowres(const struct AVCodec *codec, int w, int h, int min_w,
+                      int min_h);
+/* Sets what `dec` skips at degrade level `level`, including skip_frame when
+ * `set_skip_frame` is nonzero, and returns the swscale flags to use. */
+int video_apply_quality_level(struct AVCodecContext *dec, int level,
+                              int set_skip_frame);
+
+/* Takes ownership of `in`, even on failure. */
+int video_open_input(VideoState *v, SDL_Renderer *ren, AudioOut *audio,
+                     VideoInput *in);
+int video_open(VideoState *v, SDL_Renderer *ren, AudioOut *audio,
+               const char *path);
 void video_close(VideoState *v);
 
 void video_step(VideoState *v, SDL_Renderer *ren);
 
 void video_seek_ms(VideoState *v, int64_t target_ms);
 
+/* Shows the frame after (dir > 0) or before (dir < 0) the current one from
+ * the GOP cache. Returns 1 once shown, 0 while it is being decoded (call
+ * again), -1 at either end of the stream. */
+int video_step_frame(VideoState *v, SDL_Renderer *ren, int dir);
+
+/* Steps backward once per frame interval; same return values. */
+int video_step_reverse(VideoState *v, SDL_Renderer *ren);
+
+/* Lands on the exact frame at `target_ms` instead of the keyframe before
+ * it; frames in between are decoded but not shown. */
+void video_seek_exact_ms(VideoState *v, int64_t target_ms);
+
+/* Drag scrubbing: video_scrub() only records the latest target, which the
+ * seek worker turns into a keyframe preview that video_scrub_update() shows
+ * once ready (returning 1). video_scrub_end() seeks exactly to where the
+ * drag was released. video_step() must not run in between. */
+void video_scrub(VideoState *v, int64_t target_ms);
+int video_scrub_update(VideoState *v, SDL_Renderer *ren);
+void video_scrub_end(VideoState *v, int64_t target_ms);
+
+/* Switches audio-only background playback on or off. Turning it off
+ * resumes video at the audio position without interrupting the sound.
+ * Files without audio do not advance while in the background. */
+void video_set_background(VideoState *v, int on);
+
+void video_get_stats(VideoState *v, VideoStats *out);
+
+/* Current decode quality level (0 is full quality) and how long it has
+ * been active. */
+int video_get_quality_level(const VideoState *v, Uint32 *active_ms);
+
+/* Sets the trick-play rate, clamped to +-VIDEO_RATE_MAX; anything in -1..1
+ * returns to normal playback at the last shown frame. */
+void video_set_rate(VideoState *v, int rate);
+int video_get_rate(const VideoState *v);
+
 void video_set_volume(VideoState *v, double volume);
 double video_get_volume(const VideoState *v);
 
@@ -65,4 +277,12 @@ int64_t video_get_position_ms(const VideoState *v);
 
 int video_is_eof(const VideoState *v);
 
-SDL_Texture *video_get_texture(VideoState *v, int *w, int *h);
\ No newline at end of file
+/* Whether a frame of the open file has been converted for display. */
+int video_has_frame(const VideoState *v);
+
+void video_apply_gain(int16_t *samples, int count, double volume);
+
+SDL_Texture *video_get_texture(VideoState *v, int *w, int *h);
+
+void video_set_output_size(VideoState *v, int w, int h);
+void video_get_frame_size(const VideoState *v, int *w, int *h);
\ No newline at end of file
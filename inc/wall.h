@@ -0,0 +1,90 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <stdint.h>
+
+#include "degrade.h"
+#include "scaler.h"
+#include "video.h"
+
+struct AVCodecContext;
+struct AVPacket;
+struct AVFrame;
+
+#define WALL_MAX_TILES 16
+/* Pixels between neighbouring cells. */
+#define WALL_GAP 2
+
+/* One feed of the wall, played silently and looped, decoded and converted
+ * at the size of its cell. */
+typedef struct WallTile {
+  VideoInput in;
+  struct AVCodecContext *dec;
+  struct AVPacket *pkt;
+  struct AVFrame *frame;
+  int stream_index;
+  int frame_ms;
+
+  /* Converted picture at out_w x out_h, uploaded to `tex` by the render
+   * thread while `pic_ready` is set. */
+  Scaler scaler;
+  struct AVFrame *pic;
+  int out_w, out_h;
+  int sws_flags;
+  int pic_ready;
+  SDL_Texture *tex;
+  int tex_w, tex_h;
+
+  /* When the next frame is due on the SDL_GetTicks() clock. */
+  Uint32 due_ticks;
+  Degrade degrade;
+  int failed;
+
+  uint64_t decoded;
+  uint64_t shown;
+  uint64_t dropped;
+  uint64_t loops;
+  double decode_ms;
+} WallTile;
+
+/* Several files played at once in a grid. Every call to wall_decode()
+ * gathers the tiles whose next frame is due and decodes them as one batch
+ * on the shared WorkPool, most overdue first and one job per tile, so no
+ * feed can starve the others and decoding scales with the cores rather
+ * than with FFmpeg's per-decoder threads (which are turned off). The time
+ * a batch takes drives each tile's quality controller: when all tiles
+ * together need more than a frame interval, they step down together. */
+typedef struct VideoWall {
+  WallTile tiles[WALL_MAX_TILES];
+  int count;
+  int cols, rows;
+  int cell_w, cell_h;
+  int degrade_on;
+
+  int due[WALL_MAX_TILES];
+  int ndue;
+  Uint32 now;
+
+  uint64_t batches;
+  double batch_total_ms;
+  double batch_max_ms;
+} VideoWall;
+
+/* Opens up to WALL_MAX_TILES files in parallel for a wall of `width` x
+ * `height` pixels. Files that fail to open leave an empty cell. Returns 0
+ * when none could be opened. */
+int wall_open(VideoWall *w, const char *const *paths, int count, int width,
+              int height);
+void wall_close(VideoWall *w);
+
+/* Cheap when the size did not change. Cells that grew beyond what a tile
+ * decodes reopen its decoder at a larger lowres. */
+void wall_set_size(VideoWall *w, int width, int height);
+/* Every tile is due at `now`, as after a time without wall_decode(). */
+void wall_restart_clock(VideoWall *w, Uint32 now);
+
+/* Decodes every tile due at `now`. Returns how many new pictures are
+ * waiting for wall_upload(). */
+int wall_decode(VideoWall *w, Uint32 now);
+void wall_upload(VideoWall *w, SDL_Renderer *ren);
+void wall_draw(const VideoWall *w, SDL_Renderer *ren);
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+/* Persistent pool of worker threads running parallel-for style batches.
+ * workpool_run() hands out job indices [0, count) to the workers and the
+ * calling thread, and returns once every job has finished. Batches from
+ * different threads are serialised; a batch started from inside a job runs
+ * inline on that worker. */
+
+typedef struct WorkPool WorkPool;
+
+typedef void (*WorkFn)(void *arg, int index);
+
+WorkPool *workpool_create(int threads);
+void workpool_destroy(WorkPool *p);
+
+/* Process-wide pool sized to the CPU count, created on first use. */
+WorkPool *workpool_shared(void);
+void workpool_shared_shutdown(void);
+
+int workpool_size(const WorkPool *p);
+void workpool_run(WorkPool *p, int count, WorkFn fn, void *arg);
+
+int workpool_cpu_count(void);
\ No newline at end of file
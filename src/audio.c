@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+
+static double audio_out_bytes_to_ms(const AudioOut *a, Uint32 bytes) {
+  int bps = audio_out_bytes_per_second(a);
+  return bps > 0 ? (double)bytes * 1000.0 / bps : 0.0;
+}
+
+static Uint32 audio_out_ms_to_bytes(const AudioOut *a, int ms) {
+  int frame = a->channels * a->bytes_per_sample;
+  uint64_t frames = (uint64_t)a->sample_rate * (uint64_t)ms / 1000;
+  return (Uint32)(frames * (uint64_t)frame);
+}
+
+static void audio_out_callback(void *userdata, Uint8 *stream, int len) {
+  AudioOut *a = (AudioOut *)userdata;
+
+  Uint64 now = SDL_GetPerformanceCounter();
+  if (a->last_pull) {
+    double ms = (double)(now - a->last_pull) * 1000.0 /
+                (double)SDL_GetPerformanceFrequency();
+    /* Long gaps are pauses, not the device's period. */
+    if (ms < 500.0) {
+      a->pull_period_ms = a->pull_period_ms > 0.0
+                              ? 0.9 * a->pull_period_ms + 0.1 * ms
+                              : ms;
+    }
+  }
+  a->last_pull = now;
+
+  Uint32 want = (Uint32)len;
+  Uint32 n = want < a->ring_fill ? want : a->ring_fill;
+  Uint32 first = a->ring_size - a->ring_read;
+  if (first > n) first = n;
+  memcpy(stream, a->ring + a->ring_read, first);
+  memcpy(stream + first, a->ring, n - first);
+  a->ring_read = (a->ring_read + n) % a->ring_size;
+  a->ring_fill -= n;
+
+  if (n < want) {
+    memset(stream + n, 0, want - n);
+    if (a->primed) a->starved = 1;
+  }
+}
+
+int audio_out_open(AudioOut *a, int buffer_samples, int low_ms, int high_ms,
+                   int adaptive) {
+  memset(a, 0, sizeof(*a));
+  a->low_ms = low_ms;
+  a->high_ms = high_ms > low_ms ? high_ms : low_ms * 2;
+  a->adaptive = adaptive;
+
+  SDL_AudioSpec want, have;
+  SDL_zero(want);
+  want.freq = AUDIO_OUT_RATE;
+  want.format = AUDIO_S16SYS;
+  want.channels = AUDIO_OUT_CHANNELS;
+  want.samples = (Uint16)buffer_samples;
+  want.callback = audio_out_callback;
+  want.userdata = a;
+
+  /* Take the device's native rate so SDL does not resample a second time
+   * after swresample; format and layout stay fixed. */
+  a->dev = SDL_OpenAudioDevice(NULL, 0, &want, &have,
+                               SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+  if (!a->dev) {
+    fprintf(stderr, "audio: SDL_OpenAudioDevice failed: %s\n",
+            SDL_GetError());
+    return 0;
+  }
+
+  a->sample_rate = have.freq;
+  a->channels = have.channels;
+  a->bytes_per_sample = SDL_AUDIO_BITSIZE(have.format) / 8;
+  a->buffer_samples = have.samples;
+
+  a->ring_size = audio_out_ms_to_bytes(a, AUDIO_OUT_RING_MS);
+  a->ring = (uint8_t *)malloc(a->ring_size);
+  if (!a->ring) {
+    SDL_CloseAudioDevice(a->dev);
+    memset(a, 0, sizeof(*a));
+    return 0;
+  }
+  SDL_PauseAudioDevice(a->dev, 0);
+
+  fprintf(stderr,
+          "audio: %d Hz, %d channels, %d-sample buffer, watermarks %d/%d "
+          "ms%s\n",
+          a->sample_rate, a->channels, a->buffer_samples, a->low_ms,
+          a->high_ms, a->adaptive ? " (adaptive)" : "");
+  return 1;
+}
+
+void audio_out_close(AudioOut *a) {
+  if (!a) return;
+  if (a->dev) SDL_CloseAudioDevice(a->dev);
+  free(a->ring);
+  memset(a, 0, sizeof(*a));
+}
+
+int audio_out_is_open(const AudioOut *a) { return a && a->dev != 0; }
+
+static void audio_out_widen(AudioOut *a) {
+  if (!a->adaptive || a->high_ms >= AUDIO_OUT_MAX_WATERMARK_MS) return;
+
+  a->low_ms = a->low_ms * 3 / 2;
+  a->high_ms = a->high_ms * 3 / 2;
+  if (a->high_ms > AUDIO_OUT_MAX_WATERMARK_MS)
+    a->high_ms = AUDIO_OUT_MAX_WATERMARK_MS;
+  if (a->low_ms >= a->high_ms) a->low_ms = a->high_ms / 2;
+
+  fprintf(stderr, "audio: underrun, watermarks widened to %d/%d ms\n",
+          a->low_ms, a->high_ms);
+}
+
+void audio_out_queue(AudioOut *a, const void *data, Uint32 bytes) {
+  if (!audio_out_is_open(a) || bytes == 0) return;
+
+  SDL_LockAudioDevice(a->dev);
+  int starved = a->starved;
+  a->starved = 0;
+
+  Uint32 space = a->ring_size - a->ring_fill;
+  if (bytes > space) {
+    a->dropped_bytes += bytes - space;
+    bytes = space;
+  }
+  Uint32 write = (a->ring_read + a->ring_fill) % a->ring_size;
+  Uint32 first = a->ring_size - write;
+  if (first > bytes) first = bytes;
+  memcpy(a->ring + write, data, first);
+  memcpy(a->ring, (const uint8_t *)data + first, bytes - first);
+  a->ring_fill += bytes;
+  a->primed = 1;
+  SDL_UnlockAudioDevice(a->dev);
+
+  /* The device ran dry while this stream was playing: decoding fell
+   * behind, so keep more in hand from now on. */
+  if (starved) {
+    a->underruns++;
+    audio_out_widen(a);
+  }
+}
+
+void audio_out_clear(AudioOut *a) {
+  if (!audio_out_is_open(a)) return;
+  SDL_LockAudioDevice(a->dev);
+  a->ring_read = 0;
+  a->ring_fill = 0;
+  a->primed = 0;
+  a->starved = 0;
+  SDL_UnlockAudioDevice(a->dev);
+  a->refilling = 1;
+}
+
+void audio_out_set_paused(AudioOut *a, int paused) {
+  if (!audio_out_is_open(a)) return;
+  SDL_PauseAudioDevice(a->dev, paused ? 1 : 0);
+  SDL_LockAudioDevice(a->dev);
+  a->last_pull = 0;
+  SDL_UnlockAudioDevice(a->dev);
+}
+
+Uint32 audio_out_queued_bytes(AudioOut *a) {
+  if (!audio_out_is_open(a)) return 0;
+  SDL_LockAudioDevice(a->dev);
+  Uint32 fill = a->ring_fill;
+  SDL_UnlockAudioDevice(a->dev);
+  return fill;
+}
+
+int audio_out_bytes_per_second(const AudioOut *a) {
+  if (!audio_out_is_open(a)) return 0;
+  return a->sample_rate * a->channels * a->bytes_per_sample;
+}
+
+int audio_out_wants_data(AudioOut *a) {
+  if (!audio_out_is_open(a)) return 0;
+
+  Uint32 queued = audio_out_queued_bytes(a);
+  if (queued < audio_out_ms_to_bytes(a, a->low_ms)) {
+    a->refilling = 1;
+  } else if (queued >= audio_out_ms_to_bytes(a, a->high_ms)) {
+    a->refilling = 0;
+  }
+  return a->refilling;
+}
+
+void audio_out_get_stats(AudioOut *a, AudioOutStats *out) {
+  memset(out, 0, sizeof(*out));
+  if (!audio_out_is_open(a)) return;
+
+  SDL_LockAudioDevice(a->dev);
+  Uint32 fill = a->ring_fill;
+  double period = a->pull_period_ms;
+  SDL_UnlockAudioDevice(a->dev);
+
+  out->underruns = a->underruns;
+  out->dropped_bytes = a->dropped_bytes;
+  out->low_ms = a->low_ms;
+  out->high_ms = a->high_ms;
+  out->queue_ms = audio_out_bytes_to_ms(a, fill);
+  out->nominal_device_ms = (double)a->buffer_samples * 1000.0 / a->sample_rate;
+  out->device_ms = period > 0.0 ? period : out->nominal_device_ms;
+}
+
+double audio_out_latency_ms(AudioOut *a) {
+  AudioOutStats st;
+  audio_out_get_stats(a, &st);
+  return st.queue_ms + st.device_ms;
+}
+
+void audio_out_report(AudioOut *a) {
+  if (!audio_out_is_open(a)) return;
+
+  AudioOutStats st;
+  audio_out_get_stats(a, &st);
+  fprintf(stderr,
+          "audio: latency %.1f ms (queue %.1f ms, device %.1f ms measured, "
+          "%.1f ms nominal), watermarks %d/%d ms, %d underruns, %llu bytes "
+          "dropped\n",
+          st.queue_ms + st.device_ms, st.queue_ms, st.device_ms,
+          st.nominal_device_ms, st.low_ms, st.high_ms, st.underruns,
+          (unsigned long long)st.dropped_bytes);
+}
@@ -21,7 +21,7 @@ static void clear_items(FileBrowser *b) {
   b->scroll = 0;
 }
 
-static int cmp_entries(const void *a, const void *b) {
+int cmp_entries(const void *a, const void *b) {
   const BrowserEntry *ea = (const BrowserEntry *)a;
   const BrowserEntry *eb = (const BrowserEntry *)b;
   if (ea->is_dir != eb->is_dir) return eb->is_dir - ea->is_dir;
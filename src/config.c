@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+static PlayerConfig g_config = {
+    .trace_path = NULL,
+    .control_socket = NULL,
+    .frame_export = NULL,
+    .frame_export_slots = 4,
+
+    .io_mode = IO_MODE_PREFETCH,
+    .io_buffer_kb = 512,
+    .io_prefetch_mb = 32,
+
+    .huge_pages = 0,
+
+    .fast_open = 1,
+    .probe_kb = 256,
+    .analyze_ms = 500,
+
+    .audio_samples = 1024,
+    .audio_low_ms = 80,
+    .audio_high_ms = 200,
+    .audio_adaptive = 1,
+
+    .gop_cache_mb = 256,
+
+    .degrade = 1,
+
+    .sw_fast_path = 1,
+    .hbd_fast_path = 1,
+
+    .background_audio = 1,
+
+    .wall_tiles = 0,
+};
+
+const PlayerConfig *player_config(void) { return &g_config; }
+
+static int env_int(const char *name, int def, int min, int max) {
+  const char *s = getenv(name);
+  if (!s || !s[0]) return def;
+
+  char *end = NULL;
+  long v = strtol(s, &end, 10);
+  if (!end || *end != '\0' || v < min || v > max) {
+    fprintf(stderr, "config: ignoring %s=%s (expected %d..%d)\n", name, s, min,
+            max);
+    return def;
+  }
+  return (int)v;
+}
+
+static IoMode env_io_mode(const char *name, IoMode def) {
+  const char *s = getenv(name);
+  if (!s || !s[0]) return def;
+
+  if (strcmp(s, "default") == 0) return IO_MODE_DEFAULT;
+  if (strcmp(s, "pread") == 0) return IO_MODE_PREAD;
+  if (strcmp(s, "prefetch") == 0) return IO_MODE_PREFETCH;
+  if (strcmp(s, "mmap") == 0) return IO_MODE_MMAP;
+
+  fprintf(stderr,
+          "config: ignoring %s=%s (expected default|pread|prefetch|mmap)\n",
+          name, s);
+  return def;
+}
+
+void config_load_env(void) {
+  const char *trace = getenv("PLAYER_TRACE");
+  if (trace && trace[0]) g_config.trace_path = trace;
+  const char *control = getenv("PLAYER_CONTROL_SOCKET");
+  if (control && control[0]) g_config.control_socket = control;
+  const char *frames = getenv("PLAYER_FRAME_EXPORT");
+  if (frames && frames[0]) g_config.frame_export = frames;
+  g_config.frame_export_slots = env_int("PLAYER_FRAME_EXPORT_SLOTS",
+                                        g_config.frame_export_slots, 2, 64);
+
+  g_config.io_mode = env_io_mode("PLAYER_IO_MODE", g_config.io_mode);
+  g_config.io_buffer_kb =
+      env_int("PLAYER_IO_BUFFER_KB", g_config.io_buffer_kb, 4, 65536);
+  g_config.io_prefetch_mb =
+      env_int("PLAYER_IO_PREFETCH_MB", g_config.io_prefetch_mb, 1, 4096);
+
+  g_config.huge_pages = env_int("PLAYER_HUGEPAGES", g_config.huge_pages, 0, 1);
+
+  g_config.fast_open = env_int("PLAYER_FAST_OPEN", g_config.fast_open, 0, 1);
+  g_config.probe_kb = env_int("PLAYER_PROBE_KB", g_config.probe_kb, 32, 65536);
+  g_config.analyze_ms =
+      env_int("PLAYER_ANALYZE_MS", g_config.analyze_ms, 10, 60000);
+
+  g_config.audio_samples =
+      env_int("PLAYER_AUDIO_SAMPLES", g_config.audio_samples, 64, 16384);
+  g_config.audio_low_ms =
+      env_int("PLAYER_AUDIO_LOW_MS", g_config.audio_low_ms, 5, 2000);
+  g_config.audio_high_ms =
+      env_int("PLAYER_AUDIO_HIGH_MS", g_config.audio_high_ms, 10, 2000);
+  g_config.audio_adaptive =
+      env_int("PLAYER_AUDIO_ADAPTIVE", g_config.audio_adaptive, 0, 1);
+
+  g_config.gop_cache_mb =
+      env_int("PLAYER_GOP_CACHE_MB", g_config.gop_cache_mb, 16, 16384);
+
+  g_config.degrade = env_int("PLAYER_DEGRADE", g_config.degrade, 0, 1);
+  g_config.sw_fast_path =
+      env_int("PLAYER_SW_FAST_PATH", g_config.sw_fast_path, 0, 1);
+  g_config.hbd_fast_path =
+      env_int("PLAYER_HBD_FAST_PATH", g_config.hbd_fast_path, 0, 1);
+
+  g_config.background_audio =
+      env_int("PLAYER_BACKGROUND_AUDIO", g_config.background_audio, 0, 1);
+
+  g_config.wall_tiles =
+      env_int("PLAYER_WALL_TILES", g_config.wall_tiles, 0, 16);
+}
\ No newline at end of file
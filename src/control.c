@@ -0,0 +1,463 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "control.h"
+#include "lfqueue.h"
+#include "trace.h"
+
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_LINE_MAX 4096
+#define CONTROL_COMMANDS 64
+
+typedef struct {
+  int fd;
+  char buf[CONTROL_LINE_MAX];
+  size_t len;
+} ControlClient;
+
+struct ControlServer {
+  char *path;
+  int listen_fd;
+  /* The socket file at `path` is ours to remove. */
+  int bound;
+  /* Written to by control_close() to wake the thread. */
+  int wake[2];
+
+  pthread_t thread;
+  int thread_started;
+  atomic_int quit;
+
+  LfQueue *commands;
+  atomic_ullong queued;
+  atomic_ullong taken;
+
+  /* Seqlock: odd while the render thread is writing `metrics`. */
+  atomic_uint seq;
+  ControlMetrics metrics;
+
+  ControlClient clients[CONTROL_MAX_CLIENTS];
+  int nclients;
+};
+
+/* Finds `"key":` in a flat JSON object and returns where its value
+ * starts, or NULL. */
+static const char *control_json_find(const char *line, const char *key) {
+  size_t n = strlen(key);
+  for (const char *p = strchr(line, '"'); p; p = strchr(p + 1, '"')) {
+    if (strncmp(p + 1, key, n) != 0 || p[n + 1] != '"') continue;
+    const char *q = p + n + 2;
+    while (*q == ' ' || *q == '\t') q++;
+    if (*q != ':') continue;
+    q++;
+    while (*q == ' ' || *q == '\t') q++;
+    return q;
+  }
+  return NULL;
+}
+
+static void control_put_utf8(char *out, size_t size, size_t *len,
+                             unsigned cp) {
+  char tmp[3];
+  size_t n = 0;
+  if (cp < 0x80) {
+    tmp[n++] = (char)cp;
+  } else if (cp < 0x800) {
+    tmp[n++] = (char)(0xc0 | (cp >> 6));
+    tmp[n++] = (char)(0x80 | (cp & 0x3f));
+  } else {
+    tmp[n++] = (char)(0xe0 | (cp >> 12));
+    tmp[n++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    tmp[n++] = (char)(0x80 | (cp & 0x3f));
+  }
+  if (*len + n >= size) return;
+  memcpy(out + *len, tmp, n);
+  *len += n;
+}
+
+/* Unescapes the string value of `key` into `out`. Returns 0 if it is
+ * missing, not a string or does not fit. */
+static int control_json_string(const char *line, const char *key, char *out,
+                               size_t size) {
+  const char *p = control_json_find(line, key);
+  if (!p || *p != '"') return 0;
+
+  size_t len = 0;
+  for (p++; *p && *p != '"'; ++p) {
+    unsigned c = (unsigned char)*p;
+    if (c == '\\') {
+      p++;
+      switch (*p) {
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u': {
+          char hex[5] = {0};
+          for (int i = 0; i < 4; ++i) {
+            if (!p[1 + i]) return 0;
+            hex[i] = p[1 + i];
+          }
+          c = (unsigned)strtoul(hex, NULL, 16);
+          p += 4;
+          if (c == 0) return 0;
+          control_put_utf8(out, size, &len, c);
+          continue;
+        }
+        case '\0': return 0;
+        default: c = (unsigned char)*p; break;
+      }
+    }
+    if (len + 1 >= size) return 0;
+    out[len++] = (char)c;
+  }
+  if (*p != '"') return 0;
+  out[len] = '\0';
+  return 1;
+}
+
+static int control_json_number(const char *line, const char *key,
+                               double *out) {
+  const char *p = control_json_find(line, key);
+  if (!p) return 0;
+  char *end;
+  double v = strtod(p, &end);
+  if (end == p) return 0;
+  *out = v;
+  return 1;
+}
+
+/* A torn read is retried; the writer never waits for readers. */
+static void control_read_metrics(ControlServer *c, ControlMetrics *out) {
+  for (;;) {
+    unsigned s1 = atomic_load_explicit(&c->seq, memory_order_acquire);
+    if (s1 & 1) {
+      sched_yield();
+      continue;
+    }
+    memcpy(out, &c->metrics, sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&c->seq, memory_order_relaxed) == s1) return;
+  }
+}
+
+void control_publish(ControlServer *c, const ControlMetrics *m) {
+  if (!c) return;
+  unsigned s = atomic_load_explicit(&c->seq, memory_order_relaxed);
+  atomic_store_explicit(&c->seq, s + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&c->metrics, m, sizeof(*m));
+  atomic_store_explicit(&c->seq, s + 2, memory_order_release);
+}
+
+static int control_stats(ControlServer *c, char *out, size_t size) {
+  ControlMetrics m;
+  control_read_metrics(c, &m);
+  unsigned long long pending =
+      atomic_load(&c->queued) - atomic_load(&c->taken);
+
+  int n = snprintf(
+      out, size,
+      "{\"ok\":true,\"state\":\"%s\",\"paused\":%s,\"position_ms\":%lld,"
+      "\"duration_ms\":%lld,\"volume\":%.2f,\"fps\":%.2f,"
+      "\"frames_shown\":%llu,\"frames_dropped\":%llu,"
+      "\"frames_late\":%llu,\"quality_level\":%d,",
+      m.state ? m.state : "idle", m.paused ? "true" : "false",
+      (long long)m.position_ms, (long long)m.duration_ms, m.volume, m.fps,
+      (unsigned long long)m.frames_shown,
+      (unsigned long long)m.frames_dropped,
+      (unsigned long long)m.frames_late, m.quality_level);
+  if (n < 0 || (size_t)n >= size) return 0;
+
+  if (m.has_drift) {
+    n += snprintf(out + n, size - (size_t)n, "\"av_drift_ms\":%.1f,",
+                  m.av_drift_ms);
+  } else {
+    n += snprintf(out + n, size - (size_t)n, "\"av_drift_ms\":null,");
+  }
+  if ((size_t)n >= size) return 0;
+
+  n += snprintf(out + n, size - (size_t)n,
+                "\"audio_queue_ms\":%.1f,\"audio_device_ms\":%.1f,"
+                "\"audio_underruns\":%d,\"command_queue\":%llu,"
+                "\"first_frame_ms\":%.1f}\n",
+                m.audio_queue_ms, m.audio_device_ms, m.audio_underruns,
+                pending, m.first_frame_ms);
+  return (size_t)n < size;
+}
+
+static const struct {
+  const char *name;
+  ControlAction action;
+} g_actions[] = {
+    {"play", CONTROL_PLAY},     {"pause", CONTROL_PAUSE},
+    {"toggle", CONTROL_TOGGLE}, {"seek", CONTROL_SEEK},
+    {"next", CONTROL_NEXT},     {"prev", CONTROL_PREV},
+    {"volume", CONTROL_VOLUME}, {"open", CONTROL_OPEN},
+};
+
+/* Writes the reply to one request line into `out`. */
+static void control_handle_line(ControlServer *c, const char *line,
+                                char *out, size_t size) {
+  char cmd[32];
+  if (!control_json_string(line, "cmd", cmd, sizeof(cmd))) {
+    snprintf(out, size, "{\"ok\":false,\"error\":\"missing cmd\"}\n");
+    return;
+  }
+  if (strcmp(cmd, "stats") == 0) {
+    if (!control_stats(c, out, size)) {
+      snprintf(out, size, "{\"ok\":false,\"error\":\"internal\"}\n");
+    }
+    return;
+  }
+
+  ControlCommand command;
+  memset(&command, 0, sizeof(command));
+  for (size_t i = 0; i < sizeof(g_actions) / sizeof(g_actions[0]); ++i) {
+    if (strcmp(cmd, g_actions[i].name) == 0) {
+      command.action = g_actions[i].action;
+    }
+  }
+
+  const char *error = NULL;
+  double v = 0.0;
+  if (!command.action) {
+    error = "unknown cmd";
+  } else if (command.action == CONTROL_SEEK) {
+    if (control_json_number(line, "ms", &v) && isfinite(v)) {
+      /* Past the end is clamped to the duration by the player. */
+      if (v < 0.0) v = 0.0;
+      if (v > (double)(INT64_MAX / 2)) v = (double)(INT64_MAX / 2);
+      command.ms = (int64_t)v;
+    } else {
+      error = "seek needs ms";
+    }
+  } else if (command.action == CONTROL_VOLUME) {
+    if (control_json_number(line, "value", &v) && v >= 0.0 && v <= 1.0) {
+      command.value = v;
+    } else {
+      error = "volume needs a value from 0 to 1";
+    }
+  } else if (command.action == CONTROL_OPEN) {
+    if (!control_json_string(line, "path", command.path,
+                             sizeof(command.path)) ||
+        !command.path[0]) {
+      error = "open needs a path";
+    }
+  }
+
+  if (!error) {
+    if (lfqueue_push(c->commands, &command)) {
+      atomic_fetch_add(&c->queued, 1);
+    } else {
+      error = "busy";
+    }
+  }
+
+  if (error) {
+    snprintf(out, size, "{\"ok\":false,\"error\":\"%s\"}\n", error);
+  } else {
+    snprintf(out, size, "{\"ok\":true}\n");
+  }
+}
+
+static void control_drop_client(ControlServer *c, int i) {
+  close(c->clients[i].fd);
+  c->clients[i] = c->clients[--c->nclients];
+}
+
+/* Handles every complete line received from client `i`. Returns 0 when
+ * the client has to be dropped. */
+static int control_read_client(ControlServer *c, int i) {
+  ControlClient *cl = &c->clients[i];
+  ssize_t n = read(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - 1 - cl->len);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) return 1;
+  if (n <= 0) return 0;
+  cl->len += (size_t)n;
+  cl->buf[cl->len] = '\0';
+
+  char *start = cl->buf;
+  char *nl;
+  while ((nl = strchr(start, '\n')) != NULL) {
+    *nl = '\0';
+    char reply[1024];
+    trace_begin("control_request");
+    control_handle_line(c, start, reply, sizeof(reply));
+    trace_end();
+
+    /* A client that does not read its replies is dropped rather than
+     * waited for. */
+    size_t len = strlen(reply);
+    if (send(cl->fd, reply, len, MSG_NOSIGNAL) != (ssize_t)len) return 0;
+    start = nl + 1;
+  }
+
+  cl->len -= (size_t)(start - cl->buf);
+  memmove(cl->buf, start, cl->len);
+  /* A line that fills the whole buffer can never complete. */
+  return cl->len < sizeof(cl->buf) - 1;
+}
+
+static void control_accept(ControlServer *c) {
+  int fd = accept(c->listen_fd, NULL, NULL);
+  if (fd < 0) return;
+  if (c->nclients == CONTROL_MAX_CLIENTS) {
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  ControlClient *cl = &c->clients[c->nclients++];
+  cl->fd = fd;
+  cl->len = 0;
+}
+
+static void *control_thread(void *arg) {
+  ControlServer *c = (ControlServer *)arg;
+  trace_set_thread_name("control");
+
+  while (!atomic_load(&c->quit)) {
+    struct pollfd fds[CONTROL_MAX_CLIENTS + 2];
+    fds[0].fd = c->wake[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = c->listen_fd;
+    fds[1].events = POLLIN;
+    for (int i = 0; i < c->nclients; ++i) {
+      fds[2 + i].fd = c->clients[i].fd;
+      fds[2 + i].events = POLLIN;
+    }
+    int nfds = 2 + c->nclients;
+
+    if (poll(fds, (nfds_t)nfds, -1) < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "control: poll failed: %s\n", strerror(errno));
+      break;
+    }
+    if (fds[0].revents) break;
+
+    /* Backwards, so dropping a client does not skip the next one. */
+    for (int i = nfds - 3; i >= 0; --i) {
+      if (fds[2 + i].revents && !control_read_client(c, i)) {
+        control_drop_client(c, i);
+      }
+    }
+    if (fds[1].revents & POLLIN) control_accept(c);
+  }
+
+  while (c->nclients > 0) control_drop_client(c, c->nclients - 1);
+  return NULL;
+}
+
+/* 1 when a server accepts connections on `addr`, 0 when the socket there
+ * is stale, -1 when that cannot be told. */
+static int control_socket_live(const struct sockaddr_un *addr) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  int live = 1;
+  if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0)
+    live = errno == ECONNREFUSED ? 0 : -1;
+  close(fd);
+  return live;
+}
+
+ControlServer *control_open(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (!path || strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "control: socket path too long\n");
+    return NULL;
+  }
+  strcpy(addr.sun_path, path);
+
+  ControlServer *c = (ControlServer *)calloc(1, sizeof(ControlServer));
+  if (!c) return NULL;
+  c->listen_fd = -1;
+  c->wake[0] = c->wake[1] = -1;
+  c->commands = lfqueue_create(CONTROL_COMMANDS, sizeof(ControlCommand));
+  c->path = str_dupe(path);
+
+  /* Only a socket left behind by an earlier run is replaced; anything else
+   * at the path is most likely a mistyped setting, or another player. */
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "control: %s exists and is not a socket\n", path);
+      control_close(c);
+      return NULL;
+    }
+    int live = control_socket_live(&addr);
+    if (live != 0) {
+      fprintf(stderr, "control: %s %s\n", path,
+              live > 0 ? "is already in use" : "cannot be checked");
+      control_close(c);
+      return NULL;
+    }
+    unlink(path);
+  }
+
+  c->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (c->listen_fd >= 0 &&
+      bind(c->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    c->bound = 1;
+  }
+  if (!c->commands || !c->path || !c->bound ||
+      listen(c->listen_fd, CONTROL_MAX_CLIENTS) < 0 || pipe(c->wake) < 0) {
+    fprintf(stderr, "control: cannot listen on %s: %s\n", path,
+            strerror(errno));
+    control_close(c);
+    return NULL;
+  }
+  if (pthread_create(&c->thread, NULL, control_thread, c) != 0) {
+    fprintf(stderr, "control: cannot start thread\n");
+    control_close(c);
+    return NULL;
+  }
+  c->thread_started = 1;
+
+  fprintf(stderr, "control: listening on %s\n", path);
+  return c;
+}
+
+void control_close(ControlServer *c) {
+  if (!c) return;
+
+  if (c->thread_started) {
+    atomic_store(&c->quit, 1);
+    char b = 1;
+    if (write(c->wake[1], &b, 1) < 0) {
+      /* The thread still sees `quit` once poll() returns. */
+    }
+    pthread_join(c->thread, NULL);
+    fprintf(stderr, "control: %llu commands received\n",
+            (unsigned long long)atomic_load(&c->queued));
+  }
+
+  if (c->listen_fd >= 0) close(c->listen_fd);
+  if (c->bound) unlink(c->path);
+  if (c->wake[0] >= 0) close(c->wake[0]);
+  if (c->wake[1] >= 0) close(c->wake[1]);
+  lfqueue_destroy(c->commands);
+  free(c->path);
+  free(c);
+}
+
+int control_poll(ControlServer *c, ControlCommand *out) {
+  if (!c || !lfqueue_pop(c->commands, out)) return 0;
+  atomic_fetch_add(&c->taken, 1);
+  return 1;
+}
\ No newline at end of file
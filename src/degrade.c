@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "degrade.h"
+
+/* A frame is late when decoding and converting it used this much of its
+ * interval; the rest goes to audio, drawing and presenting. */
+#define DEGRADE_LATE_FRACTION 0.85
+/* More than this share of late frames in a window raises the level. */
+#define DEGRADE_WINDOW_MS 500
+#define DEGRADE_LATE_SHARE 0.5
+/* Load below this for `hold_ms` lowers the level. */
+#define DEGRADE_HEADROOM_LOAD 0.45
+#define DEGRADE_HOLD_MS 3000
+#define DEGRADE_MAX_HOLD_MS 60000
+
+void degrade_reset(Degrade *d, uint32_t now) {
+  memset(d, 0, sizeof(*d));
+  d->level_since = now;
+  d->window_start = now;
+  d->hold_ms = DEGRADE_HOLD_MS;
+}
+
+static void degrade_set(Degrade *d, int level, uint32_t now) {
+  d->ms_at_level[d->level] += now - d->level_since;
+  d->level = level;
+  d->level_since = now;
+  d->headroom_since = 0;
+  d->changes++;
+}
+
+int degrade_update(Degrade *d, double cost_ms, int frame_ms, uint32_t now) {
+  if (frame_ms <= 0) return -1;
+
+  double load = cost_ms / (double)frame_ms;
+  d->load += (load - d->load) * 0.1;
+  d->window_frames++;
+  if (load > DEGRADE_LATE_FRACTION) d->window_late++;
+
+  if (now - d->window_start >= DEGRADE_WINDOW_MS) {
+    int pressure =
+        d->window_late > (int)(d->window_frames * DEGRADE_LATE_SHARE);
+    d->window_start = now;
+    d->window_frames = 0;
+    d->window_late = 0;
+
+    if (pressure && d->level < DEGRADE_MAX_LEVEL &&
+        now - d->level_since >= DEGRADE_WINDOW_MS) {
+      /* Lowering did not hold; wait longer before trying again. */
+      if (d->lowered_at && now - d->lowered_at < 2 * d->hold_ms) {
+        d->hold_ms *= 2;
+        if (d->hold_ms > DEGRADE_MAX_HOLD_MS) d->hold_ms = DEGRADE_MAX_HOLD_MS;
+      }
+      d->lowered_at = 0;
+      degrade_set(d, d->level + 1, now);
+      return d->level;
+    }
+  }
+
+  if (d->level == 0 || d->load >= DEGRADE_HEADROOM_LOAD) {
+    d->headroom_since = 0;
+    return -1;
+  }
+  if (!d->headroom_since) d->headroom_since = now;
+  if (now - d->headroom_since < d->hold_ms || now - d->level_since < d->hold_ms)
+    return -1;
+
+  degrade_set(d, d->level - 1, now);
+  d->lowered_at = now;
+  return d->level;
+}
+
+void degrade_totals(const Degrade *d, uint32_t now,
+                    uint32_t out[DEGRADE_MAX_LEVEL + 1]) {
+  memcpy(out, d->ms_at_level, sizeof(d->ms_at_level));
+  out[d->level] += now - d->level_since;
+}
+
+const char *degrade_level_name(int level) {
+  switch (level) {
+    case 0:
+      return "full";
+    case 1:
+      return "no non-ref loop filter";
+    case 2:
+      return "no loop filter";
+    case 3:
+      return "no non-ref IDCT, fast scaling";
+    case 4:
+      return "non-ref frames skipped";
+    default:
+      return "?";
+  }
+}
\ No newline at end of file
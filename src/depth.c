@@ -0,0 +1,140 @@
+#include <libavutil/frame.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "depth.h"
+#include "workpool.h"
+
+/* Below this many pixels a frame is converted on the calling thread. */
+#define DEPTH_MIN_PARALLEL_PIXELS (1920 * 1080)
+#define DEPTH_MAX_BANDS 16
+
+/* Quarter-step offsets of a 2x2 ordered dither; their mean of 1.5 also
+ * rounds to nearest. Index with [y & 1][x & 1]. */
+static const uint16_t depth_dither[2][2] = {{0, 2}, {3, 1}};
+
+int depth_supported(int pix_fmt) {
+  return pix_fmt == AV_PIX_FMT_P010LE || pix_fmt == AV_PIX_FMT_YUV420P10LE;
+}
+
+/* dst[x] = min(255, (src[x] + d[x & 1]) >> shift). Both 10-bit layouts fit:
+ * YUV420P10 keeps samples in the low bits (shift 2), P010 in the high bits
+ * (shift 8, offsets scaled by 64). */
+static void depth_row(const uint16_t *src, uint8_t *dst, int n, int shift,
+                      unsigned d0, unsigned d1) {
+  int x = 0;
+#if defined(__SSE2__)
+  __m128i dv = _mm_set_epi16((short)d1, (short)d0, (short)d1, (short)d0,
+                             (short)d1, (short)d0, (short)d1, (short)d0);
+  __m128i sh = _mm_cvtsi32_si128(shift);
+  for (; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + x + 8));
+    a = _mm_srl_epi16(_mm_adds_epu16(a, dv), sh);
+    b = _mm_srl_epi16(_mm_adds_epu16(b, dv), sh);
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(a, b));
+  }
+#endif
+  for (; x < n; ++x) {
+    unsigned v = ((unsigned)src[x] + ((x & 1) ? d1 : d0)) >> shift;
+    dst[x] = (uint8_t)(v > 255 ? 255 : v);
+  }
+}
+
+/* P010 chroma: `n` interleaved U/V pairs split into two planes. */
+static void depth_row_uv(const uint16_t *src, uint8_t *u, uint8_t *v, int n,
+                         unsigned d0, unsigned d1) {
+  int x = 0;
+#if defined(__SSE2__)
+  __m128i dv = _mm_set_epi16((short)d1, (short)d1, (short)d0, (short)d0,
+                             (short)d1, (short)d1, (short)d0, (short)d0);
+  __m128i lo = _mm_set1_epi32(0xffff);
+  __m128i zero = _mm_setzero_si128();
+  for (; x + 8 <= n; x += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 8));
+    a = _mm_srli_epi16(_mm_adds_epu16(a, dv), 8);
+    b = _mm_srli_epi16(_mm_adds_epu16(b, dv), 8);
+    __m128i uu = _mm_packs_epi32(_mm_and_si128(a, lo), _mm_and_si128(b, lo));
+    __m128i vv = _mm_packs_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+    _mm_storel_epi64((__m128i *)(u + x), _mm_packus_epi16(uu, zero));
+    _mm_storel_epi64((__m128i *)(v + x), _mm_packus_epi16(vv, zero));
+  }
+#endif
+  for (; x < n; ++x) {
+    unsigned d = (x & 1) ? d1 : d0;
+    unsigned cu = ((unsigned)src[2 * x] + d) >> 8;
+    unsigned cv = ((unsigned)src[2 * x + 1] + d) >> 8;
+    u[x] = (uint8_t)(cu > 255 ? 255 : cu);
+    v[x] = (uint8_t)(cv > 255 ? 255 : cv);
+  }
+}
+
+static const uint16_t *depth_src_row(const AVFrame *f, int plane, int y) {
+  return (const uint16_t *)(f->data[plane] + (ptrdiff_t)y * f->linesize[plane]);
+}
+
+void depth_convert_rows(const AVFrame *src, uint8_t *const dst[3],
+                        const int dst_stride[3], int y0, int y1) {
+  int p010 = src->format == AV_PIX_FMT_P010LE;
+  int shift = p010 ? 8 : 2;
+  unsigned scale = p010 ? 64 : 1;
+  int cw = (src->width + 1) / 2;
+
+  for (int y = y0; y < y1; ++y) {
+    const uint16_t *d = depth_dither[y & 1];
+    depth_row(depth_src_row(src, 0, y), dst[0] + (ptrdiff_t)y * dst_stride[0],
+              src->width, shift, d[0] * scale, d[1] * scale);
+  }
+
+  for (int cy = y0 / 2; cy < (y1 + 1) / 2; ++cy) {
+    const uint16_t *d = depth_dither[cy & 1];
+    uint8_t *u = dst[1] + (ptrdiff_t)cy * dst_stride[1];
+    uint8_t *v = dst[2] + (ptrdiff_t)cy * dst_stride[2];
+    if (p010) {
+      depth_row_uv(depth_src_row(src, 1, cy), u, v, cw, d[0] * scale,
+                   d[1] * scale);
+    } else {
+      depth_row(depth_src_row(src, 1, cy), u, cw, shift, d[0], d[1]);
+      depth_row(depth_src_row(src, 2, cy), v, cw, shift, d[0], d[1]);
+    }
+  }
+}
+
+typedef struct {
+  const AVFrame *src;
+  uint8_t *const *dst;
+  const int *dst_stride;
+  int rows;
+} DepthJob;
+
+static void depth_band_job(void *arg, int index) {
+  const DepthJob *job = (const DepthJob *)arg;
+  int y0 = index * job->rows;
+  int y1 = y0 + job->rows;
+  if (y1 > job->src->height) y1 = job->src->height;
+  if (y0 < y1) depth_convert_rows(job->src, job->dst, job->dst_stride, y0, y1);
+}
+
+void depth_convert(const AVFrame *src, uint8_t *const dst[3],
+                   const int dst_stride[3]) {
+  int bands = 1;
+  if (src->width * src->height >= DEPTH_MIN_PARALLEL_PIXELS) {
+    bands = workpool_cpu_count();
+    if (bands > DEPTH_MAX_BANDS) bands = DEPTH_MAX_BANDS;
+  }
+  if (bands <= 1) {
+    depth_convert_rows(src, dst, dst_stride, 0, src->height);
+    return;
+  }
+
+  /* Even band heights keep each chroma row inside one band. */
+  int rows = (src->height + bands - 1) / bands;
+  rows = (rows + 1) & ~1;
+  bands = (src->height + rows - 1) / rows;
+
+  DepthJob job = {src, dst, dst_stride, rows};
+  workpool_run(workpool_shared(), bands, depth_band_job, &job);
+}
\ No newline at end of file
@@ -0,0 +1,341 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <SDL2/SDL.h>
+#include <libavformat/avformat.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "common.h"
+#include "config.h"
+#include "engine.h"
+#include "framepool.h"
+#include "framesink.h"
+#include "lfqueue.h"
+#include "loader.h"
+#include "probecache.h"
+#include "trace.h"
+#include "video.h"
+#include "workpool.h"
+
+#define ENGINE_COMMANDS 64
+#define ENGINE_EVENTS 256
+/* Longest the engine thread sleeps, which bounds command latency. */
+#define ENGINE_POLL_MS 5
+
+typedef enum {
+  ENGINE_CMD_OPEN,
+  ENGINE_CMD_SEEK,
+  ENGINE_CMD_PAUSE,
+  ENGINE_CMD_VOLUME
+} EngineCommandType;
+
+typedef struct {
+  EngineCommandType type;
+  /* ENGINE_CMD_OPEN; freed by whoever takes the command. */
+  char *path;
+  int64_t ms;
+  int paused;
+  double volume;
+} EngineCommand;
+
+/* Engines alive in the process. The worker pool, frame pools, probe cache
+ * and frame export are shared by all of them and torn down with the last,
+ * so nothing keeps running once the host unloads the library. */
+static pthread_mutex_t g_engines_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_engines;
+
+struct Engine {
+  LfQueue *commands;
+  LfQueue *events;
+  atomic_uint events_dropped;
+
+  pthread_t thread;
+  int thread_started;
+  atomic_int quit;
+
+  EngineFrameFn on_frame;
+  void *opaque;
+
+  /* Everything below belongs to the engine thread. Frames are drawn by
+   * SDL's software renderer into `surface`, so VideoState converts them
+   * straight to its RGB format at the letterboxed size. */
+  SDL_Surface *surface;
+  SDL_Renderer *ren;
+  AudioOut audio;
+  VideoState vid;
+  Loader *loader;
+  int playing;
+  int paused;
+  double volume;
+  Uint32 position_ticks;
+};
+
+static void engine_post(Engine *e, const EngineEvent *ev) {
+  if (!lfqueue_push(e->events, ev)) atomic_fetch_add(&e->events_dropped, 1);
+}
+
+static void engine_post_error(Engine *e, const char *fmt, ...) {
+  EngineEvent ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.type = ENGINE_EVENT_ERROR;
+  ev.position_ms = video_get_position_ms(&e->vid);
+
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(ev.message, sizeof(ev.message), fmt, ap);
+  va_end(ap);
+
+  fprintf(stderr, "engine: %s\n", ev.message);
+  engine_post(e, &ev);
+}
+
+static void engine_post_position(Engine *e, EngineEventType type) {
+  EngineEvent ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.type = type;
+  ev.position_ms = video_get_position_ms(&e->vid);
+  ev.duration_ms = video_get_duration_ms(&e->vid);
+  if (type == ENGINE_EVENT_OPENED && e->vid.path) {
+    snprintf(ev.message, sizeof(ev.message), "%s", e->vid.path);
+  }
+  engine_post(e, &ev);
+  e->position_ticks = SDL_GetTicks();
+}
+
+static void engine_run_command(Engine *e, EngineCommand *c) {
+  switch (c->type) {
+    case ENGINE_CMD_OPEN:
+      audio_out_clear(&e->audio);
+      e->playing = 0;
+      loader_start(e->loader, c->path);
+      free(c->path);
+      break;
+    case ENGINE_CMD_SEEK:
+      if (!e->vid.fmt) break;
+      video_seek_ms(&e->vid, c->ms);
+      e->playing = 1;
+      engine_post_position(e, ENGINE_EVENT_POSITION);
+      break;
+    case ENGINE_CMD_PAUSE:
+      e->paused = c->paused;
+      audio_out_set_paused(&e->audio, c->paused);
+      break;
+    case ENGINE_CMD_VOLUME:
+      e->volume = c->volume;
+      video_set_volume(&e->vid, c->volume);
+      break;
+  }
+}
+
+static void engine_poll_loader(Engine *e) {
+  LoaderState st = loader_poll(e->loader);
+  if (st == LOADER_FAILED) {
+    engine_post_error(e, "cannot open %s", loader_path(e->loader));
+    loader_reset(e->loader);
+    video_close(&e->vid);
+  } else if (st == LOADER_READY) {
+    char path[ENGINE_MESSAGE_MAX];
+    snprintf(path, sizeof(path), "%s", loader_path(e->loader));
+
+    VideoInput in;
+    loader_take(e->loader, &in);
+    if (!video_open_input(&e->vid, e->ren, &e->audio, &in)) {
+      engine_post_error(e, "cannot play %s", path);
+      return;
+    }
+    video_set_volume(&e->vid, e->volume);
+    e->playing = 1;
+    engine_post_position(e, ENGINE_EVENT_OPENED);
+  }
+}
+
+/* Letterboxes the current frame into the surface for the host. */
+static void engine_deliver_frame(Engine *e, SDL_Texture *tex) {
+  int fw, fh;
+  video_get_frame_size(&e->vid, &fw, &fh);
+  if (fw <= 0 || fh <= 0) return;
+
+  int ww = e->surface->w, wh = e->surface->h;
+  double sx = (double)ww / fw;
+  double sy = (double)wh / fh;
+  double sc = sx < sy ? sx : sy;
+  SDL_Rect dst = {0, 0, (int)(fw * sc), (int)(fh * sc)};
+  dst.x = (ww - dst.w) / 2;
+  dst.y = (wh - dst.h) / 2;
+  video_set_output_size(&e->vid, dst.w, dst.h);
+
+  trace_begin("engine_frame");
+  SDL_SetRenderDrawColor(e->ren, 0, 0, 0, 255);
+  SDL_RenderClear(e->ren);
+  SDL_RenderCopy(e->ren, tex, NULL, &dst);
+  SDL_RenderPresent(e->ren);
+  e->on_frame(e->opaque, (const uint8_t *)e->surface->pixels,
+              e->surface->pitch, ww, wh, video_get_position_ms(&e->vid));
+  trace_end();
+}
+
+static void engine_step(Engine *e) {
+  SDL_Texture *before = video_get_texture(&e->vid, NULL, NULL);
+  video_step(&e->vid, e->ren);
+
+  /* Each shown frame goes to the next texture of the ring. */
+  SDL_Texture *tex = video_get_texture(&e->vid, NULL, NULL);
+  if (tex && tex != before && e->on_frame) engine_deliver_frame(e, tex);
+
+  if (video_is_eof(&e->vid)) {
+    e->playing = 0;
+    engine_post_position(e, ENGINE_EVENT_EOF);
+  } else if (SDL_GetTicks() - e->position_ticks >= ENGINE_POSITION_MS) {
+    engine_post_position(e, ENGINE_EVENT_POSITION);
+  }
+}
+
+/* Until the next frame is due, but no longer than ENGINE_POLL_MS. */
+static Uint32 engine_sleep_ms(const Engine *e) {
+  if (!e->playing || e->paused) return ENGINE_POLL_MS;
+  int left = e->vid.frame_ms - (int)(SDL_GetTicks() - e->vid.last_ticks);
+  if (left < 1) left = 1;
+  if (left > ENGINE_POLL_MS) left = ENGINE_POLL_MS;
+  return (Uint32)left;
+}
+
+static void *engine_thread(void *arg) {
+  Engine *e = (Engine *)arg;
+  trace_set_thread_name("engine");
+
+  while (!atomic_load(&e->quit)) {
+    EngineCommand c;
+    while (lfqueue_pop(e->commands, &c)) engine_run_command(e, &c);
+
+    engine_poll_loader(e);
+    if (e->playing && !e->paused) engine_step(e);
+
+    SDL_Delay(engine_sleep_ms(e));
+  }
+  return NULL;
+}
+
+Engine *engine_create(int width, int height, EngineFrameFn on_frame,
+                      void *opaque) {
+  if (width < 2 || height < 2) return NULL;
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0) {
+    fprintf(stderr, "engine: SDL_InitSubSystem failed: %s\n",
+            SDL_GetError());
+    return NULL;
+  }
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+  av_register_all();
+#endif
+  avformat_network_init();
+
+  Engine *e = (Engine *)calloc(1, sizeof(Engine));
+  if (!e) {
+    SDL_QuitSubSystem(SDL_INIT_AUDIO | SDL_INIT_TIMER);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&g_engines_lock);
+  if (g_engines++ == 0) {
+    config_load_env();
+    const PlayerConfig *cfg = player_config();
+    if (cfg->frame_export) {
+      framesink_init(cfg->frame_export, cfg->frame_export_slots);
+    }
+  }
+  pthread_mutex_unlock(&g_engines_lock);
+
+  e->on_frame = on_frame;
+  e->opaque = opaque;
+  e->volume = 1.0;
+  e->commands = lfqueue_create(ENGINE_COMMANDS, sizeof(EngineCommand));
+  e->events = lfqueue_create(ENGINE_EVENTS, sizeof(EngineEvent));
+  e->loader = loader_create();
+  e->surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32,
+                                              SDL_PIXELFORMAT_ARGB8888);
+  e->ren = e->surface ? SDL_CreateSoftwareRenderer(e->surface) : NULL;
+
+  const PlayerConfig *cfg = player_config();
+  audio_out_open(&e->audio, cfg->audio_samples, cfg->audio_low_ms,
+                 cfg->audio_high_ms, cfg->audio_adaptive);
+
+  if (!e->commands || !e->events || !e->loader || !e->ren ||
+      pthread_create(&e->thread, NULL, engine_thread, e) != 0) {
+    fprintf(stderr, "engine: cannot start: %s\n", SDL_GetError());
+    engine_destroy(e);
+    return NULL;
+  }
+  e->thread_started = 1;
+  return e;
+}
+
+void engine_destroy(Engine *e) {
+  if (!e) return;
+
+  if (e->thread_started) {
+    atomic_store(&e->quit, 1);
+    pthread_join(e->thread, NULL);
+  }
+
+  EngineCommand c;
+  while (e->commands && lfqueue_pop(e->commands, &c)) {
+    if (c.type == ENGINE_CMD_OPEN) free(c.path);
+  }
+  unsigned dropped = atomic_load(&e->events_dropped);
+  if (dropped) fprintf(stderr, "engine: %u events dropped\n", dropped);
+
+  loader_destroy(e->loader);
+  video_close(&e->vid);
+  audio_out_report(&e->audio);
+  audio_out_close(&e->audio);
+  if (e->ren) SDL_DestroyRenderer(e->ren);
+  if (e->surface) SDL_FreeSurface(e->surface);
+  lfqueue_destroy(e->commands);
+  lfqueue_destroy(e->events);
+  free(e);
+
+  pthread_mutex_lock(&g_engines_lock);
+  if (--g_engines == 0) {
+    framesink_shutdown();
+    workpool_shared_shutdown();
+    framepool_shutdown();
+    probecache_shutdown();
+  }
+  pthread_mutex_unlock(&g_engines_lock);
+  SDL_QuitSubSystem(SDL_INIT_AUDIO | SDL_INIT_TIMER);
+}
+
+static int engine_send(Engine *e, const EngineCommand *c) {
+  return e && lfqueue_push(e->commands, c);
+}
+
+int engine_open(Engine *e, const char *path) {
+  if (!e || !path) return 0;
+  EngineCommand c = {ENGINE_CMD_OPEN, str_dupe(path), 0, 0, 0.0};
+  if (c.path && engine_send(e, &c)) return 1;
+  free(c.path);
+  return 0;
+}
+
+int engine_seek(Engine *e, int64_t ms) {
+  EngineCommand c = {ENGINE_CMD_SEEK, NULL, ms, 0, 0.0};
+  return engine_send(e, &c);
+}
+
+int engine_pause(Engine *e, int paused) {
+  EngineCommand c = {ENGINE_CMD_PAUSE, NULL, 0, paused != 0, 0.0};
+  return engine_send(e, &c);
+}
+
+int engine_set_volume(Engine *e, double volume) {
+  EngineCommand c = {ENGINE_CMD_VOLUME, NULL, 0, 0, volume};
+  return engine_send(e, &c);
+}
+
+int engine_poll_event(Engine *e, EngineEvent *ev) {
+  return e && ev && lfqueue_pop(e->events, ev);
+}
\ No newline at end of file
@@ -0,0 +1,397 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "fileio.h"
+#include "trace.h"
+
+struct FileIo {
+  int fd;
+  int64_t size;
+  IoMode mode;
+  char *path;
+
+  AVIOContext *avio;
+  int64_t pos;
+
+  /* IO_MODE_MMAP */
+  uint8_t *map;
+  int64_t advised_until;
+
+  /* IO_MODE_PREAD / IO_MODE_PREFETCH */
+  size_t prefetch_bytes;
+
+  /* IO_MODE_PREFETCH: ring of bytes [ring_pos, ring_pos + fill). */
+  pthread_t thread;
+  int thread_started;
+  pthread_mutex_t lock;
+  pthread_cond_t data_ready;
+  pthread_cond_t space_ready;
+  uint8_t *ring;
+  int64_t ring_pos;
+  size_t fill;
+  unsigned generation;
+  int at_eof;
+  int error;
+  int quit;
+
+  FileIoStats stats;
+};
+
+static uint64_t fileio_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+const char *fileio_mode_name(IoMode mode) {
+  switch (mode) {
+    case IO_MODE_PREAD:
+      return "pread";
+    case IO_MODE_PREFETCH:
+      return "prefetch";
+    case IO_MODE_MMAP:
+      return "mmap";
+    default:
+      return "default";
+  }
+}
+
+int fileio_is_local_path(const char *path) {
+  if (!path || !path[0]) return 0;
+  if (strstr(path, "://")) return 0;
+
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static void fileio_advise_ahead(FileIo *f, int64_t pos) {
+  if (f->prefetch_bytes == 0 || pos + (int64_t)f->prefetch_bytes / 2 <
+                                    f->advised_until)
+    return;
+
+  int64_t end = pos + (int64_t)f->prefetch_bytes;
+  if (end > f->size) end = f->size;
+  if (end <= f->advised_until) return;
+  int64_t start = f->advised_until > pos ? f->advised_until : pos;
+
+  if (f->map) {
+    long page = sysconf(_SC_PAGESIZE);
+    int64_t aligned = start & ~((int64_t)page - 1);
+    madvise(f->map + aligned, (size_t)(end - aligned), MADV_WILLNEED);
+  } else {
+    posix_fadvise(f->fd, start, end - start, POSIX_FADV_WILLNEED);
+  }
+  f->stats.syscalls++;
+  f->advised_until = end;
+}
+
+static int fileio_read_mmap(FileIo *f, uint8_t *buf, int size) {
+  if (f->pos >= f->size) return AVERROR_EOF;
+
+  int64_t n = f->size - f->pos;
+  if (n > size) n = size;
+
+  fileio_advise_ahead(f, f->pos);
+
+  /* Page faults on the mapping are where the demuxer waits for the disk. */
+  uint64_t t0 = fileio_now_ns();
+  memcpy(buf, f->map + f->pos, (size_t)n);
+  f->stats.stall_ns += fileio_now_ns() - t0;
+
+  f->pos += n;
+  f->stats.bytes_read += (uint64_t)n;
+  return (int)n;
+}
+
+static int fileio_read_pread(FileIo *f, uint8_t *buf, int size) {
+  fileio_advise_ahead(f, f->pos);
+
+  uint64_t t0 = fileio_now_ns();
+  ssize_t n;
+  do {
+    n = pread(f->fd, buf, (size_t)size, f->pos);
+  } while (n < 0 && errno == EINTR);
+  f->stats.stall_ns += fileio_now_ns() - t0;
+  f->stats.syscalls++;
+
+  if (n < 0) return AVERROR(errno);
+  if (n == 0) return AVERROR_EOF;
+
+  f->pos += n;
+  f->stats.bytes_read += (uint64_t)n;
+  return (int)n;
+}
+
+static void *fileio_prefetch_thread(void *opaque) {
+  FileIo *f = (FileIo *)opaque;
+  trace_set_thread_name("prefetch");
+
+  pthread_mutex_lock(&f->lock);
+  while (!f->quit) {
+    if (f->at_eof || f->error || f->fill == f->prefetch_bytes) {
+      pthread_cond_wait(&f->space_ready, &f->lock);
+      continue;
+    }
+
+    int64_t off = f->ring_pos + (int64_t)f->fill;
+    size_t idx = (size_t)(off % (int64_t)f->prefetch_bytes);
+    size_t chunk = f->prefetch_bytes - f->fill;
+    if (chunk > f->prefetch_bytes - idx) chunk = f->prefetch_bytes - idx;
+    if (chunk > FILEIO_CHUNK_BYTES) chunk = FILEIO_CHUNK_BYTES;
+    unsigned gen = f->generation;
+
+    /* Only this thread writes past `fill`, so the ring can be filled
+     * without holding the lock. */
+    pthread_mutex_unlock(&f->lock);
+    trace_begin("prefetch_read");
+    ssize_t n;
+    do {
+      n = pread(f->fd, f->ring + idx, chunk, off);
+    } while (n < 0 && errno == EINTR);
+    trace_end();
+    pthread_mutex_lock(&f->lock);
+
+    f->stats.syscalls++;
+    if (gen != f->generation) continue;
+
+    if (n > 0) {
+      f->fill += (size_t)n;
+    } else if (n == 0) {
+      f->at_eof = 1;
+    } else {
+      f->error = AVERROR(errno);
+    }
+    pthread_cond_signal(&f->data_ready);
+  }
+  pthread_mutex_unlock(&f->lock);
+  return NULL;
+}
+
+static int fileio_read_prefetch(FileIo *f, uint8_t *buf, int size) {
+  pthread_mutex_lock(&f->lock);
+
+  if (f->fill == 0 && !f->at_eof && !f->error) {
+    uint64_t t0 = fileio_now_ns();
+    while (f->fill == 0 && !f->at_eof && !f->error) {
+      pthread_cond_wait(&f->data_ready, &f->lock);
+    }
+    f->stats.stall_ns += fileio_now_ns() - t0;
+  }
+
+  if (f->fill == 0) {
+    int err = f->error ? f->error : AVERROR_EOF;
+    pthread_mutex_unlock(&f->lock);
+    return err;
+  }
+
+  size_t n = f->fill < (size_t)size ? f->fill : (size_t)size;
+  size_t idx = (size_t)(f->ring_pos % (int64_t)f->prefetch_bytes);
+  pthread_mutex_unlock(&f->lock);
+
+  /* The reader owns [ring_pos, ring_pos + fill) until it advances. */
+  size_t first = f->prefetch_bytes - idx;
+  if (first > n) first = n;
+  memcpy(buf, f->ring + idx, first);
+  if (n > first) memcpy(buf + first, f->ring, n - first);
+
+  pthread_mutex_lock(&f->lock);
+  f->ring_pos += (int64_t)n;
+  f->fill -= n;
+  f->stats.bytes_read += n;
+  pthread_cond_signal(&f->space_ready);
+  pthread_mutex_unlock(&f->lock);
+
+  f->pos += (int64_t)n;
+  return (int)n;
+}
+
+static int fileio_read_packet(void *opaque, uint8_t *buf, int size) {
+  FileIo *f = (FileIo *)opaque;
+  switch (f->mode) {
+    case IO_MODE_MMAP:
+      return fileio_read_mmap(f, buf, size);
+    case IO_MODE_PREFETCH:
+      return fileio_read_prefetch(f, buf, size);
+    default:
+      return fileio_read_pread(f, buf, size);
+  }
+}
+
+static int64_t fileio_seek(void *opaque, int64_t offset, int whence) {
+  FileIo *f = (FileIo *)opaque;
+
+  whence &= ~AVSEEK_FORCE;
+  if (whence == AVSEEK_SIZE) return f->size;
+
+  int64_t target;
+  if (whence == SEEK_SET) {
+    target = offset;
+  } else if (whence == SEEK_CUR) {
+    target = f->pos + offset;
+  } else if (whence == SEEK_END) {
+    target = f->size + offset;
+  } else {
+    return AVERROR(EINVAL);
+  }
+  if (target < 0) return AVERROR(EINVAL);
+
+  if (f->mode == IO_MODE_PREFETCH) {
+    pthread_mutex_lock(&f->lock);
+    f->stats.seeks++;
+    if (target >= f->ring_pos && target <= f->ring_pos + (int64_t)f->fill) {
+      size_t skip = (size_t)(target - f->ring_pos);
+      f->ring_pos = target;
+      f->fill -= skip;
+    } else {
+      f->generation++;
+      f->ring_pos = target;
+      f->fill = 0;
+      f->at_eof = 0;
+      f->error = 0;
+    }
+    pthread_cond_signal(&f->space_ready);
+    pthread_mutex_unlock(&f->lock);
+  } else {
+    f->stats.seeks++;
+    if (target < f->pos || target > f->advised_until) f->advised_until = target;
+  }
+
+  f->pos = target;
+  return target;
+}
+
+static int fileio_start_prefetch(FileIo *f) {
+  f->ring = (uint8_t *)malloc(f->prefetch_bytes);
+  if (!f->ring) return 0;
+
+  pthread_mutex_init(&f->lock, NULL);
+  pthread_cond_init(&f->data_ready, NULL);
+  pthread_cond_init(&f->space_ready, NULL);
+  if (pthread_create(&f->thread, NULL, fileio_prefetch_thread, f) != 0) {
+    pthread_cond_destroy(&f->space_ready);
+    pthread_cond_destroy(&f->data_ready);
+    pthread_mutex_destroy(&f->lock);
+    free(f->ring);
+    f->ring = NULL;
+    return 0;
+  }
+  f->thread_started = 1;
+  return 1;
+}
+
+FileIo *fileio_open(const char *path, IoMode mode, size_t buffer_size,
+                    size_t prefetch_bytes) {
+  if (mode == IO_MODE_DEFAULT || !fileio_is_local_path(path)) return NULL;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  FileIo *f = (FileIo *)calloc(1, sizeof(FileIo));
+  if (!f) {
+    close(fd);
+    return NULL;
+  }
+  f->fd = fd;
+  f->size = st.st_size;
+  f->mode = mode;
+  f->path = str_dupe(path);
+  f->prefetch_bytes = prefetch_bytes;
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  f->stats.syscalls++;
+
+  if (mode == IO_MODE_MMAP) {
+    void *m = f->size > 0 ? mmap(NULL, (size_t)f->size, PROT_READ,
+                                 MAP_PRIVATE, fd, 0)
+                          : MAP_FAILED;
+    f->stats.syscalls++;
+    if (m == MAP_FAILED) {
+      f->mode = IO_MODE_PREAD;
+    } else {
+      f->map = (uint8_t *)m;
+      madvise(f->map, (size_t)f->size, MADV_SEQUENTIAL);
+      f->stats.syscalls++;
+    }
+  } else if (mode == IO_MODE_PREFETCH) {
+    if (prefetch_bytes < FILEIO_CHUNK_BYTES || !fileio_start_prefetch(f)) {
+      f->mode = IO_MODE_PREAD;
+    }
+  }
+
+  uint8_t *buf = (uint8_t *)av_malloc(buffer_size);
+  if (buf) {
+    f->avio = avio_alloc_context(buf, (int)buffer_size, 0, f,
+                                 fileio_read_packet, NULL, fileio_seek);
+  }
+  if (!f->avio) {
+    av_free(buf);
+    fileio_close(f);
+    return NULL;
+  }
+  return f;
+}
+
+struct AVIOContext *fileio_avio(FileIo *f) {
+  return f ? f->avio : NULL;
+}
+
+void fileio_get_stats(FileIo *f, FileIoStats *out) {
+  if (!f || !out) return;
+  if (f->thread_started) pthread_mutex_lock(&f->lock);
+  *out = f->stats;
+  if (f->thread_started) pthread_mutex_unlock(&f->lock);
+}
+
+void fileio_close(FileIo *f) {
+  if (!f) return;
+
+  if (f->thread_started) {
+    pthread_mutex_lock(&f->lock);
+    f->quit = 1;
+    pthread_cond_signal(&f->space_ready);
+    pthread_mutex_unlock(&f->lock);
+    pthread_join(f->thread, NULL);
+    pthread_cond_destroy(&f->space_ready);
+    pthread_cond_destroy(&f->data_ready);
+    pthread_mutex_destroy(&f->lock);
+  }
+
+  FileIoStats st = f->stats;
+  if (f->avio) {
+    fprintf(stderr,
+            "fileio: %s [%s] read %.1f MiB, %llu syscalls, %llu seeks, "
+            "stalled %.1f ms\n",
+            f->path ? f->path : "?", fileio_mode_name(f->mode),
+            (double)st.bytes_read / (1024.0 * 1024.0),
+            (unsigned long long)st.syscalls, (unsigned long long)st.seeks,
+            (double)st.stall_ns / 1e6);
+    av_freep(&f->avio->buffer);
+    avio_context_free(&f->avio);
+  }
+
+  if (f->map) munmap(f->map, (size_t)f->size);
+  free(f->ring);
+  if (f->fd >= 0) close(f->fd);
+  free(f->path);
+  free(f);
+}
\ No newline at end of file
@@ -0,0 +1,219 @@
+#define _GNU_SOURCE
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "framepool.h"
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+typedef size_t FramePoolSize;
+#else
+typedef int FramePoolSize;
+#endif
+
+typedef struct {
+  int format;
+  int width, height;
+  int huge_pages;
+
+  int linesize[4];
+  size_t plane_size[4];
+  AVBufferPool *pools[4];
+
+  uint64_t last_used;
+} FramePool;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static FramePool g_pools[FRAMEPOOL_MAX_POOLS];
+static uint64_t g_use_counter;
+
+static atomic_uint_fast64_t g_gets;
+static atomic_uint_fast64_t g_allocs;
+static atomic_uint_fast64_t g_resident;
+
+static void framepool_free_block(void *opaque, uint8_t *data) {
+  size_t size = (size_t)(uintptr_t)opaque;
+  atomic_fetch_sub(&g_resident, size);
+  free(data);
+}
+
+static AVBufferRef *framepool_alloc(void *opaque, FramePoolSize size) {
+  int huge = (int)(intptr_t)opaque;
+  size_t align = FRAMEPOOL_ALIGN;
+  size_t bytes = (size_t)size;
+
+  /* Transparent huge pages want 2 MB alignment and whole pages. */
+  if (huge && bytes >= FRAMEPOOL_HUGE_PAGE / 2) {
+    align = FRAMEPOOL_HUGE_PAGE;
+    bytes = (bytes + FRAMEPOOL_HUGE_PAGE - 1) &
+            ~(size_t)(FRAMEPOOL_HUGE_PAGE - 1);
+  }
+
+  void *mem = NULL;
+  if (posix_memalign(&mem, align, bytes) != 0) return NULL;
+#ifdef MADV_HUGEPAGE
+  if (align == FRAMEPOOL_HUGE_PAGE) madvise(mem, bytes, MADV_HUGEPAGE);
+#endif
+
+  AVBufferRef *ref = av_buffer_create((uint8_t *)mem, size,
+                                      framepool_free_block,
+                                      (void *)(uintptr_t)bytes, 0);
+  if (!ref) {
+    free(mem);
+    return NULL;
+  }
+
+  atomic_fetch_add(&g_allocs, 1);
+  atomic_fetch_add(&g_resident, bytes);
+  return ref;
+}
+
+static void framepool_release(FramePool *p) {
+  for (int i = 0; i < 4; ++i) {
+    if (p->pools[i]) av_buffer_pool_uninit(&p->pools[i]);
+  }
+  memset(p, 0, sizeof(*p));
+}
+
+static int framepool_layout(AVCodecContext *avctx, FramePool *p) {
+  int w = p->width, h = p->height;
+  int align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(avctx, &w, &h, align);
+
+  if (av_image_fill_linesizes(p->linesize, p->format, w) < 0) return 0;
+  for (int i = 0; i < 4; ++i) {
+    p->linesize[i] = FFALIGN(p->linesize[i], FRAMEPOOL_ALIGN);
+  }
+
+  uint8_t *data[4];
+  int total = av_image_fill_pointers(data, p->format, h, NULL, p->linesize);
+  if (total < 0) return 0;
+
+  int planes;
+  for (planes = 0; planes < 3 && data[planes + 1]; ++planes) {
+    p->plane_size[planes] = (size_t)(data[planes + 1] - data[planes]);
+  }
+  p->plane_size[planes] = (size_t)total - (size_t)(data[planes] - data[0]);
+
+  for (int i = 0; i <= planes; ++i) {
+    p->plane_size[i] += 16 + FRAMEPOOL_ALIGN - 1;
+  }
+  return 1;
+}
+
+static FramePool *framepool_lookup(AVCodecContext *avctx, int format,
+                                   int width, int height, int huge) {
+  FramePool *lru = &g_pools[0];
+  for (int i = 0; i < FRAMEPOOL_MAX_POOLS; ++i) {
+    FramePool *p = &g_pools[i];
+    if (p->pools[0] && p->format == format && p->width == width &&
+        p->height == height && p->huge_pages == huge) {
+      p->last_used = ++g_use_counter;
+      return p;
+    }
+    if (!p->pools[0] || p->last_used < lru->last_used) lru = p;
+    if (!p->pools[0]) break;
+  }
+
+  framepool_release(lru);
+  lru->format = format;
+  lru->width = width;
+  lru->height = height;
+  lru->huge_pages = huge;
+  if (!framepool_layout(avctx, lru)) {
+    memset(lru, 0, sizeof(*lru));
+    return NULL;
+  }
+
+  for (int i = 0; i < 4 && lru->plane_size[i]; ++i) {
+    lru->pools[i] = av_buffer_pool_init2(lru->plane_size[i],
+                                         (void *)(intptr_t)huge,
+                                         framepool_alloc, NULL);
+    if (!lru->pools[i]) {
+      framepool_release(lru);
+      return NULL;
+    }
+  }
+  lru->last_used = ++g_use_counter;
+  return lru;
+}
+
+static int framepool_get_buffer2(AVCodecContext *avctx, AVFrame *frame,
+                                 int flags) {
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+  if (avctx->codec_type != AVMEDIA_TYPE_VIDEO || !desc ||
+      (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL |
+                      AV_PIX_FMT_FLAG_BITSTREAM)))
+    return avcodec_default_get_buffer2(avctx, frame, flags);
+
+  int huge = (int)(intptr_t)avctx->opaque;
+
+  pthread_mutex_lock(&g_lock);
+  FramePool *p = framepool_lookup(avctx, frame->format, frame->width,
+                                  frame->height, huge);
+  int ok = p != NULL;
+  for (int i = 0; ok && i < 4 && p->pools[i]; ++i) {
+    frame->buf[i] = av_buffer_pool_get(p->pools[i]);
+    if (!frame->buf[i]) {
+      ok = 0;
+      break;
+    }
+    frame->data[i] = (uint8_t *)FFALIGN((uintptr_t)frame->buf[i]->data,
+                                        FRAMEPOOL_ALIGN);
+    frame->linesize[i] = p->linesize[i];
+  }
+  pthread_mutex_unlock(&g_lock);
+
+  if (!ok) {
+    for (int i = 0; i < 4; ++i) av_buffer_unref(&frame->buf[i]);
+    memset(frame->data, 0, sizeof(frame->data));
+    memset(frame->linesize, 0, sizeof(frame->linesize));
+    return avcodec_default_get_buffer2(avctx, frame, flags);
+  }
+
+  /* Palette-less formats only need the data pointers mirrored. */
+  frame->extended_data = frame->data;
+  atomic_fetch_add(&g_gets, 1);
+  return 0;
+}
+
+void framepool_attach(AVCodecContext *dec, int huge_pages) {
+  if (!dec || !dec->codec || !(dec->codec->capabilities & AV_CODEC_CAP_DR1))
+    return;
+
+  dec->opaque = (void *)(intptr_t)(huge_pages ? 1 : 0);
+  dec->get_buffer2 = framepool_get_buffer2;
+#if LIBAVCODEC_VERSION_MAJOR < 59
+  dec->thread_safe_callbacks = 1;
+#endif
+}
+
+void framepool_get_stats(FramePoolStats *out) {
+  if (!out) return;
+  uint64_t gets = atomic_load(&g_gets);
+  uint64_t allocs = atomic_load(&g_allocs);
+  out->misses = allocs;
+  out->hits = gets > allocs ? gets - allocs : 0;
+  out->resident_bytes = atomic_load(&g_resident);
+
+  out->pools = 0;
+  pthread_mutex_lock(&g_lock);
+  for (int i = 0; i < FRAMEPOOL_MAX_POOLS; ++i) {
+    if (g_pools[i].pools[0]) out->pools++;
+  }
+  pthread_mutex_unlock(&g_lock);
+}
+
+void framepool_shutdown(void) {
+  pthread_mutex_lock(&g_lock);
+  for (int i = 0; i < FRAMEPOOL_MAX_POOLS; ++i) framepool_release(&g_pools[i]);
+  pthread_mutex_unlock(&g_lock);
+}
\ No newline at end of file
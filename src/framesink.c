@@ -0,0 +1,312 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "framesink.h"
+#include "lfqueue.h"
+#include "scaler.h"
+#include "trace.h"
+
+/* Frames waiting for the export thread; more means the export lags. */
+#define FRAMESINK_QUEUE 4
+#define FRAMESINK_ALIGN 64
+#define FRAMESINK_PAGE 4096
+
+_Static_assert(sizeof(FrameSinkSlot) <= FRAMESINK_SLOT_HEADER,
+               "FrameSinkSlot does not fit its header");
+_Static_assert(sizeof(FrameSinkHeader) <= FRAMESINK_PAGE,
+               "FrameSinkHeader does not fit its page");
+
+typedef struct {
+  AVFrame *frame;
+  int64_t pts_ms;
+} FrameSinkItem;
+
+typedef struct {
+  char *name;
+  unsigned char *map;
+  size_t map_size;
+  FrameSinkHeader *hdr;
+
+  LfQueue *queue;
+  sem_t wake;
+  pthread_t thread;
+  atomic_int quit;
+
+  /* Export thread only. */
+  Scaler scaler;
+  uint64_t frames;
+  uint64_t scaled;
+  uint64_t failed;
+  double write_ms;
+
+  atomic_ullong submitted;
+  atomic_ullong finished;
+  atomic_ullong dropped;
+} FrameSink;
+
+static atomic_int g_sink_on;
+static FrameSink g_sink;
+
+static size_t framesink_align(size_t v, size_t a) {
+  return (v + a - 1) & ~(a - 1);
+}
+
+static size_t framesink_slot_size(void) {
+  size_t cw = (FRAMESINK_MAX_WIDTH + 1) / 2;
+  size_t ch = (FRAMESINK_MAX_HEIGHT + 1) / 2;
+  size_t size = FRAMESINK_SLOT_HEADER +
+                framesink_align(FRAMESINK_MAX_WIDTH, FRAMESINK_ALIGN) *
+                    FRAMESINK_MAX_HEIGHT +
+                2 * framesink_align(cw, FRAMESINK_ALIGN) * ch;
+  return framesink_align(size, FRAMESINK_PAGE);
+}
+
+static double framesink_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+/* Largest even size within the slot limits with the aspect of w x h. */
+static void framesink_fit(int *w, int *h) {
+  int64_t sw = *w, sh = *h;
+  if (sw <= FRAMESINK_MAX_WIDTH && sh <= FRAMESINK_MAX_HEIGHT) return;
+  if (sw * FRAMESINK_MAX_HEIGHT > sh * FRAMESINK_MAX_WIDTH) {
+    *w = FRAMESINK_MAX_WIDTH;
+    *h = (int)(sh * FRAMESINK_MAX_WIDTH / sw) & ~1;
+  } else {
+    *h = FRAMESINK_MAX_HEIGHT;
+    *w = (int)(sw * FRAMESINK_MAX_HEIGHT / sh) & ~1;
+  }
+  if (*w < 2) *w = 2;
+  if (*h < 2) *h = 2;
+}
+
+/* Writes `f` as the next frame; readers of the slot it replaces see its
+ * sequence number change and discard what they read. */
+static void framesink_write(FrameSink *s, const AVFrame *f, int64_t pts_ms) {
+  int w = f->width, h = f->height;
+  framesink_fit(&w, &h);
+  int direct = (f->format == AV_PIX_FMT_YUV420P ||
+                f->format == AV_PIX_FMT_YUVJ420P) &&
+               w == f->width && h == f->height;
+
+  uint64_t n = s->frames + 1;
+  FrameSinkHeader *hdr = s->hdr;
+  unsigned char *base =
+      s->map + hdr->header_size + ((n - 1) % hdr->slot_count) * hdr->slot_size;
+  FrameSinkSlot *slot = (FrameSinkSlot *)base;
+
+  atomic_store_explicit(&slot->seq, 2 * n - 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  int cw = (w + 1) / 2, ch = (h + 1) / 2;
+  slot->pts_ms = pts_ms;
+  slot->format = FRAMESINK_FORMAT_I420;
+  slot->width = (uint32_t)w;
+  slot->height = (uint32_t)h;
+  slot->pitch[0] = (uint32_t)framesink_align((size_t)w, FRAMESINK_ALIGN);
+  slot->pitch[1] = (uint32_t)framesink_align((size_t)cw, FRAMESINK_ALIGN);
+  slot->pitch[2] = slot->pitch[1];
+  slot->offset[0] = FRAMESINK_SLOT_HEADER;
+  slot->offset[1] = slot->offset[0] + slot->pitch[0] * (uint32_t)h;
+  slot->offset[2] = slot->offset[1] + slot->pitch[1] * (uint32_t)ch;
+
+  uint8_t *planes[4] = {base + slot->offset[0], base + slot->offset[1],
+                        base + slot->offset[2], NULL};
+  int strides[4] = {(int)slot->pitch[0], (int)slot->pitch[1],
+                    (int)slot->pitch[2], 0};
+
+  if (direct) {
+    av_image_copy_plane(planes[0], strides[0], f->data[0], f->linesize[0], w,
+                        h);
+    av_image_copy_plane(planes[1], strides[1], f->data[1], f->linesize[1], cw,
+                        ch);
+    av_image_copy_plane(planes[2], strides[2], f->data[2], f->linesize[2], cw,
+                        ch);
+  } else if (!scaler_configure(&s->scaler, f->width, f->height, f->format, w,
+                               h, AV_PIX_FMT_YUV420P, SWS_BILINEAR, 1) ||
+             !scaler_scale(&s->scaler, f, planes, strides)) {
+    /* The slot stays marked as being written; the next frame reuses it. */
+    s->failed++;
+    return;
+  } else {
+    s->scaled++;
+  }
+
+  s->frames = n;
+  atomic_store_explicit(&slot->seq, 2 * n, memory_order_release);
+  atomic_store_explicit(&hdr->published, n, memory_order_release);
+}
+
+static void framesink_drain(FrameSink *s) {
+  FrameSinkItem it;
+  while (lfqueue_pop(s->queue, &it)) {
+    if (!atomic_load(&s->quit)) {
+      double t0 = framesink_now_ms();
+      trace_begin("frame_export");
+      framesink_write(s, it.frame, it.pts_ms);
+      trace_end();
+      s->write_ms += framesink_now_ms() - t0;
+    }
+    av_frame_free(&it.frame);
+    atomic_fetch_add_explicit(&s->finished, 1, memory_order_release);
+  }
+}
+
+static void *framesink_thread(void *arg) {
+  FrameSink *s = (FrameSink *)arg;
+  trace_set_thread_name("frame_export");
+
+  while (!atomic_load(&s->quit)) {
+    if (sem_wait(&s->wake) != 0 && errno == EINTR) continue;
+    framesink_drain(s);
+  }
+  return NULL;
+}
+
+static void framesink_unmap(FrameSink *s) {
+  if (s->map) {
+    munmap(s->map, s->map_size);
+    shm_unlink(s->name);
+  }
+  lfqueue_destroy(s->queue);
+  free(s->name);
+  memset(s, 0, sizeof(*s));
+}
+
+int framesink_init(const char *name, int slots) {
+  if (!name || !name[0] || framesink_enabled()) return 0;
+  if (slots < FRAMESINK_MIN_SLOTS) slots = FRAMESINK_MIN_SLOTS;
+  if (slots > FRAMESINK_MAX_SLOTS) slots = FRAMESINK_MAX_SLOTS;
+
+  FrameSink *s = &g_sink;
+  memset(s, 0, sizeof(*s));
+  s->name = str_dupe(name);
+  s->queue = lfqueue_create(FRAMESINK_QUEUE, sizeof(FrameSinkItem));
+  if (!s->name || !s->queue) {
+    framesink_unmap(s);
+    return 0;
+  }
+
+  /* Pages are only backed once a frame of that size has been written. */
+  size_t slot_size = framesink_slot_size();
+  size_t size = FRAMESINK_PAGE + (size_t)slots * slot_size;
+  shm_unlink(name);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+    fprintf(stderr, "framesink: cannot create %s: %s\n", name,
+            strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(name);
+    }
+    framesink_unmap(s);
+    return 0;
+  }
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "framesink: cannot map %s: %s\n", name, strerror(errno));
+    shm_unlink(name);
+    framesink_unmap(s);
+    return 0;
+  }
+  s->map = (unsigned char *)map;
+  s->map_size = size;
+
+  /* Readers check the magic last. */
+  s->hdr = (FrameSinkHeader *)s->map;
+  s->hdr->version = FRAMESINK_VERSION;
+  s->hdr->header_size = FRAMESINK_PAGE;
+  s->hdr->slot_count = (uint32_t)slots;
+  s->hdr->slot_size = slot_size;
+  s->hdr->max_width = FRAMESINK_MAX_WIDTH;
+  s->hdr->max_height = FRAMESINK_MAX_HEIGHT;
+  atomic_store(&s->hdr->published, 0);
+  atomic_thread_fence(memory_order_release);
+  s->hdr->magic = FRAMESINK_MAGIC;
+
+  if (sem_init(&s->wake, 0, 0) != 0) {
+    framesink_unmap(s);
+    return 0;
+  }
+  if (pthread_create(&s->thread, NULL, framesink_thread, s) != 0) {
+    sem_destroy(&s->wake);
+    framesink_unmap(s);
+    return 0;
+  }
+
+  atomic_store(&g_sink_on, 1);
+  fprintf(stderr, "framesink: exporting frames to %s (%d slots of %.1f MB)\n",
+          name, slots, (double)slot_size / (1024.0 * 1024.0));
+  return 1;
+}
+
+void framesink_shutdown(void) {
+  if (!framesink_enabled()) return;
+  atomic_store(&g_sink_on, 0);
+
+  FrameSink *s = &g_sink;
+  atomic_store(&s->quit, 1);
+  sem_post(&s->wake);
+  pthread_join(s->thread, NULL);
+  framesink_drain(s);
+  sem_destroy(&s->wake);
+
+  fprintf(stderr,
+          "framesink: %llu frames published (%llu converted), %llu dropped, "
+          "%llu failed, %.2f ms per frame\n",
+          (unsigned long long)s->frames, (unsigned long long)s->scaled,
+          (unsigned long long)atomic_load(&s->dropped),
+          (unsigned long long)s->failed,
+          s->frames ? s->write_ms / (double)s->frames : 0.0);
+
+  scaler_free(&s->scaler);
+  framesink_unmap(s);
+}
+
+int framesink_enabled(void) {
+  return atomic_load_explicit(&g_sink_on, memory_order_relaxed);
+}
+
+int framesink_submit(const AVFrame *f, int64_t pts_ms) {
+  if (!framesink_enabled() || !f || f->width <= 0 || f->height <= 0)
+    return 0;
+
+  FrameSink *s = &g_sink;
+  FrameSinkItem it = {av_frame_clone(f), pts_ms};
+  if (!it.frame || !lfqueue_push(s->queue, &it)) {
+    av_frame_free(&it.frame);
+    atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+    return 0;
+  }
+  atomic_fetch_add_explicit(&s->submitted, 1, memory_order_relaxed);
+  sem_post(&s->wake);
+  return 1;
+}
+
+void framesink_flush(void) {
+  if (!framesink_enabled()) return;
+  FrameSink *s = &g_sink;
+  while (atomic_load_explicit(&s->finished, memory_order_acquire) <
+         atomic_load_explicit(&s->submitted, memory_order_relaxed)) {
+    sched_yield();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,531 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "gopcache.h"
+#include "trace.h"
+#include "video.h"
+
+/* Every frame with start <= pts < end is in `frames`, sorted by pts.
+ * INT64_MIN / INT64_MAX mark the two ends of the stream. */
+typedef struct {
+  int64_t start, end;
+  AVFrame **frames;
+  int count, cap;
+  size_t bytes;
+  /* Frames of the GOP were left out to stay within the span limit. */
+  int trimmed;
+} GopSpan;
+
+struct GopCache {
+  char *path;
+  int stream_index;
+  int lowres;
+  size_t budget;
+
+  pthread_t thread;
+  int thread_started;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  atomic_int quit;
+
+  int has_request;
+  int64_t request;
+  /* Direction of the step that asked, which decides what part of a GOP
+   * too large for the budget is kept. */
+  int request_dir;
+  /* The worker could not start; nothing will ever be decoded. */
+  int failed;
+  /* The last request could not be decoded (AV_NOPTS_VALUE if none). It is
+   * reported once and then tried again when asked for. */
+  int64_t failed_request;
+  /* Largest complete GOP decoded so far. */
+  size_t gop_bytes;
+
+  int64_t playhead;
+  GopSpan *spans;
+  int nspans, cap_spans;
+
+  int64_t last_miss_pts;
+  int last_miss_dir;
+  GopCacheStats stats;
+};
+
+static size_t gop_frame_bytes(const AVFrame *f) {
+  size_t n = 0;
+  for (int i = 0; i < AV_NUM_DATA_POINTERS && f->buf[i]; ++i) {
+    n += f->buf[i]->size;
+  }
+  return n;
+}
+
+static void gop_span_free(GopSpan *s) {
+  for (int i = 0; i < s->count; ++i) av_frame_free(&s->frames[i]);
+  free(s->frames);
+  memset(s, 0, sizeof(*s));
+}
+
+/* Inserts keeping pts order; decoders output in presentation order, so
+ * this is an append in practice. Takes ownership of `f`. */
+static int gop_span_add(GopSpan *s, AVFrame *f) {
+  if (s->count == s->cap) {
+    int cap = s->cap ? s->cap * 2 : 64;
+    AVFrame **frames =
+        (AVFrame **)realloc(s->frames, (size_t)cap * sizeof(AVFrame *));
+    if (!frames) {
+      av_frame_free(&f);
+      return 0;
+    }
+    s->frames = frames;
+    s->cap = cap;
+  }
+
+  int i = s->count;
+  while (i > 0 && s->frames[i - 1]->pts > f->pts) {
+    s->frames[i] = s->frames[i - 1];
+    i--;
+  }
+  s->frames[i] = f;
+  s->count++;
+  s->bytes += gop_frame_bytes(f);
+  return 1;
+}
+
+static void gop_span_drop_first(GopSpan *s) {
+  s->trimmed = 1;
+  s->bytes -= gop_frame_bytes(s->frames[0]);
+  av_frame_free(&s->frames[0]);
+  memmove(s->frames, s->frames + 1,
+          (size_t)(s->count - 1) * sizeof(*s->frames));
+  s->count--;
+  s->start = s->frames[0]->pts;
+}
+
+static GopSpan *gopcache_span_at(GopCache *c, int64_t pts) {
+  for (int i = 0; i < c->nspans; ++i) {
+    if (c->spans[i].start <= pts && pts < c->spans[i].end) return &c->spans[i];
+  }
+  return NULL;
+}
+
+static void gopcache_remove_span(GopCache *c, int i) {
+  c->stats.bytes -= c->spans[i].bytes;
+  gop_span_free(&c->spans[i]);
+  c->spans[i] = c->spans[c->nspans - 1];
+  c->nspans--;
+}
+
+static int64_t gopcache_distance(const GopSpan *s, int64_t pts) {
+  if (pts < s->start) return s->start - pts;
+  if (pts >= s->end) return pts - s->end;
+  return 0;
+}
+
+/* Takes ownership of the frames in `s`. Called by the worker. */
+static void gopcache_insert(GopCache *c, GopSpan *s) {
+  pthread_mutex_lock(&c->lock);
+
+  /* Spans inside the new one are stale partial decodes of the same GOP. */
+  for (int i = 0; i < c->nspans;) {
+    if (c->spans[i].start >= s->start && c->spans[i].end <= s->end) {
+      gopcache_remove_span(c, i);
+    } else {
+      ++i;
+    }
+  }
+
+  if (c->nspans == c->cap_spans) {
+    int cap = c->cap_spans ? c->cap_spans * 2 : 16;
+    GopSpan *spans =
+        (GopSpan *)realloc(c->spans, (size_t)cap * sizeof(GopSpan));
+    if (!spans) {
+      pthread_mutex_unlock(&c->lock);
+      gop_span_free(s);
+      return;
+    }
+    c->spans = spans;
+    c->cap_spans = cap;
+  }
+
+  if (s->bytes > c->gop_bytes && s->end != INT64_MAX && !s->trimmed)
+    c->gop_bytes = s->bytes;
+  c->spans[c->nspans++] = *s;
+  c->stats.bytes += s->bytes;
+  c->stats.gops_decoded++;
+  c->stats.frames_decoded += (uint64_t)s->count;
+  if (c->stats.bytes > c->stats.peak_bytes)
+    c->stats.peak_bytes = c->stats.bytes;
+  int64_t fresh_start = s->start;
+  memset(s, 0, sizeof(*s));
+
+  while (c->stats.bytes > c->budget) {
+    int victim = -1;
+    int64_t far = 0;
+    for (int i = 0; i < c->nspans; ++i) {
+      int64_t d = gopcache_distance(&c->spans[i], c->playhead);
+      if (d == 0 || c->spans[i].start == fresh_start) continue;
+      if (victim < 0 || d > far) {
+        victim = i;
+        far = d;
+      }
+    }
+    if (victim < 0) break;
+    gopcache_remove_span(c, victim);
+  }
+
+  pthread_mutex_unlock(&c->lock);
+}
+
+static void gopcache_fail(GopCache *c, int64_t target) {
+  pthread_mutex_lock(&c->lock);
+  c->failed_request = target;
+  pthread_mutex_unlock(&c->lock);
+}
+
+/* How much of one GOP a span may hold: half the budget, so the GOP being
+ * stepped through and the next one fit together, or a whole GOP of the
+ * length seen so far when that still leaves a quarter of the budget. */
+static size_t gopcache_span_limit(GopCache *c) {
+  pthread_mutex_lock(&c->lock);
+  size_t gop = c->gop_bytes;
+  pthread_mutex_unlock(&c->lock);
+
+  size_t limit = c->budget / 2;
+  if (gop > limit && gop <= c->budget - c->budget / 4) limit = gop;
+  return limit;
+}
+
+/* Seeks to the keyframe at or before `target` and decodes until the GOP
+ * holding `target` is complete. Every GOP finished on the way is cached. */
+static void gopcache_decode(GopCache *c, AVFormatContext *fmt,
+                            AVCodecContext *dec, AVPacket *pkt,
+                            AVFrame *frame, int64_t target, int dir) {
+  int64_t seek_to = target == INT64_MIN ? 0 : target;
+  int ret = av_seek_frame(fmt, c->stream_index, seek_to, AVSEEK_FLAG_BACKWARD);
+  if (ret < 0) {
+    fprintf(stderr, "gopcache: seek failed\n");
+    gopcache_fail(c, target);
+    return;
+  }
+  avcodec_flush_buffers(dec);
+
+  GopSpan cur;
+  memset(&cur, 0, sizeof(cur));
+  int started = 0;
+  int done = 0;
+  size_t span_budget = gopcache_span_limit(c);
+
+  while (!done && !atomic_load(&c->quit)) {
+    int eof = 0;
+    ret = av_read_frame(fmt, pkt);
+    if (ret < 0) {
+      eof = 1;
+      avcodec_send_packet(dec, NULL);
+    } else if (pkt->stream_index != c->stream_index) {
+      av_packet_unref(pkt);
+      continue;
+    } else {
+      avcodec_send_packet(dec, pkt);
+      av_packet_unref(pkt);
+    }
+
+    while (!done && avcodec_receive_frame(dec, frame) >= 0) {
+      int64_t pts = frame->best_effort_timestamp;
+      if (pts == AV_NOPTS_VALUE) {
+        av_frame_unref(frame);
+        continue;
+      }
+
+      if (frame->key_frame) {
+        if (started) {
+          cur.end = pts;
+          if (cur.count > 0) gopcache_insert(c, &cur);
+          gop_span_free(&cur);
+          if (pts > target) {
+            done = 1;
+            av_frame_unref(frame);
+            break;
+          }
+        }
+        /* No keyframe at or before the target: it precedes the first one,
+         * so this GOP reaches back to the start of the stream. */
+        cur.start = (!started && pts > target) ? INT64_MIN : pts;
+        started = 1;
+      }
+      if (!started) {
+        av_frame_unref(frame);
+        continue;
+      }
+
+      /* Stepping back through a GOP too large for one span, the frames
+       * up to the target are the ones wanted next; stop right after it. */
+      if (dir < 0 && cur.trimmed && pts > target) {
+        cur.end = pts;
+        gopcache_insert(c, &cur);
+        done = 1;
+        av_frame_unref(frame);
+        break;
+      }
+
+      AVFrame *f = av_frame_alloc();
+      if (!f) {
+        av_frame_unref(frame);
+        continue;
+      }
+      av_frame_move_ref(f, frame);
+      f->pts = pts;
+      if (!gop_span_add(&cur, f)) continue;
+
+      if (dir < 0) {
+        /* Keep the latest frames before the target. */
+        while (cur.bytes > span_budget && cur.count > 1) {
+          gop_span_drop_first(&cur);
+        }
+        continue;
+      }
+
+      /* Otherwise keep what is needed from the target on, and end early
+       * once the span is full. */
+      while (cur.bytes > span_budget && cur.count > 1 &&
+             cur.frames[1]->pts <= target) {
+        gop_span_drop_first(&cur);
+      }
+      if (cur.bytes > span_budget && pts >= target) {
+        cur.end = pts + 1;
+        gopcache_insert(c, &cur);
+        done = 1;
+      }
+    }
+
+    if (eof && !done) {
+      if (started && cur.count > 0) {
+        cur.end = INT64_MAX;
+        gopcache_insert(c, &cur);
+      } else {
+        gopcache_fail(c, target);
+      }
+      done = 1;
+    }
+  }
+
+  gop_span_free(&cur);
+}
+
+static int gopcache_interrupt(void *opaque) {
+  GopCache *c = (GopCache *)opaque;
+  return atomic_load_explicit(&c->quit, memory_order_relaxed);
+}
+
+static void *gopcache_thread(void *arg) {
+  GopCache *c = (GopCache *)arg;
+  trace_set_thread_name("gopcache");
+
+  VideoInput in;
+  memset(&in, 0, sizeof(in));
+  /* Reverse playback has to decode GOPs faster than real time. */
+  AVCodecContext *dec = video_open_worker_decoder(
+      &in, c->path, c->stream_index, c->lowres, 0, gopcache_interrupt, c);
+  AVPacket *pkt = av_packet_alloc();
+  AVFrame *frame = av_frame_alloc();
+
+  if (!dec || !pkt || !frame) {
+    fprintf(stderr, "gopcache: cannot open decoder for '%s'\n", c->path);
+    pthread_mutex_lock(&c->lock);
+    c->failed = 1;
+    pthread_mutex_unlock(&c->lock);
+  } else {
+    for (;;) {
+      pthread_mutex_lock(&c->lock);
+      while (!atomic_load(&c->quit) && !c->has_request) {
+        pthread_cond_wait(&c->wake, &c->lock);
+      }
+      if (atomic_load(&c->quit)) {
+        pthread_mutex_unlock(&c->lock);
+        break;
+      }
+      int64_t target = c->request;
+      int dir = c->request_dir;
+      c->has_request = 0;
+      int cached = gopcache_span_at(c, target) != NULL;
+      pthread_mutex_unlock(&c->lock);
+
+      if (cached) continue;
+      trace_begin("gop_decode");
+      gopcache_decode(c, in.fmt, dec, pkt, frame, target, dir);
+      trace_end();
+    }
+  }
+
+  av_frame_free(&frame);
+  av_packet_free(&pkt);
+  avcodec_free_context(&dec);
+  video_input_close(&in);
+  return NULL;
+}
+
+GopCache *gopcache_open(const char *path, int stream_index, int lowres,
+                        size_t budget_bytes) {
+  GopCache *c = (GopCache *)calloc(1, sizeof(GopCache));
+  if (!c) return NULL;
+
+  c->path = str_dupe(path);
+  c->stream_index = stream_index;
+  c->lowres = lowres;
+  c->budget = budget_bytes;
+  c->last_miss_pts = AV_NOPTS_VALUE;
+  c->failed_request = AV_NOPTS_VALUE;
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->wake, NULL);
+
+  if (!c->path || pthread_create(&c->thread, NULL, gopcache_thread, c) != 0) {
+    fprintf(stderr, "gopcache: cannot start worker\n");
+    gopcache_close(c);
+    return NULL;
+  }
+  c->thread_started = 1;
+  return c;
+}
+
+void gopcache_get_stats(GopCache *c, GopCacheStats *out) {
+  pthread_mutex_lock(&c->lock);
+  *out = c->stats;
+  out->spans = c->nspans;
+  pthread_mutex_unlock(&c->lock);
+}
+
+void gopcache_close(GopCache *c) {
+  if (!c) return;
+
+  if (c->thread_started) {
+    pthread_mutex_lock(&c->lock);
+    atomic_store(&c->quit, 1);
+    pthread_cond_signal(&c->wake);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    GopCacheStats st;
+    gopcache_get_stats(c, &st);
+    uint64_t lookups = st.hits + st.misses;
+    fprintf(stderr,
+            "gopcache: %llu hits, %llu misses (%.1f%% hit), %llu GOPs / %llu "
+            "frames decoded, %.1f MiB peak of %.1f MiB\n",
+            (unsigned long long)st.hits, (unsigned long long)st.misses,
+            lookups ? 100.0 * (double)st.hits / (double)lookups : 0.0,
+            (unsigned long long)st.gops_decoded,
+            (unsigned long long)st.frames_decoded,
+            (double)st.peak_bytes / (1024.0 * 1024.0),
+            (double)c->budget / (1024.0 * 1024.0));
+  }
+
+  for (int i = 0; i < c->nspans; ++i) gop_span_free(&c->spans[i]);
+  free(c->spans);
+  pthread_cond_destroy(&c->wake);
+  pthread_mutex_destroy(&c->lock);
+  free(c->path);
+  free(c);
+}
+
+/* Nearest frame in `s` strictly after (dir > 0) or before (dir < 0) `pts`,
+ * or the one shown at `pts` (dir == 0). */
+static AVFrame *gop_span_pick(const GopSpan *s, int64_t pts, int dir) {
+  if (dir > 0) {
+    for (int i = 0; i < s->count; ++i) {
+      if (s->frames[i]->pts > pts) return s->frames[i];
+    }
+    return NULL;
+  }
+  for (int i = s->count - 1; i >= 0; --i) {
+    if (dir < 0 ? s->frames[i]->pts < pts : s->frames[i]->pts <= pts)
+      return s->frames[i];
+  }
+  /* Before the first frame of the stream, show the first frame. */
+  if (dir == 0 && s->start == INT64_MIN && s->count > 0) return s->frames[0];
+  return NULL;
+}
+
+static void gopcache_request(GopCache *c, int64_t target, int dir) {
+  c->request = target;
+  c->request_dir = dir;
+  c->has_request = 1;
+  pthread_cond_signal(&c->wake);
+}
+
+int gopcache_find(GopCache *c, int64_t pts, int dir, AVFrame *out) {
+  if (!c) return GOPCACHE_END;
+
+  pthread_mutex_lock(&c->lock);
+  if (c->failed) {
+    pthread_mutex_unlock(&c->lock);
+    return GOPCACHE_END;
+  }
+
+  GopSpan *s = gopcache_span_at(c, pts);
+  AVFrame *hit = s ? gop_span_pick(s, pts, dir) : NULL;
+  int64_t need = pts;
+  int at_end = 0;
+
+  /* Spans are complete over their range, so the neighbour of a frame at
+   * the edge of one is the nearest frame in the span across the edge. */
+  for (int hops = 0; s && !hit && dir != 0 && hops <= c->nspans; ++hops) {
+    int64_t edge = dir > 0 ? s->end : s->start;
+    if (edge == INT64_MAX || edge == INT64_MIN) {
+      at_end = 1;
+      break;
+    }
+    need = dir > 0 ? edge : edge - 1;
+    s = gopcache_span_at(c, need);
+    if (s) hit = gop_span_pick(s, pts, dir);
+  }
+  if (s && !hit && dir == 0) at_end = 1;
+
+  int ret;
+  if (hit) {
+    av_frame_ref(out, hit);
+    c->playhead = hit->pts;
+    /* A retry that now succeeds was already counted as a miss. */
+    if (c->last_miss_pts == pts && c->last_miss_dir == dir) {
+      c->last_miss_pts = AV_NOPTS_VALUE;
+    } else {
+      c->stats.hits++;
+    }
+
+    /* Have the neighbouring GOP ready by the time this one is used up. */
+    if (dir != 0 && !c->has_request) {
+      int64_t edge = dir > 0 ? s->end : s->start;
+      int64_t next = dir > 0 ? edge : edge - 1;
+      if (edge != INT64_MAX && edge != INT64_MIN &&
+          !gopcache_span_at(c, next)) {
+        gopcache_request(c, next, dir);
+      }
+    }
+    ret = GOPCACHE_HIT;
+  } else if (at_end) {
+    ret = GOPCACHE_END;
+  } else if (need == c->failed_request) {
+    /* Give up on this step; asking again starts a new attempt. */
+    c->failed_request = AV_NOPTS_VALUE;
+    c->last_miss_pts = AV_NOPTS_VALUE;
+    ret = GOPCACHE_END;
+  } else {
+    /* The caller retries every frame while the GOP decodes; count the
+     * miss once. */
+    if (c->last_miss_pts != pts || c->last_miss_dir != dir) {
+      c->stats.misses++;
+      c->last_miss_pts = pts;
+      c->last_miss_dir = dir;
+    }
+    c->playhead = pts;
+    if (!c->has_request || c->request != need) gopcache_request(c, need, dir);
+    ret = GOPCACHE_PENDING;
+  }
+
+  pthread_mutex_unlock(&c->lock);
+  return ret;
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lfqueue.h"
+
+/* Head and tail on their own cache lines, so producers and consumers do
+ * not contend on the same line. */
+#define LFQUEUE_LINE 64
+/* Items follow the sequence number, aligned for any scalar. */
+#define LFQUEUE_ITEM_OFFSET 16
+
+typedef struct {
+  atomic_size_t seq;
+} LfSlot;
+
+struct LfQueue {
+  _Alignas(LFQUEUE_LINE) atomic_size_t tail;
+  _Alignas(LFQUEUE_LINE) atomic_size_t head;
+  _Alignas(LFQUEUE_LINE) size_t mask;
+  size_t item_size;
+  size_t stride;
+  unsigned char *slots;
+};
+
+static LfSlot *lfqueue_slot(const LfQueue *q, size_t pos) {
+  return (LfSlot *)(q->slots + (pos & q->mask) * q->stride);
+}
+
+LfQueue *lfqueue_create(int capacity, size_t item_size) {
+  if (capacity < 2 || item_size == 0) return NULL;
+
+  size_t cap = 2;
+  while (cap < (size_t)capacity) cap <<= 1;
+
+  size_t size =
+      (sizeof(LfQueue) + LFQUEUE_LINE - 1) & ~(size_t)(LFQUEUE_LINE - 1);
+  LfQueue *q = (LfQueue *)aligned_alloc(LFQUEUE_LINE, size);
+  if (!q) return NULL;
+  memset(q, 0, sizeof(*q));
+  q->mask = cap - 1;
+  q->item_size = item_size;
+  q->stride = (LFQUEUE_ITEM_OFFSET + item_size + 15) & ~(size_t)15;
+  q->slots = (unsigned char *)calloc(cap, q->stride);
+  if (!q->slots) {
+    free(q);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < cap; ++i) {
+    atomic_init(&lfqueue_slot(q, i)->seq, i);
+  }
+  atomic_init(&q->tail, 0);
+  atomic_init(&q->head, 0);
+  return q;
+}
+
+void lfqueue_destroy(LfQueue *q) {
+  if (!q) return;
+  free(q->slots);
+  free(q);
+}
+
+static void *lfqueue_item(LfSlot *s) {
+  return (unsigned char *)s + LFQUEUE_ITEM_OFFSET;
+}
+
+int lfqueue_push(LfQueue *q, const void *item) {
+  size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  LfSlot *s;
+  for (;;) {
+    s = lfqueue_slot(q, pos);
+    size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      return 0;
+    } else {
+      pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    }
+  }
+
+  memcpy(lfqueue_item(s), item, q->item_size);
+  atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+  return 1;
+}
+
+int lfqueue_pop(LfQueue *q, void *out) {
+  size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+  LfSlot *s;
+  for (;;) {
+    s = lfqueue_slot(q, pos);
+    size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      return 0;
+    } else {
+      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    }
+  }
+
+  memcpy(out, lfqueue_item(s), q->item_size);
+  atomic_store_explicit(&s->seq, pos + q->mask + 1, memory_order_release);
+  return 1;
+}
\ No newline at end of file
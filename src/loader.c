@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "loader.h"
+#include "trace.h"
+
+typedef struct LoadJob {
+  struct LoadJob *next;
+  pthread_t thread;
+  int has_thread;
+  char *path;
+  Uint32 start_ticks;
+
+  atomic_int cancel;
+  atomic_int done;
+  int ok;
+  VideoInput input;
+} LoadJob;
+
+struct Loader {
+  LoadJob *current;
+  LoadJob *retired;
+};
+
+static int loader_interrupt(void *opaque) {
+  LoadJob *job = (LoadJob *)opaque;
+  return atomic_load_explicit(&job->cancel, memory_order_relaxed);
+}
+
+static void *loader_thread(void *arg) {
+  LoadJob *job = (LoadJob *)arg;
+  trace_set_thread_name("loader");
+
+  trace_begin("open_input");
+  job->ok = video_input_open(&job->input, job->path, 0, loader_interrupt, job);
+  trace_end();
+
+  if (job->ok && atomic_load(&job->cancel)) {
+    video_input_close(&job->input);
+    job->ok = 0;
+  }
+  atomic_store_explicit(&job->done, 1, memory_order_release);
+  return NULL;
+}
+
+static void loader_free_job(LoadJob *job) {
+  if (job->has_thread) pthread_join(job->thread, NULL);
+  video_input_close(&job->input);
+  free(job->path);
+  free(job);
+}
+
+static void loader_retire(Loader *l) {
+  LoadJob *job = l->current;
+  if (!job) return;
+  l->current = NULL;
+
+  atomic_store(&job->cancel, 1);
+  job->next = l->retired;
+  l->retired = job;
+}
+
+static void loader_reap(Loader *l) {
+  LoadJob **pp = &l->retired;
+  while (*pp) {
+    LoadJob *job = *pp;
+    if (atomic_load_explicit(&job->done, memory_order_acquire)) {
+      *pp = job->next;
+      loader_free_job(job);
+    } else {
+      pp = &job->next;
+    }
+  }
+}
+
+Loader *loader_create(void) {
+  return (Loader *)calloc(1, sizeof(Loader));
+}
+
+void loader_destroy(Loader *l) {
+  if (!l) return;
+  loader_retire(l);
+  while (l->retired) {
+    LoadJob *job = l->retired;
+    l->retired = job->next;
+    loader_free_job(job);
+  }
+  free(l);
+}
+
+void loader_start(Loader *l, const char *path) {
+  loader_retire(l);
+  loader_reap(l);
+
+  LoadJob *job = (LoadJob *)calloc(1, sizeof(LoadJob));
+  if (!job) return;
+  job->path = str_dupe(path);
+  job->start_ticks = SDL_GetTicks();
+  if (!job->path) {
+    free(job);
+    return;
+  }
+
+  if (pthread_create(&job->thread, NULL, loader_thread, job) == 0) {
+    job->has_thread = 1;
+  } else {
+    fprintf(stderr, "loader: cannot start thread, opening inline\n");
+    loader_thread(job);
+  }
+  l->current = job;
+}
+
+void loader_cancel(Loader *l) {
+  if (!l) return;
+  loader_retire(l);
+  loader_reap(l);
+}
+
+LoaderState loader_poll(Loader *l) {
+  if (!l) return LOADER_IDLE;
+  loader_reap(l);
+
+  LoadJob *job = l->current;
+  if (!job) return LOADER_IDLE;
+  if (!atomic_load_explicit(&job->done, memory_order_acquire))
+    return LOADER_LOADING;
+  return job->ok ? LOADER_READY : LOADER_FAILED;
+}
+
+int loader_take(Loader *l, VideoInput *out) {
+  if (loader_poll(l) != LOADER_READY) return 0;
+
+  LoadJob *job = l->current;
+  l->current = NULL;
+  *out = job->input;
+  memset(&job->input, 0, sizeof(job->input));
+  loader_free_job(job);
+  return 1;
+}
+
+void loader_reset(Loader *l) {
+  if (loader_poll(l) != LOADER_FAILED) return;
+  LoadJob *job = l->current;
+  l->current = NULL;
+  loader_free_job(job);
+}
+
+const char *loader_path(const Loader *l) {
+  return l && l->current ? l->current->path : NULL;
+}
+
+Uint32 loader_elapsed_ms(const Loader *l) {
+  if (!l || !l->current) return 0;
+  return SDL_GetTicks() - l->current->start_ticks;
+}
\ No newline at end of file
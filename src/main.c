@@ -6,12 +6,41 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "audio.h"
 #include "browser.h"
+#include "config.h"
+#include "control.h"
+#include "framepool.h"
+#include "framesink.h"
+#include "loader.h"
 #include "playlist.h"
+#include "probecache.h"
+#include "trace.h"
 #include "ui.h"
 #include "video.h"
+#include "wall.h"
+#include "workpool.h"
 
-typedef enum { STATE_BROWSE = 0, STATE_PLAY } AppState;
+typedef enum { STATE_BROWSE = 0, STATE_PLAY, STATE_WALL } AppState;
+
+#define TIMING_MAX_MARKS 8
+
+/* Main loop period while the window is hidden and nothing is drawn. */
+#define APP_HIDDEN_POLL_MS 10
+
+/* How often metrics are handed to the control socket. */
+#define APP_METRICS_MS 100
+
+/* Start-up milestones relative to entering main(), printed with --timing
+ * once the first frame has been presented. */
+typedef struct {
+  int enabled;
+  Uint64 start;
+  const char *names[TIMING_MAX_MARKS];
+  double ms[TIMING_MAX_MARKS];
+  int count;
+  int reported;
+} StartupTiming;
 
 typedef struct {
   SDL_Window *win;
@@ -23,31 +52,162 @@ typedef struct {
 
   Playlist pl;
   VideoState vid;
+  AudioOut audio;
+  Loader *loader;
+  /* Several playlist entries at once, with PLAYER_WALL_TILES. */
+  VideoWall wall;
   int paused;
   int fullscreen;
 
+  /* Frame step requested with , or . (-1/+1), and reverse playback (r). Both
+   * run from the GOP cache while normal playback is paused. */
+  int step_pending;
+  int step_dir;
+  int reverse;
+
+  /* The progress bar is being dragged. */
+  int scrubbing;
+
   int muted;
   double volume_before_mute;
 
+  /* The window is hidden or minimised. */
+  int hidden;
+
   UiContext ui;
+  /* Fonts are opened after the first frame of a file given on the command
+   * line, or right away for the browser. Without them files still play,
+   * with no controls drawn. */
+  int fonts_ready;
+  int fonts_failed;
+
+  StartupTiming timing;
+
+  /* PLAYER_CONTROL_SOCKET; NULL when not configured. */
+  ControlServer *control;
+  Uint32 metrics_ticks;
+  uint64_t metrics_shown;
 } App;
 
+static void timing_mark(StartupTiming *t, const char *name) {
+  if (!t->enabled || t->reported || t->count == TIMING_MAX_MARKS) return;
+  t->names[t->count] = name;
+  t->ms[t->count] = (double)(SDL_GetPerformanceCounter() - t->start) *
+                    1000.0 / (double)SDL_GetPerformanceFrequency();
+  t->count++;
+}
+
+static void timing_report(StartupTiming *t) {
+  if (!t->enabled || t->reported) return;
+  t->reported = 1;
+  fprintf(stderr, "timing:");
+  for (int i = 0; i < t->count; ++i) {
+    fprintf(stderr, "%s %s %.1f ms", i ? "," : "", t->names[i], t->ms[i]);
+  }
+  fprintf(stderr, "\n");
+}
+
+static int app_load_fonts(App *app) {
+  if (app->fonts_ready) return 1;
+  if (app->fonts_failed) return 0;
+
+  if (!ui_load_fonts(&app->ui)) {
+    app->fonts_failed = 1;
+    fprintf(stderr, "ui: cannot load %s; playing without controls\n",
+            app->ui.font_path);
+    return 0;
+  }
+  app->fonts_ready = 1;
+  timing_mark(&app->timing, "fonts");
+  return 1;
+}
+
+/* Video is only decoded while it can be seen. */
+static void app_update_background(App *app) {
+  video_set_background(&app->vid,
+                       app->hidden && player_config()->background_audio);
+}
+
+static void app_handle_window_event(App *app, const SDL_WindowEvent *we) {
+  int was_hidden = app->hidden;
+  if (we->event == SDL_WINDOWEVENT_HIDDEN ||
+      we->event == SDL_WINDOWEVENT_MINIMIZED) {
+    app->hidden = 1;
+  } else if (we->event == SDL_WINDOWEVENT_SHOWN ||
+             we->event == SDL_WINDOWEVENT_RESTORED ||
+             we->event == SDL_WINDOWEVENT_MAXIMIZED ||
+             we->event == SDL_WINDOWEVENT_EXPOSED) {
+    app->hidden = 0;
+  } else {
+    return;
+  }
+  /* The wall was not decoded while hidden; start its tiles from now. */
+  if (was_hidden && !app->hidden && app->state == STATE_WALL)
+    wall_restart_clock(&app->wall, SDL_GetTicks());
+  app_update_background(app);
+}
+
+static void player_set_paused(App *app, int paused) {
+  app->paused = paused;
+  audio_out_set_paused(&app->audio, paused);
+}
+
+/* Starts opening the current playlist entry in the background. The previous
+ * file stays on screen, stopped, until the new one is ready, so its decoders
+ * can be reused. */
 static void player_open_current(App *app) {
   const char *path = playlist_current(&app->pl);
   if (!path) return;
 
-  video_close(&app->vid);
-  if (!video_open(&app->vid, app->ren, path)) {
-    fprintf(stderr, "Failed to open video: %s\n", path);
-    return;
-  }
+  audio_out_report(&app->audio);
+  audio_out_clear(&app->audio);
+  app->step_pending = 0;
+  app->reverse = 0;
+  app->scrubbing = 0;
+  loader_start(app->loader, path);
+}
 
-  app->paused = 0;
-  SDL_SetWindowTitle(app->win, path);
+/* Finishes a background open once it is ready. Returns 1 while a file is
+ * still loading. */
+static int player_poll_loader(App *app) {
+  LoaderState st = loader_poll(app->loader);
+  if (st == LOADER_LOADING) return 1;
+
+  if (st == LOADER_FAILED) {
+    fprintf(stderr, "Failed to open video: %s\n", loader_path(app->loader));
+    loader_reset(app->loader);
+    video_close(&app->vid);
+  } else if (st == LOADER_READY) {
+    char title[1024];
+    snprintf(title, sizeof(title), "%s", loader_path(app->loader));
+
+    VideoInput in;
+    loader_take(app->loader, &in);
+    if (!video_open_input(&app->vid, app->ren, &app->audio, &in)) {
+      fprintf(stderr, "Failed to open video: %s\n", title);
+      return 0;
+    }
+
+    app_update_background(app);
+    player_set_paused(app, 0);
+    SDL_SetWindowTitle(app->win, title);
+    timing_mark(&app->timing, "opened");
+  }
+  return 0;
 }
 
-static void app_enter_browse(App *app) {
+/* The browser cannot be used without text; whatever is playing then goes
+ * on. */
+static int app_enter_browse(App *app) {
+  if (!app_load_fonts(app)) {
+    fprintf(stderr, "Cannot open the file browser without fonts\n");
+    return 0;
+  }
+
+  loader_cancel(app->loader);
+  app->scrubbing = 0;
   video_close(&app->vid);
+  wall_close(&app->wall);
   playlist_free(&app->pl);
 
   if (!app->browser) {
@@ -55,20 +215,173 @@ static void app_enter_browse(App *app) {
   }
   app->state = STATE_BROWSE;
   SDL_SetWindowTitle(app->win, "Choose file / folder");
+  return 1;
 }
 
-static void app_enter_play(App *app, const char *path) {
+/* Plays the playlist from its current entry on as a grid, when configured
+ * and there is more than one file. The window may not exist yet; the grid
+ * follows its size once drawn. */
+static int app_enter_wall(App *app) {
+  int n = player_config()->wall_tiles;
+  if (n > app->pl.count) n = app->pl.count;
+  if (n < 2) return 0;
+
+  const char *paths[WALL_MAX_TILES];
+  for (int i = 0; i < n; ++i) {
+    paths[i] = app->pl.files[(app->pl.index + i) % app->pl.count];
+  }
+
+  /* A file may still be playing or loading when the wall is opened from
+   * the control socket; the wall has no sound and draws on its own. */
+  loader_cancel(app->loader);
+  video_close(&app->vid);
+  audio_out_report(&app->audio);
+  audio_out_clear(&app->audio);
+  app->step_pending = 0;
+  app->reverse = 0;
+  app->scrubbing = 0;
+
+  if (!wall_open(&app->wall, paths, n, 1280, 720)) return 0;
+
+  player_set_paused(app, 0);
+  app->state = STATE_WALL;
+  if (app->win) SDL_SetWindowTitle(app->win, "Video wall");
+  return 1;
+}
+
+static int app_enter_play(App *app, const char *path) {
   playlist_free(&app->pl);
   if (!playlist_build(&app->pl, path)) {
-    return;
+    return 0;
   }
+  if (app_enter_wall(app)) return 1;
   player_open_current(app);
   app->state = STATE_PLAY;
+  return 1;
+}
+
+/* Applies the commands received on the control socket since the last
+ * frame, the same way the matching keys and buttons do. */
+static void app_poll_control(App *app) {
+  ControlCommand cmd;
+  while (control_poll(app->control, &cmd)) {
+    int playing = app->state == STATE_PLAY;
+    switch (cmd.action) {
+      case CONTROL_PLAY:
+      case CONTROL_PAUSE:
+      case CONTROL_TOGGLE:
+        if (app->state == STATE_BROWSE) break;
+        app->reverse = 0;
+        player_set_paused(app, cmd.action == CONTROL_TOGGLE
+                                   ? !app->paused
+                                   : cmd.action == CONTROL_PAUSE);
+        break;
+      case CONTROL_SEEK:
+        if (!playing) break;
+        app->step_pending = 0;
+        app->reverse = 0;
+        video_seek_ms(&app->vid, cmd.ms);
+        break;
+      case CONTROL_NEXT:
+        if (playing && playlist_next(&app->pl)) player_open_current(app);
+        break;
+      case CONTROL_PREV:
+        if (playing && playlist_prev(&app->pl)) player_open_current(app);
+        break;
+      case CONTROL_VOLUME:
+        if (!playing) break;
+        video_set_volume(&app->vid, cmd.value);
+        app->muted = (cmd.value <= 0.001);
+        if (!app->muted) app->volume_before_mute = cmd.value;
+        break;
+      case CONTROL_OPEN:
+        wall_close(&app->wall);
+        if (!app_enter_play(app, cmd.path)) {
+          fprintf(stderr, "control: cannot play %s\n", cmd.path);
+          app_enter_browse(app);
+        }
+        break;
+    }
+  }
+}
+
+static void app_publish_metrics(App *app) {
+  Uint32 now = SDL_GetTicks();
+  Uint32 elapsed = now - app->metrics_ticks;
+  if (!app->control || elapsed < APP_METRICS_MS) return;
+
+  ControlMetrics m;
+  memset(&m, 0, sizeof(m));
+  m.paused = app->paused;
+
+  if (app->state == STATE_WALL) {
+    m.state = "wall";
+    for (int i = 0; i < app->wall.count; ++i) {
+      m.frames_shown += app->wall.tiles[i].shown;
+      m.frames_dropped += app->wall.tiles[i].dropped;
+    }
+  } else if (app->state == STATE_PLAY) {
+    VideoStats vs;
+    video_get_stats(&app->vid, &vs);
+    m.state = loader_poll(app->loader) == LOADER_LOADING ? "loading" : "play";
+    m.position_ms = video_get_position_ms(&app->vid);
+    m.duration_ms = video_get_duration_ms(&app->vid);
+    m.volume = video_get_volume(&app->vid);
+    m.frames_shown = vs.shown;
+    m.frames_dropped = vs.dropped;
+    m.frames_late = vs.late;
+    m.has_drift = vs.has_drift;
+    m.av_drift_ms = vs.drift_ms;
+    m.quality_level = vs.quality_level;
+    m.first_frame_ms = vs.first_frame_ms;
+  } else {
+    m.state = "browse";
+  }
+
+  /* The counters start over with every file. */
+  if (m.frames_shown >= app->metrics_shown && app->metrics_ticks) {
+    m.fps = (double)(m.frames_shown - app->metrics_shown) * 1000.0 /
+            (double)elapsed;
+  }
+  app->metrics_shown = m.frames_shown;
+  app->metrics_ticks = now;
+
+  AudioOutStats as;
+  audio_out_get_stats(&app->audio, &as);
+  m.audio_queue_ms = as.queue_ms;
+  m.audio_device_ms = as.device_ms;
+  m.audio_underruns = as.underruns;
+
+  control_publish(app->control, &m);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--timing] [file | directory | playlist.m3u]\n"
+          "  Without a path the file browser opens.\n"
+          "  --timing  print start-up milestones up to the first frame\n",
+          argv0);
 }
 
 int main(int argc, char **argv) {
-  (void)argc;
-  (void)argv;
+  App app;
+  memset(&app, 0, sizeof(app));
+  app.timing.start = SDL_GetPerformanceCounter();
+
+  const char *start_path = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--timing") == 0) {
+      app.timing.enabled = 1;
+    } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      usage(argv[0]);
+      return 0;
+    } else if (argv[i][0] == '-' || start_path) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      start_path = argv[i];
+    }
+  }
 
 #if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
   av_register_all();
@@ -86,31 +399,59 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  App app;
-  memset(&app, 0, sizeof(app));
+  config_load_env();
+  trace_init(player_config()->trace_path);
+  if (player_config()->frame_export) {
+    framesink_init(player_config()->frame_export,
+                   player_config()->frame_export_slots);
+  }
+  timing_mark(&app.timing, "init");
+
+  app.loader = loader_create();
+  if (!app.loader) {
+    fprintf(stderr, "loader_create failed\n");
+    TTF_Quit();
+    SDL_Quit();
+    return 1;
+  }
+
+  /* The file starts opening now, while the window, renderer and audio
+   * device are set up. */
+  if (start_path && !app_enter_play(&app, start_path)) {
+    fprintf(stderr, "Cannot play %s\n", start_path);
+    loader_destroy(app.loader);
+    TTF_Quit();
+    SDL_Quit();
+    return 1;
+  }
 
   app.win = SDL_CreateWindow("Dummy Player", SDL_WINDOWPOS_CENTERED,
                              SDL_WINDOWPOS_CENTERED, 1280, 720,
                              SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
   if (!app.win) {
     fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
+    loader_destroy(app.loader);
     TTF_Quit();
     SDL_Quit();
     return 1;
   }
+  timing_mark(&app.timing, "window");
 
   app.ren = SDL_CreateRenderer(
       app.win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
   if (!app.ren) {
     fprintf(stderr, "SDL_CreateRenderer failed: %s\n", SDL_GetError());
+    loader_destroy(app.loader);
     SDL_DestroyWindow(app.win);
     TTF_Quit();
     SDL_Quit();
     return 1;
   }
+  timing_mark(&app.timing, "renderer");
 
   if (!ui_init(&app.ui, app.ren, "fonts/DejaVuSans.ttf")) {
     fprintf(stderr, "ui_init failed\n");
+    loader_destroy(app.loader);
     SDL_DestroyRenderer(app.ren);
     SDL_DestroyWindow(app.win);
     TTF_Quit();
@@ -118,13 +459,35 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  app.state = STATE_BROWSE;
-  app_enter_browse(&app);
+  /* Opened once for the session; if it fails, files play without sound. */
+  const PlayerConfig *cfg = player_config();
+  audio_out_open(&app.audio, cfg->audio_samples, cfg->audio_low_ms,
+                 cfg->audio_high_ms, cfg->audio_adaptive);
+  timing_mark(&app.timing, "audio");
+
+  if (!start_path && !app_enter_browse(&app)) {
+    ui_shutdown(&app.ui);
+    loader_destroy(app.loader);
+    audio_out_close(&app.audio);
+    SDL_DestroyRenderer(app.ren);
+    SDL_DestroyWindow(app.win);
+    TTF_Quit();
+    SDL_Quit();
+    return 1;
+  }
+
+  if (cfg->control_socket) app.control = control_open(cfg->control_socket);
 
   int running = 1;
   while (running) {
+    trace_begin("frame");
+
+    trace_begin("events");
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
+      ui_handle_event(&app.ui, &e);
+      if (e.type == SDL_WINDOWEVENT) app_handle_window_event(&app, &e.window);
+
       if (app.state == STATE_BROWSE) {
         BrowserResult r = browser_handle_event(app.browser, &e);
         if (r == BROWSER_RESULT_QUIT) {
@@ -138,6 +501,25 @@ int main(int argc, char **argv) {
         }
       }
 
+      else if (app.state == STATE_WALL) {
+        if (e.type == SDL_QUIT) {
+          running = 0;
+        } else if (e.type == SDL_KEYDOWN) {
+          SDL_Keycode k = e.key.keysym.sym;
+          if (k == SDLK_ESCAPE) {
+            running = 0;
+          } else if (k == SDLK_SPACE) {
+            player_set_paused(&app, !app.paused);
+          } else if (k == SDLK_f) {
+            app.fullscreen = !app.fullscreen;
+            SDL_SetWindowFullscreen(
+                app.win, app.fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
+          } else if (k == SDLK_o) {
+            app_enter_browse(&app);
+          }
+        }
+      }
+
       else if (app.state == STATE_PLAY) {
         if (e.type == SDL_QUIT) {
           running = 0;
@@ -147,7 +529,31 @@ int main(int argc, char **argv) {
           if (k == SDLK_ESCAPE) {
             running = 0;
           } else if (k == SDLK_SPACE) {
-            app.paused = !app.paused;
+            app.reverse = 0;
+            player_set_paused(&app, !app.paused);
+          } else if (k == SDLK_l || k == SDLK_j) {
+            /* Each press doubles the rate in that direction; the other
+             * direction starts over at 2x. */
+            int rate = video_get_rate(&app.vid);
+            int dir = k == SDLK_l ? 1 : -1;
+            rate = rate * dir >= 2 ? rate * 2 : dir * 2;
+            app.reverse = 0;
+            app.step_pending = 0;
+            video_set_rate(&app.vid, rate);
+            player_set_paused(&app, 0);
+          } else if (k == SDLK_k) {
+            video_set_rate(&app.vid, 1);
+          } else if (k == SDLK_PERIOD || k == SDLK_COMMA) {
+            video_set_rate(&app.vid, 1);
+            player_set_paused(&app, 1);
+            app.reverse = 0;
+            app.step_pending = 1;
+            app.step_dir = k == SDLK_PERIOD ? 1 : -1;
+          } else if (k == SDLK_r) {
+            video_set_rate(&app.vid, 1);
+            app.reverse = !app.reverse;
+            app.step_pending = 0;
+            if (app.reverse) player_set_paused(&app, 1);
           } else if (k == SDLK_f) {
             app.fullscreen = !app.fullscreen;
             SDL_SetWindowFullscreen(
@@ -174,6 +580,8 @@ int main(int argc, char **argv) {
             if (playlist_prev(&app.pl)) player_open_current(&app);
           } else if (k == SDLK_o) {
             app_enter_browse(&app);
+          } else if (k == SDLK_t) {
+            if (trace_enabled()) trace_dump(trace_output_path());
           }
         } else if (e.type == SDL_MOUSEBUTTONDOWN &&
                    e.button.button == SDL_BUTTON_LEFT) {
@@ -186,7 +594,7 @@ int main(int argc, char **argv) {
           double r;
 
           if (ui_hit_test_rect(&lay.btn_play, mx, my)) {
-            app.paused = !app.paused;
+            player_set_paused(&app, !app.paused);
           } else if (ui_hit_test_rect(&lay.btn_prev, mx, my)) {
             if (playlist_prev(&app.pl)) player_open_current(&app);
           } else if (ui_hit_test_rect(&lay.btn_next, mx, my)) {
@@ -209,24 +617,92 @@ int main(int argc, char **argv) {
           } else if (ui_progress_hit_test(&lay, mx, my, &r)) {
             int64_t dur = video_get_duration_ms(&app.vid);
             if (dur > 0) {
-              int64_t target = (int64_t)(dur * r);
-              video_seek_ms(&app.vid, target);
+              app.scrubbing = 1;
+              app.reverse = 0;
+              app.step_pending = 0;
+              video_scrub(&app.vid, (int64_t)(dur * r));
             }
           }
+        } else if (e.type == SDL_MOUSEMOTION && app.scrubbing) {
+          UiPlayerLayout lay;
+          ui_compute_player_layout(&app.ui, &lay);
+          double r = ui_progress_ratio(&lay, e.motion.x);
+          video_scrub(&app.vid,
+                      (int64_t)(video_get_duration_ms(&app.vid) * r));
+        } else if (e.type == SDL_MOUSEBUTTONUP &&
+                   e.button.button == SDL_BUTTON_LEFT && app.scrubbing) {
+          UiPlayerLayout lay;
+          ui_compute_player_layout(&app.ui, &lay);
+          double r = ui_progress_ratio(&lay, e.button.x);
+          app.scrubbing = 0;
+          video_scrub_end(&app.vid,
+                          (int64_t)(video_get_duration_ms(&app.vid) * r));
+          /* Playback would land on the exact frame by itself; a paused
+           * player shows it through the frame-step cache. */
+          if (app.paused) {
+            app.step_pending = 1;
+            app.step_dir = 0;
+          }
         }
       }
     }
 
+    trace_end();
+
+    if (app.control) app_poll_control(&app);
+
     if (app.state == STATE_BROWSE) {
-      ui_draw_browser(&app.ui, app.browser);
+      if (app.hidden) {
+        SDL_Delay(APP_HIDDEN_POLL_MS);
+      } else {
+        ui_draw_browser(&app.ui, app.browser);
+      }
+    } else if (app.state == STATE_WALL) {
+      int ww, wh;
+      SDL_GetRendererOutputSize(app.ren, &ww, &wh);
+      wall_set_size(&app.wall, ww, wh);
+      if (!app.paused && !app.hidden) wall_decode(&app.wall, SDL_GetTicks());
+
+      if (app.hidden) {
+        SDL_Delay(APP_HIDDEN_POLL_MS);
+      } else {
+        wall_upload(&app.wall, app.ren);
+        SDL_Color bg = app.ui.pal->bg;
+        SDL_SetRenderDrawColor(app.ren, bg.r, bg.g, bg.b, bg.a);
+        SDL_RenderClear(app.ren);
+        wall_draw(&app.wall, app.ren);
+
+        trace_begin("present");
+        SDL_RenderPresent(app.ren);
+        trace_end();
+      }
     } else if (app.state == STATE_PLAY) {
-      if (!app.paused) {
+      int loading = player_poll_loader(&app);
+      if (loading) {
+        /* Nothing to step until the new file is open. */
+      } else if (app.scrubbing) {
+        video_scrub_update(&app.vid, app.ren);
+      } else if (app.step_pending) {
+        /* 0 means the GOP is still being decoded; retry next frame. */
+        if (video_step_frame(&app.vid, app.ren, app.step_dir) != 0)
+          app.step_pending = 0;
+      } else if (app.reverse) {
+        if (video_step_reverse(&app.vid, app.ren) < 0) app.reverse = 0;
+      } else if (!app.paused) {
         video_step(&app.vid, app.ren);
         if (video_is_eof(&app.vid)) {
           if (playlist_next(&app.pl)) player_open_current(&app);
         }
       }
 
+      /* Nothing to draw; wake up often enough to keep audio queued. */
+      if (app.hidden) {
+        app_publish_metrics(&app);
+        SDL_Delay(APP_HIDDEN_POLL_MS);
+        trace_end();
+        continue;
+      }
+
       const UiPalette *p = app.ui.pal;
       SDL_Color bg = p->bg;
       SDL_SetRenderDrawColor(app.ren, bg.r, bg.g, bg.b, bg.a);
@@ -234,18 +710,51 @@ int main(int argc, char **argv) {
 
       ui_draw_video(&app.ui, &app.vid);
 
-      UiPlayerLayout lay;
-      ui_compute_player_layout(&app.ui, &lay);
-      ui_draw_player_controls(&app.ui, &lay, &app.vid, app.paused, app.muted);
+      if (app.fonts_ready) {
+        UiPlayerLayout lay;
+        ui_compute_player_layout(&app.ui, &lay);
+        ui_draw_player_controls(&app.ui, &lay, &app.vid, app.paused,
+                                app.muted);
+        if (loading) {
+          ui_draw_loading(&app.ui, loader_path(app.loader),
+                          loader_elapsed_ms(app.loader));
+        }
+      }
 
+      trace_begin("present");
       SDL_RenderPresent(app.ren);
+      trace_end();
+
+      /* The controls only appear after the first frame has been presented,
+       * or once a load takes long enough to deserve an overlay. */
+      int has_frame = video_has_frame(&app.vid);
+      if (has_frame && !app.timing.reported) {
+        timing_mark(&app.timing, "first frame");
+        timing_report(&app.timing);
+      }
+      if (has_frame || !loading || loader_elapsed_ms(app.loader) >= 250) {
+        app_load_fonts(&app);
+      }
     }
+
+    app_publish_metrics(&app);
+    trace_end();
   }
 
+  control_close(app.control);
   ui_shutdown(&app.ui);
   browser_destroy(app.browser);
+  loader_destroy(app.loader);
   video_close(&app.vid);
+  wall_close(&app.wall);
+  audio_out_report(&app.audio);
+  audio_out_close(&app.audio);
   playlist_free(&app.pl);
+  workpool_shared_shutdown();
+  framesink_shutdown();
+  framepool_shutdown();
+  probecache_shutdown();
+  trace_shutdown();
   SDL_DestroyRenderer(app.ren);
   SDL_DestroyWindow(app.win);
   TTF_Quit();
@@ -74,6 +74,70 @@ static int collect_from_dir(Playlist *pl, const char *dir,
   return 1;
 }
 
+static int is_m3u_file(const char *p) {
+  return ends_with_ci(p, ".m3u") || ends_with_ci(p, ".m3u8");
+}
+
+/* One entry per line; '#' lines are comments or extended tags. Relative
+ * entries are taken relative to the playlist's own directory, and URLs are
+ * passed through to the demuxer. */
+static int collect_from_m3u(Playlist *pl, const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "playlist: failed to open %s\n", path);
+    return 0;
+  }
+
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", path);
+  char *slash = strrchr(dir, '/');
+  if (slash) {
+    slash[1] = '\0';
+  } else {
+    dir[0] = '\0';
+  }
+
+  char **arr = NULL;
+  int n = 0, cap = 0;
+
+  char line[PATH_MAX];
+  while (fgets(line, sizeof(line), f)) {
+    size_t len = strlen(line);
+    while (len > 0 && isspace((unsigned char)line[len - 1])) line[--len] = '\0';
+    char *entry = line;
+    while (isspace((unsigned char)*entry)) entry++;
+    if (!*entry || *entry == '#') continue;
+
+    char full[PATH_MAX];
+    if (entry[0] == '/' || strstr(entry, "://")) {
+      snprintf(full, sizeof(full), "%s", entry);
+    } else {
+      snprintf(full, sizeof(full), "%s%s", dir, entry);
+    }
+
+    if (n == cap) {
+      int nc = cap ? cap * 2 : 32;
+      char **tmp = (char **)realloc(arr, (size_t)nc * sizeof(char *));
+      if (!tmp) break;
+      arr = tmp;
+      cap = nc;
+    }
+    arr[n++] = str_dupe(full);
+  }
+  fclose(f);
+
+  if (n == 0) {
+    free(arr);
+    fprintf(stderr, "playlist: no entries in %s\n", path);
+    return 0;
+  }
+
+  pl->files = arr;
+  pl->count = n;
+  pl->index = 0;
+  return 1;
+}
+
 int playlist_build(Playlist *pl, const char *path) {
   playlist_free(pl);
   if (!path || !path[0]) return 0;
@@ -82,6 +146,10 @@ int playlist_build(Playlist *pl, const char *path) {
     return collect_from_dir(pl, path, NULL);
   }
 
+  if (is_m3u_file(path)) {
+    return collect_from_m3u(pl, path);
+  }
+
   if (!is_video_file(path)) {
     fprintf(stderr, "playlist: not a video file: %s\n", path);
     return 0;
@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <libavformat/avformat.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "probecache.h"
+
+typedef struct {
+  AVCodecParameters *par;
+  AVRational time_base;
+  AVRational avg_frame_rate;
+  AVRational r_frame_rate;
+  int64_t start_time;
+  int64_t duration;
+} ProbeStream;
+
+typedef struct {
+  char *path;
+  int64_t size;
+  int64_t mtime_ns;
+
+  int64_t start_time;
+  int64_t duration;
+  unsigned nb_streams;
+  ProbeStream *streams;
+
+  uint64_t last_used;
+} ProbeEntry;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static ProbeEntry g_entries[PROBECACHE_MAX_ENTRIES];
+static uint64_t g_use_counter;
+
+static int probecache_key(const char *path, int64_t *size,
+                          int64_t *mtime_ns) {
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+  *size = (int64_t)st.st_size;
+  *mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  return 1;
+}
+
+static void probecache_clear(ProbeEntry *e) {
+  for (unsigned i = 0; e->streams && i < e->nb_streams; ++i) {
+    avcodec_parameters_free(&e->streams[i].par);
+  }
+  free(e->streams);
+  free(e->path);
+  memset(e, 0, sizeof(*e));
+}
+
+static ProbeEntry *probecache_find(const char *path) {
+  for (int i = 0; i < PROBECACHE_MAX_ENTRIES; ++i) {
+    if (g_entries[i].path && strcmp(g_entries[i].path, path) == 0)
+      return &g_entries[i];
+  }
+  return NULL;
+}
+
+int probecache_lookup(const char *path, AVFormatContext *fmt) {
+  int64_t size, mtime_ns;
+  if (!path || !fmt || !probecache_key(path, &size, &mtime_ns)) return 0;
+
+  pthread_mutex_lock(&g_lock);
+  ProbeEntry *e = probecache_find(path);
+  int ok = e && e->size == size && e->mtime_ns == mtime_ns &&
+           e->nb_streams == fmt->nb_streams;
+  for (unsigned i = 0; ok && i < fmt->nb_streams; ++i) {
+    ok = e->streams[i].par->codec_id == fmt->streams[i]->codecpar->codec_id;
+  }
+  for (unsigned i = 0; ok && i < fmt->nb_streams; ++i) {
+    const ProbeStream *ps = &e->streams[i];
+    AVStream *st = fmt->streams[i];
+    if (avcodec_parameters_copy(st->codecpar, ps->par) < 0) {
+      ok = 0;
+      break;
+    }
+    st->time_base = ps->time_base;
+    st->avg_frame_rate = ps->avg_frame_rate;
+    st->r_frame_rate = ps->r_frame_rate;
+    st->start_time = ps->start_time;
+    st->duration = ps->duration;
+  }
+  if (ok) {
+    fmt->start_time = e->start_time;
+    fmt->duration = e->duration;
+    e->last_used = ++g_use_counter;
+  }
+  pthread_mutex_unlock(&g_lock);
+  return ok;
+}
+
+void probecache_store(const char *path, const AVFormatContext *fmt) {
+  int64_t size, mtime_ns;
+  if (!path || !fmt || !probecache_key(path, &size, &mtime_ns)) return;
+
+  ProbeEntry n;
+  memset(&n, 0, sizeof(n));
+  n.path = str_dupe(path);
+  n.size = size;
+  n.mtime_ns = mtime_ns;
+  n.start_time = fmt->start_time;
+  n.duration = fmt->duration;
+  n.nb_streams = fmt->nb_streams;
+  n.streams = (ProbeStream *)calloc(fmt->nb_streams ? fmt->nb_streams : 1,
+                                    sizeof(ProbeStream));
+  if (!n.path || !n.streams) {
+    probecache_clear(&n);
+    return;
+  }
+  for (unsigned i = 0; i < fmt->nb_streams; ++i) {
+    const AVStream *st = fmt->streams[i];
+    ProbeStream *ps = &n.streams[i];
+    ps->par = avcodec_parameters_alloc();
+    if (!ps->par || avcodec_parameters_copy(ps->par, st->codecpar) < 0) {
+      probecache_clear(&n);
+      return;
+    }
+    ps->time_base = st->time_base;
+    ps->avg_frame_rate = st->avg_frame_rate;
+    ps->r_frame_rate = st->r_frame_rate;
+    ps->start_time = st->start_time;
+    ps->duration = st->duration;
+  }
+
+  pthread_mutex_lock(&g_lock);
+  ProbeEntry *slot = probecache_find(path);
+  for (int i = 0; !slot && i < PROBECACHE_MAX_ENTRIES; ++i) {
+    if (!g_entries[i].path) slot = &g_entries[i];
+  }
+  if (!slot) {
+    slot = &g_entries[0];
+    for (int i = 1; i < PROBECACHE_MAX_ENTRIES; ++i) {
+      if (g_entries[i].last_used < slot->last_used) slot = &g_entries[i];
+    }
+  }
+  probecache_clear(slot);
+  *slot = n;
+  slot->last_used = ++g_use_counter;
+  pthread_mutex_unlock(&g_lock);
+}
+
+void probecache_shutdown(void) {
+  pthread_mutex_lock(&g_lock);
+  for (int i = 0; i < PROBECACHE_MAX_ENTRIES; ++i) {
+    probecache_clear(&g_entries[i]);
+  }
+  pthread_mutex_unlock(&g_lock);
+}
\ No newline at end of file
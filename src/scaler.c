@@ -0,0 +1,232 @@
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scaler.h"
+#include "workpool.h"
+
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+#define SCALER_HAVE_THREADED_API 1
+#else
+#define SCALER_HAVE_THREADED_API 0
+#endif
+
+typedef struct {
+  Scaler *s;
+  const struct AVFrame *src;
+  uint8_t *const *dst;
+  const int *dst_stride;
+} SliceJob;
+
+static void scaler_reset(Scaler *s) {
+  if (s->sws) sws_freeContext(s->sws);
+  for (int i = 0; i < s->nslices; ++i) sws_freeContext(s->slice[i]);
+  av_frame_free(&s->src_frame);
+  av_frame_free(&s->dst_frame);
+  memset(s, 0, sizeof(*s));
+}
+
+void scaler_free(Scaler *s) {
+  if (s) scaler_reset(s);
+}
+
+static int scaler_plane_shift(const AVPixFmtDescriptor *d, int plane) {
+  return (plane == 1 || plane == 2) ? d->log2_chroma_h : 0;
+}
+
+/* Bands can be converted independently only when each output row depends
+ * on exactly the same input rows. */
+static int scaler_can_slice(const Scaler *s) {
+  if (s->src_w != s->dst_w || s->src_h != s->dst_h) return 0;
+
+  const AVPixFmtDescriptor *sd = av_pix_fmt_desc_get(s->src_fmt);
+  const AVPixFmtDescriptor *dd = av_pix_fmt_desc_get(s->dst_fmt);
+  if (!sd || !dd) return 0;
+  if ((sd->flags | dd->flags) & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL))
+    return 0;
+  if ((sd->flags | dd->flags) & AV_PIX_FMT_FLAG_RGB) return 0;
+  return sd->log2_chroma_h == dd->log2_chroma_h;
+}
+
+static int scaler_init_slices(Scaler *s, int n) {
+  int rows = (s->src_h + n - 1) / n;
+  rows = (rows + SCALER_SLICE_ALIGN - 1) / SCALER_SLICE_ALIGN *
+         SCALER_SLICE_ALIGN;
+
+  int y = 0;
+  s->nslices = 0;
+  while (y < s->src_h && s->nslices < SCALER_MAX_SLICES) {
+    int h = s->src_h - y < rows ? s->src_h - y : rows;
+    struct SwsContext *c =
+        sws_getContext(s->src_w, h, s->src_fmt, s->dst_w, h, s->dst_fmt,
+                       s->flags, NULL, NULL, NULL);
+    if (!c) return 0;
+    s->slice[s->nslices] = c;
+    s->slice_y[s->nslices] = y;
+    s->nslices++;
+    y += h;
+  }
+  s->slice_y[s->nslices] = y;
+  return y == s->src_h;
+}
+
+static void scaler_drop_slices(Scaler *s) {
+  for (int i = 0; i < s->nslices; ++i) sws_freeContext(s->slice[i]);
+  memset(s->slice, 0, sizeof(s->slice));
+  s->nslices = 0;
+}
+
+#if SCALER_HAVE_THREADED_API
+static int scaler_init_threaded(Scaler *s) {
+  struct SwsContext *c = sws_alloc_context();
+  if (!c) return 0;
+
+  av_opt_set_int(c, "srcw", s->src_w, 0);
+  av_opt_set_int(c, "srch", s->src_h, 0);
+  av_opt_set_int(c, "src_format", s->src_fmt, 0);
+  av_opt_set_int(c, "dstw", s->dst_w, 0);
+  av_opt_set_int(c, "dsth", s->dst_h, 0);
+  av_opt_set_int(c, "dst_format", s->dst_fmt, 0);
+  av_opt_set_int(c, "sws_flags", s->flags, 0);
+  av_opt_set_int(c, "threads", s->threads, 0);
+
+  s->src_frame = av_frame_alloc();
+  s->dst_frame = av_frame_alloc();
+  if (!s->src_frame || !s->dst_frame || sws_init_context(c, NULL, NULL) < 0) {
+    sws_freeContext(c);
+    av_frame_free(&s->src_frame);
+    av_frame_free(&s->dst_frame);
+    return 0;
+  }
+
+  s->sws = c;
+  s->threaded_api = 1;
+  return 1;
+}
+#endif
+
+int scaler_configure(Scaler *s, int src_w, int src_h, int src_fmt, int dst_w,
+                     int dst_h, int dst_fmt, int flags, int threads) {
+  if (threads <= 0) threads = workpool_cpu_count();
+  if (threads > SCALER_MAX_SLICES) threads = SCALER_MAX_SLICES;
+  if ((int64_t)src_w * src_h < SCALER_MIN_PARALLEL_PIXELS) threads = 1;
+
+  if ((s->sws || s->nslices) && s->src_w == src_w && s->src_h == src_h &&
+      s->src_fmt == src_fmt && s->dst_w == dst_w && s->dst_h == dst_h &&
+      s->dst_fmt == dst_fmt && s->flags == flags && s->threads == threads)
+    return 1;
+
+  scaler_reset(s);
+  s->src_w = src_w;
+  s->src_h = src_h;
+  s->src_fmt = src_fmt;
+  s->dst_w = dst_w;
+  s->dst_h = dst_h;
+  s->dst_fmt = dst_fmt;
+  s->flags = flags;
+  s->threads = threads;
+
+  if (threads > 1) {
+#if SCALER_HAVE_THREADED_API
+    if (scaler_init_threaded(s)) return 1;
+#endif
+    if (scaler_can_slice(s) && scaler_init_slices(s, threads)) return 1;
+    scaler_drop_slices(s);
+  }
+
+  s->sws = sws_getContext(src_w, src_h, src_fmt, dst_w, dst_h, dst_fmt, flags,
+                          NULL, NULL, NULL);
+  if (!s->sws) {
+    fprintf(stderr, "scaler: sws_getContext failed\n");
+    return 0;
+  }
+  return 1;
+}
+
+static void scaler_slice_job(void *arg, int index) {
+  SliceJob *job = (SliceJob *)arg;
+  Scaler *s = job->s;
+  const AVPixFmtDescriptor *sd = av_pix_fmt_desc_get(s->src_fmt);
+  const AVPixFmtDescriptor *dd = av_pix_fmt_desc_get(s->dst_fmt);
+  int y0 = s->slice_y[index];
+  int h = s->slice_y[index + 1] - y0;
+
+  const uint8_t *src[4] = {NULL};
+  uint8_t *dst[4] = {NULL};
+  for (int p = 0; p < 4; ++p) {
+    if (job->src->data[p]) {
+      src[p] = job->src->data[p] +
+               (ptrdiff_t)(y0 >> scaler_plane_shift(sd, p)) *
+                   job->src->linesize[p];
+    }
+    if (job->dst[p]) {
+      dst[p] = job->dst[p] +
+               (ptrdiff_t)(y0 >> scaler_plane_shift(dd, p)) *
+                   job->dst_stride[p];
+    }
+  }
+
+  sws_scale(s->slice[index], src, job->src->linesize, 0, h, dst,
+            job->dst_stride);
+}
+
+#if SCALER_HAVE_THREADED_API
+static void scaler_buffer_noop(void *opaque, uint8_t *data) {
+  (void)opaque;
+  (void)data;
+}
+
+static int scaler_scale_threaded(Scaler *s, const struct AVFrame *src,
+                                 uint8_t *const dst[],
+                                 const int dst_stride[]) {
+  AVFrame *in = s->src_frame;
+  AVFrame *out = s->dst_frame;
+
+  if (av_frame_ref(in, src) < 0) return 0;
+
+  /* Wrap the caller's planes so swscale writes into them in place. */
+  out->format = s->dst_fmt;
+  out->width = s->dst_w;
+  out->height = s->dst_h;
+  for (int p = 0; p < 4; ++p) {
+    out->data[p] = dst[p];
+    out->linesize[p] = dst[p] ? dst_stride[p] : 0;
+  }
+  out->buf[0] = av_buffer_create(dst[0], 1, scaler_buffer_noop, NULL, 0);
+
+  int ok = out->buf[0] && sws_scale_frame(s->sws, out, in) >= 0;
+
+  av_frame_unref(in);
+  av_frame_unref(out);
+  return ok;
+}
+#endif
+
+int scaler_scale(Scaler *s, const struct AVFrame *src, uint8_t *const dst[],
+                 const int dst_stride[]) {
+  if (!s || !src) return 0;
+
+#if SCALER_HAVE_THREADED_API
+  if (s->threaded_api) return scaler_scale_threaded(s, src, dst, dst_stride);
+#endif
+
+  if (s->nslices > 0) {
+    SliceJob job = {s, src, dst, dst_stride};
+    workpool_run(workpool_shared(), s->nslices, scaler_slice_job, &job);
+    return 1;
+  }
+
+  if (!s->sws) return 0;
+  sws_scale(s->sws, (const uint8_t *const *)src->data, src->linesize, 0,
+            src->height, dst, dst_stride);
+  return 1;
+}
+
+int scaler_thread_count(const Scaler *s) {
+  if (!s) return 0;
+  if (s->threaded_api) return s->threads;
+  return s->nslices > 0 ? s->nslices : 1;
+}
\ No newline at end of file
@@ -0,0 +1,234 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <SDL2/SDL.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "scrub.h"
+#include "trace.h"
+#include "video.h"
+
+struct Scrubber {
+  char *path;
+  int stream_index;
+  int lowres;
+
+  pthread_t thread;
+  int thread_started;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  atomic_int quit;
+
+  /* Latest target; `seq` grows with every request so the worker can tell
+   * that the one it is decoding has been superseded. */
+  int has_request;
+  int64_t request;
+  Uint64 request_ticks;
+  atomic_uint seq;
+
+  AVFrame *result;
+  Uint64 result_ticks;
+  int has_result;
+
+  ScrubStats stats;
+};
+
+static int scrub_interrupt(void *opaque) {
+  return atomic_load(&((Scrubber *)opaque)->quit);
+}
+
+/* Decodes the keyframe at or before `target` into `frame`. Returns 1 on a
+ * new frame, 0 when `last_key` is already that keyframe or the request was
+ * superseded, -1 on errors. */
+static int scrub_decode(Scrubber *s, AVFormatContext *fmt,
+                        AVCodecContext *dec, AVPacket *pkt, AVFrame *frame,
+                        int64_t target, unsigned seq, int64_t *last_key) {
+  if (av_seek_frame(fmt, s->stream_index, target, AVSEEK_FLAG_BACKWARD) < 0)
+    return -1;
+  avcodec_flush_buffers(dec);
+
+  int first = 1;
+  while (!atomic_load(&s->quit) && atomic_load(&s->seq) == seq) {
+    int ret = av_read_frame(fmt, pkt);
+    if (ret < 0) {
+      avcodec_send_packet(dec, NULL);
+    } else {
+      if (pkt->stream_index != s->stream_index) {
+        av_packet_unref(pkt);
+        continue;
+      }
+      /* Dragging within one GOP lands on the keyframe already shown. */
+      if (first && pkt->pts != AV_NOPTS_VALUE && pkt->pts == *last_key) {
+        av_packet_unref(pkt);
+        return 0;
+      }
+      first = 0;
+      avcodec_send_packet(dec, pkt);
+      av_packet_unref(pkt);
+    }
+
+    ret = avcodec_receive_frame(dec, frame);
+    if (ret >= 0) {
+      frame->pts = frame->best_effort_timestamp;
+      *last_key = frame->pts;
+      return 1;
+    }
+    if (ret != AVERROR(EAGAIN)) return -1;
+  }
+  return 0;
+}
+
+static void *scrub_thread(void *arg) {
+  Scrubber *s = (Scrubber *)arg;
+  trace_set_thread_name("scrub");
+
+  VideoInput in;
+  memset(&in, 0, sizeof(in));
+  /* A preview wants the keyframe as soon as its packet is in, so no frame
+   * threads. */
+  AVCodecContext *dec = video_open_worker_decoder(
+      &in, s->path, s->stream_index, s->lowres,
+      VIDEO_WORKER_KEYFRAMES | VIDEO_WORKER_LOW_DELAY, scrub_interrupt, s);
+  AVPacket *pkt = av_packet_alloc();
+  AVFrame *frame = av_frame_alloc();
+  int64_t last_key = AV_NOPTS_VALUE;
+
+  if (!dec || !pkt || !frame) {
+    fprintf(stderr, "scrub: cannot open decoder for '%s'\n", s->path);
+  } else {
+    for (;;) {
+      pthread_mutex_lock(&s->lock);
+      while (!atomic_load(&s->quit) && !s->has_request) {
+        pthread_cond_wait(&s->wake, &s->lock);
+      }
+      if (atomic_load(&s->quit)) {
+        pthread_mutex_unlock(&s->lock);
+        break;
+      }
+      int64_t target = s->request;
+      Uint64 ticks = s->request_ticks;
+      unsigned seq = atomic_load(&s->seq);
+      s->has_request = 0;
+      pthread_mutex_unlock(&s->lock);
+
+      trace_begin("scrub_decode");
+      int ret =
+          scrub_decode(s, in.fmt, dec, pkt, frame, target, seq, &last_key);
+      trace_end();
+
+      pthread_mutex_lock(&s->lock);
+      if (ret > 0) {
+        av_frame_unref(s->result);
+        av_frame_move_ref(s->result, frame);
+        s->result_ticks = ticks;
+        s->has_result = 1;
+        s->stats.previews++;
+      } else if (ret == 0 && atomic_load(&s->seq) == seq) {
+        s->stats.reused++;
+      }
+      pthread_mutex_unlock(&s->lock);
+      if (ret < 0) last_key = AV_NOPTS_VALUE;
+    }
+  }
+
+  av_frame_free(&frame);
+  av_packet_free(&pkt);
+  avcodec_free_context(&dec);
+  video_input_close(&in);
+  return NULL;
+}
+
+Scrubber *scrub_open(const char *path, int stream_index, int lowres) {
+  Scrubber *s = (Scrubber *)calloc(1, sizeof(Scrubber));
+  if (!s) return NULL;
+
+  s->path = str_dupe(path);
+  s->stream_index = stream_index;
+  s->lowres = lowres;
+  s->result = av_frame_alloc();
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->wake, NULL);
+
+  if (!s->path || !s->result ||
+      pthread_create(&s->thread, NULL, scrub_thread, s) != 0) {
+    fprintf(stderr, "scrub: cannot start worker\n");
+    scrub_close(s);
+    return NULL;
+  }
+  s->thread_started = 1;
+  return s;
+}
+
+void scrub_request(Scrubber *s, int64_t pts) {
+  if (!s) return;
+
+  pthread_mutex_lock(&s->lock);
+  if (s->has_request) s->stats.coalesced++;
+  s->stats.requests++;
+  s->has_request = 1;
+  s->request = pts;
+  s->request_ticks = SDL_GetPerformanceCounter();
+  atomic_fetch_add(&s->seq, 1);
+  pthread_cond_signal(&s->wake);
+  pthread_mutex_unlock(&s->lock);
+}
+
+int scrub_take(Scrubber *s, AVFrame *out) {
+  if (!s) return 0;
+
+  pthread_mutex_lock(&s->lock);
+  int got = s->has_result;
+  if (got) {
+    av_frame_unref(out);
+    av_frame_move_ref(out, s->result);
+    s->has_result = 0;
+
+    double ms = (double)(SDL_GetPerformanceCounter() - s->result_ticks) *
+                1000.0 / (double)SDL_GetPerformanceFrequency();
+    s->stats.shown++;
+    s->stats.latency_total_ms += ms;
+    if (ms > s->stats.latency_max_ms) s->stats.latency_max_ms = ms;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return got;
+}
+
+void scrub_get_stats(Scrubber *s, ScrubStats *out) {
+  pthread_mutex_lock(&s->lock);
+  *out = s->stats;
+  pthread_mutex_unlock(&s->lock);
+}
+
+void scrub_close(Scrubber *s) {
+  if (!s) return;
+
+  if (s->thread_started) {
+    pthread_mutex_lock(&s->lock);
+    atomic_store(&s->quit, 1);
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+
+    ScrubStats st;
+    scrub_get_stats(s, &st);
+    fprintf(stderr,
+            "scrub: %llu requests (%llu coalesced), %llu previews decoded, "
+            "%llu same keyframe, seek-to-display avg %.1f ms max %.1f ms\n",
+            (unsigned long long)st.requests, (unsigned long long)st.coalesced,
+            (unsigned long long)st.previews, (unsigned long long)st.reused,
+            st.shown ? st.latency_total_ms / (double)st.shown : 0.0,
+            st.latency_max_ms);
+  }
+
+  av_frame_free(&s->result);
+  pthread_cond_destroy(&s->wake);
+  pthread_mutex_destroy(&s->lock);
+  free(s->path);
+  free(s);
+}
\ No newline at end of file
@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "trace.h"
+
+/* A dump taken while threads keep tracing skips this many of the oldest
+ * events of each ring, which their threads are about to overwrite. */
+#define TRACE_DUMP_SLACK 1024
+
+typedef struct {
+  const char *name;
+  uint64_t ts_ns;
+  uint64_t dur_ns;
+} TraceEvent;
+
+typedef struct TraceRing {
+  struct TraceRing *next;
+  int tid;
+  char thread_name[32];
+
+  _Atomic uint64_t head;
+  TraceEvent events[TRACE_RING_EVENTS];
+
+  int depth;
+  const char *stack_name[TRACE_MAX_DEPTH];
+  uint64_t stack_ts[TRACE_MAX_DEPTH];
+} TraceRing;
+
+static atomic_int g_trace_on;
+static char *g_trace_path;
+static uint64_t g_trace_epoch_ns;
+
+static pthread_mutex_t g_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing *g_rings;
+static int g_next_tid = 1;
+
+static _Thread_local TraceRing *t_ring;
+
+static uint64_t trace_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static TraceRing *trace_thread_ring(void) {
+  if (t_ring) return t_ring;
+
+  TraceRing *r = (TraceRing *)calloc(1, sizeof(TraceRing));
+  if (!r) return NULL;
+
+  pthread_mutex_lock(&g_rings_lock);
+  r->tid = g_next_tid++;
+  snprintf(r->thread_name, sizeof(r->thread_name), "thread-%d", r->tid);
+  r->next = g_rings;
+  g_rings = r;
+  pthread_mutex_unlock(&g_rings_lock);
+
+  t_ring = r;
+  return r;
+}
+
+int trace_init(const char *out_path) {
+  if (!out_path || !out_path[0]) return 0;
+
+  free(g_trace_path);
+  g_trace_path = str_dupe(out_path);
+  if (!g_trace_path) return 0;
+
+  g_trace_epoch_ns = trace_now_ns();
+  atomic_store(&g_trace_on, 1);
+  trace_set_thread_name("main");
+
+  fprintf(stderr, "trace: recording to %s\n", g_trace_path);
+  return 1;
+}
+
+void trace_shutdown(void) {
+  if (atomic_load(&g_trace_on) && g_trace_path) {
+    trace_dump(g_trace_path);
+  }
+  atomic_store(&g_trace_on, 0);
+
+  pthread_mutex_lock(&g_rings_lock);
+  TraceRing *r = g_rings;
+  g_rings = NULL;
+  pthread_mutex_unlock(&g_rings_lock);
+
+  while (r) {
+    TraceRing *next = r->next;
+    free(r);
+    r = next;
+  }
+  t_ring = NULL;
+
+  free(g_trace_path);
+  g_trace_path = NULL;
+}
+
+int trace_enabled(void) {
+  return atomic_load_explicit(&g_trace_on, memory_order_relaxed);
+}
+
+const char *trace_output_path(void) { return g_trace_path; }
+
+void trace_set_thread_name(const char *name) {
+  if (!trace_enabled() || !name) return;
+  TraceRing *r = trace_thread_ring();
+  if (!r) return;
+  strncpy(r->thread_name, name, sizeof(r->thread_name) - 1);
+  r->thread_name[sizeof(r->thread_name) - 1] = '\0';
+}
+
+void trace_begin(const char *name) {
+  if (!trace_enabled()) return;
+  TraceRing *r = trace_thread_ring();
+  if (!r) return;
+
+  if (r->depth < TRACE_MAX_DEPTH) {
+    r->stack_name[r->depth] = name;
+    r->stack_ts[r->depth] = trace_now_ns();
+  }
+  r->depth++;
+}
+
+void trace_end(void) {
+  TraceRing *r = t_ring;
+  if (!r || r->depth == 0) return;
+
+  r->depth--;
+  if (r->depth >= TRACE_MAX_DEPTH || !trace_enabled()) return;
+
+  uint64_t now = trace_now_ns();
+  uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+  /* A dump that sees any of this write also sees head == h, which marks
+   * the slot's older event as overwritten. */
+  atomic_thread_fence(memory_order_release);
+  TraceEvent *ev = &r->events[h % TRACE_RING_EVENTS];
+  ev->name = r->stack_name[r->depth];
+  ev->ts_ns = r->stack_ts[r->depth];
+  ev->dur_ns = now - ev->ts_ns;
+  atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+static void trace_write_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; ++s) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      fputc('\\', f);
+      fputc(c, f);
+    } else if (c < 0x20) {
+      fprintf(f, "\\u%04x", c);
+    } else {
+      fputc(c, f);
+    }
+  }
+  fputc('"', f);
+}
+
+int trace_dump(const char *path) {
+  if (!path) return 0;
+
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "trace: cannot write %s\n", path);
+    return 0;
+  }
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  int first = 1;
+  uint64_t written = 0;
+  uint64_t overwritten = 0;
+
+  pthread_mutex_lock(&g_rings_lock);
+  for (TraceRing *r = g_rings; r; r = r->next) {
+    fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":",
+            first ? "" : ",\n", r->tid);
+    trace_write_string(f, r->thread_name);
+    fprintf(f, "}}");
+    first = 0;
+
+    /* The ring's thread may still be tracing: each event is copied, then
+     * dropped if head shows its slot was reused meanwhile. */
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint64_t keep = TRACE_RING_EVENTS - TRACE_DUMP_SLACK;
+    uint64_t start = head > keep ? head - keep : 0;
+
+    for (uint64_t i = start; i < head; ++i) {
+      TraceEvent ev = r->events[i % TRACE_RING_EVENTS];
+      atomic_thread_fence(memory_order_acquire);
+      if (atomic_load_explicit(&r->head, memory_order_relaxed) >=
+          i + TRACE_RING_EVENTS) {
+        overwritten++;
+        continue;
+      }
+      if (!ev.name || ev.ts_ns < g_trace_epoch_ns) continue;
+
+      fprintf(f, ",\n{\"name\":");
+      trace_write_string(f, ev.name);
+      fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              r->tid, (double)(ev.ts_ns - g_trace_epoch_ns) / 1000.0,
+              (double)ev.dur_ns / 1000.0);
+      written++;
+    }
+  }
+  pthread_mutex_unlock(&g_rings_lock);
+
+  fprintf(f, "\n]}\n");
+  fclose(f);
+
+  fprintf(stderr, "trace: wrote %llu events to %s (%llu overwritten while "
+          "writing)\n",
+          (unsigned long long)written, path, (unsigned long long)overwritten);
+  return 1;
+}
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "common.h"
+#include "trace.h"
 #include "ui.h"
 
 static const UiPalette g_palette = {
@@ -29,8 +33,22 @@ int ui_init(UiContext *ui, SDL_Renderer *ren, const char *font_path) {
   if (!ui) return 0;
   ui->ren = ren;
   ui->pal = ui_palette();
+  ui->font_path = str_dupe(font_path);
+  ui->fonts_tried = 0;
   ui->font_regular = NULL;
   ui->font_small = NULL;
+  ui->layout_valid = 0;
+  ui->bar_tex = NULL;
+  ui->bar_valid = 0;
+  ui->time_tex = NULL;
+  ui->time_str[0] = '\0';
+  return ui->font_path != NULL;
+}
+
+int ui_load_fonts(UiContext *ui) {
+  if (!ui) return 0;
+  if (ui->fonts_tried) return ui->font_regular != NULL;
+  ui->fonts_tried = 1;
 
   if (TTF_WasInit() == 0) {
     if (TTF_Init() != 0) {
@@ -39,13 +57,13 @@ int ui_init(UiContext *ui, SDL_Renderer *ren, const char *font_path) {
     }
   }
 
-  ui->font_regular = TTF_OpenFont(font_path, 18);
+  ui->font_regular = TTF_OpenFont(ui->font_path, 18);
   if (!ui->font_regular) {
     fprintf(stderr, "ui: TTF_OpenFont regular failed: %s\n", TTF_GetError());
     return 0;
   }
 
-  ui->font_small = TTF_OpenFont(font_path, 16);
+  ui->font_small = TTF_OpenFont(ui->font_path, 16);
   if (!ui->font_small) {
     ui->font_small = ui->font_regular;
   }
@@ -55,16 +73,40 @@ int ui_init(UiContext *ui, SDL_Renderer *ren, const char *font_path) {
 
 void ui_shutdown(UiContext *ui) {
   if (!ui) return;
+  ui_invalidate_cache(ui);
   if (ui->font_small && ui->font_small != ui->font_regular)
     TTF_CloseFont(ui->font_small);
   if (ui->font_regular) TTF_CloseFont(ui->font_regular);
   ui->font_small = NULL;
   ui->font_regular = NULL;
+  free(ui->font_path);
+  ui->font_path = NULL;
+  ui->fonts_tried = 0;
   ui->ren = NULL;
   ui->pal = NULL;
 }
 
-void ui_compute_player_layout(const UiContext *ui, UiPlayerLayout *l) {
+void ui_invalidate_cache(UiContext *ui) {
+  if (ui->bar_tex) SDL_DestroyTexture(ui->bar_tex);
+  if (ui->time_tex) SDL_DestroyTexture(ui->time_tex);
+  ui->bar_tex = NULL;
+  ui->time_tex = NULL;
+  ui->time_str[0] = '\0';
+  ui->bar_valid = 0;
+  ui->layout_valid = 0;
+}
+
+void ui_handle_event(UiContext *ui, const SDL_Event *e) {
+  if (e->type == SDL_WINDOWEVENT &&
+      e->window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+    ui_invalidate_cache(ui);
+  } else if (e->type == SDL_RENDER_TARGETS_RESET ||
+             e->type == SDL_RENDER_DEVICE_RESET) {
+    ui_invalidate_cache(ui);
+  }
+}
+
+static void ui_layout_player(const UiContext *ui, UiPlayerLayout *l) {
   int ww, wh;
   SDL_GetRendererOutputSize(ui->ren, &ww, &wh);
 
@@ -115,11 +157,21 @@ void ui_compute_player_layout(const UiContext *ui, UiPlayerLayout *l) {
   l->progress_bg.y = center_y - l->progress_bg.h / 2;
 }
 
+void ui_compute_player_layout(UiContext *ui, UiPlayerLayout *l) {
+  if (!ui->layout_valid) {
+    ui_layout_player(ui, &ui->layout);
+    ui->layout_valid = 1;
+  }
+  *l = ui->layout;
+}
+
 void ui_draw_video(const UiContext *ui, VideoState *vid) {
-  int tw, th;
-  SDL_Texture *tex = video_get_texture(vid, &tw, &th);
+  SDL_Texture *tex = video_get_texture(vid, NULL, NULL);
   if (!tex) return;
 
+  int tw, th;
+  video_get_frame_size(vid, &tw, &th);
+
   int ww, wh;
   SDL_GetRendererOutputSize(ui->ren, &ww, &wh);
 
@@ -130,104 +182,88 @@ void ui_draw_video(const UiContext *ui, VideoState *vid) {
   int rh = (int)(th * sc);
 
   SDL_Rect dst = {(ww - rw) / 2, (wh - rh) / 2, rw, rh};
+  video_set_output_size(vid, rw, rh);
+
+  trace_begin("draw_video");
   SDL_RenderCopy(ui->ren, tex, NULL, &dst);
+  trace_end();
 }
 
-void ui_draw_player_controls(const UiContext *ui, const UiPlayerLayout *l,
-                             const VideoState *vid, int paused, int muted) {
-  SDL_SetRenderDrawBlendMode(ui->ren, SDL_BLENDMODE_BLEND);
+static SDL_Rect ui_offset_rect(SDL_Rect r, int dx, int dy) {
+  r.x += dx;
+  r.y += dy;
+  return r;
+}
 
+/* The parts of the control bar that do not move during playback, drawn
+ * shifted by (dx, dy). `panel_mode` is SDL_BLENDMODE_NONE when drawing into
+ * the cache texture, so the panel keeps its own alpha. */
+static void ui_draw_bar_static(const UiContext *ui, const UiPlayerLayout *l,
+                               int dx, int dy, int paused, int muted,
+                               SDL_BlendMode panel_mode) {
   const UiPalette *p = ui->pal;
   SDL_Color c;
 
+  SDL_Rect bar = ui_offset_rect(l->bar, dx, dy);
+  SDL_Rect bg = ui_offset_rect(l->progress_bg, dx, dy);
+  SDL_Rect play = ui_offset_rect(l->btn_play, dx, dy);
+  SDL_Rect prev = ui_offset_rect(l->btn_prev, dx, dy);
+  SDL_Rect next = ui_offset_rect(l->btn_next, dx, dy);
+  SDL_Rect vol_bar = ui_offset_rect(l->vol_bar, dx, dy);
+  SDL_Rect vol_icon = ui_offset_rect(l->vol_icon, dx, dy);
+
   c = p->panel;
+  SDL_SetRenderDrawBlendMode(ui->ren, panel_mode);
   SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, 230);
-  SDL_RenderFillRect(ui->ren, &l->bar);
-
-  int64_t dur = video_get_duration_ms(vid);
-  int64_t pos = video_get_position_ms(vid);
-  double r = 0.0;
-  if (dur > 0) {
-    r = (double)pos / (double)dur;
-    if (r < 0.0) r = 0.0;
-    if (r > 1.0) r = 1.0;
-  }
-
-  SDL_Rect bg = l->progress_bg;
-  SDL_Rect fg = bg;
-  fg.w = (int)(bg.w * r);
+  SDL_RenderFillRect(ui->ren, &bar);
+  SDL_SetRenderDrawBlendMode(ui->ren, SDL_BLENDMODE_BLEND);
 
   c = p->panel_header_border;
   SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, 220);
   SDL_RenderFillRect(ui->ren, &bg);
 
-  c = p->row_selected_accent;
-  SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, 255);
-  SDL_RenderFillRect(ui->ren, &fg);
-
   c = p->text_primary;
   SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, c.a);
-  SDL_RenderDrawRect(ui->ren, &l->btn_play);
+  SDL_RenderDrawRect(ui->ren, &play);
 
   if (paused) {
-    SDL_Point p1 = {l->btn_play.x + l->btn_play.w / 3, l->btn_play.y + 6};
-    SDL_Point p2 = {l->btn_play.x + l->btn_play.w / 3,
-                    l->btn_play.y + l->btn_play.h - 6};
-    SDL_Point p3 = {l->btn_play.x + l->btn_play.w - l->btn_play.w / 4,
-                    l->btn_play.y + l->btn_play.h / 2};
+    SDL_Point p1 = {play.x + play.w / 3, play.y + 6};
+    SDL_Point p2 = {play.x + play.w / 3, play.y + play.h - 6};
+    SDL_Point p3 = {play.x + play.w - play.w / 4, play.y + play.h / 2};
 
     SDL_RenderDrawLine(ui->ren, p1.x, p1.y, p2.x, p2.y);
     SDL_RenderDrawLine(ui->ren, p2.x, p2.y, p3.x, p3.y);
     SDL_RenderDrawLine(ui->ren, p3.x, p3.y, p1.x, p1.y);
   } else {
     int pad = 6;
-    SDL_Rect bar1 = {l->btn_play.x + pad, l->btn_play.y + pad, 6,
-                     l->btn_play.h - 2 * pad};
-    SDL_Rect bar2 = {l->btn_play.x + l->btn_play.w - pad - 6,
-                     l->btn_play.y + pad, 6, l->btn_play.h - 2 * pad};
-    SDL_RenderFillRect(ui->ren, &bar1);
-    SDL_RenderFillRect(ui->ren, &bar2);
+    SDL_Rect bars[2] = {
+        {play.x + pad, play.y + pad, 6, play.h - 2 * pad},
+        {play.x + play.w - pad - 6, play.y + pad, 6, play.h - 2 * pad}};
+    SDL_RenderFillRects(ui->ren, bars, 2);
   }
 
-  SDL_Point pv1 = {l->btn_prev.x + l->btn_prev.w - 4, l->btn_prev.y + 4};
-  SDL_Point pv2 = {l->btn_prev.x + 4, l->btn_prev.y + l->btn_prev.h / 2};
-  SDL_Point pv3 = {l->btn_prev.x + l->btn_prev.w - 4,
-                   l->btn_prev.y + l->btn_prev.h - 4};
-  SDL_RenderDrawLine(ui->ren, pv1.x, pv1.y, pv2.x, pv2.y);
-  SDL_RenderDrawLine(ui->ren, pv2.x, pv2.y, pv3.x, pv3.y);
-
-  SDL_Point nx1 = {l->btn_next.x + 4, l->btn_next.y + 4};
-  SDL_Point nx2 = {l->btn_next.x + l->btn_next.w - 4,
-                   l->btn_next.y + l->btn_next.h / 2};
-  SDL_Point nx3 = {l->btn_next.x + 4, l->btn_next.y + l->btn_next.h - 4};
-  SDL_RenderDrawLine(ui->ren, nx1.x, nx1.y, nx2.x, nx2.y);
-  SDL_RenderDrawLine(ui->ren, nx2.x, nx2.y, nx3.x, nx3.y);
+  SDL_Point pv[3] = {{prev.x + prev.w - 4, prev.y + 4},
+                     {prev.x + 4, prev.y + prev.h / 2},
+                     {prev.x + prev.w - 4, prev.y + prev.h - 4}};
+  SDL_RenderDrawLines(ui->ren, pv, 3);
 
-  double vol = video_get_volume(vid);
-  if (vol < 0.0) vol = 0.0;
-  if (vol > 1.0) vol = 1.0;
+  SDL_Point nx[3] = {{next.x + 4, next.y + 4},
+                     {next.x + next.w - 4, next.y + next.h / 2},
+                     {next.x + 4, next.y + next.h - 4}};
+  SDL_RenderDrawLines(ui->ren, nx, 3);
 
   c = p->scrollbar_bg;
   SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, 220);
-  SDL_RenderFillRect(ui->ren, &l->vol_bar);
-
-  SDL_Rect vol_fg = l->vol_bar;
-  vol_fg.w = (int)(l->vol_bar.w * vol);
-  c = p->scrollbar_handle;
-  SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, 255);
-  SDL_RenderFillRect(ui->ren, &vol_fg);
-
-  c = p->text_primary;
-  SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, c.a);
-
-  int icon_x = l->vol_icon.x;
-  int icon_y = l->vol_icon.y;
-  int icon_w = l->vol_icon.w;
-  int icon_h = l->vol_icon.h;
+  SDL_RenderFillRect(ui->ren, &vol_bar);
 
   SDL_Color vc = p->text_primary;
   SDL_SetRenderDrawColor(ui->ren, vc.r, vc.g, vc.b, vc.a);
 
+  int icon_x = vol_icon.x;
+  int icon_y = vol_icon.y;
+  int icon_w = vol_icon.w;
+  int icon_h = vol_icon.h;
+
   int body_w = icon_w / 2.5;
   SDL_Rect body = {icon_x, icon_y + icon_h / 4, body_w, icon_h / 2};
   SDL_RenderFillRect(ui->ren, &body);
@@ -267,12 +303,141 @@ void ui_draw_player_controls(const UiContext *ui, const UiPlayerLayout *l,
     SDL_RenderDrawLine(ui->ren, xl, y, xr, y);
   }
 
-  if (muted || vol <= 0.001) {
+  if (muted) {
     SDL_RenderDrawLine(ui->ren, icon_x + 2, icon_y + 2, icon_x + icon_w - 2,
                        icon_y + icon_h - 2);
     SDL_RenderDrawLine(ui->ren, icon_x + icon_w - 2, icon_y + 2, icon_x + 2,
                        icon_y + icon_h - 2);
   }
+}
+
+/* Renders the static bar into ui->bar_tex. Returns 0 when render targets
+ * are unavailable and the bar has to be drawn directly. */
+static int ui_build_bar_cache(UiContext *ui, const UiPlayerLayout *l,
+                              int paused, int muted) {
+  if (!SDL_RenderTargetSupported(ui->ren)) return 0;
+
+  if (!ui->bar_tex) {
+    ui->bar_tex = SDL_CreateTexture(ui->ren, SDL_PIXELFORMAT_RGBA8888,
+                                    SDL_TEXTUREACCESS_TARGET, l->bar.w,
+                                    l->bar.h);
+    if (!ui->bar_tex) return 0;
+    SDL_SetTextureBlendMode(ui->bar_tex, SDL_BLENDMODE_BLEND);
+  }
+
+  SDL_Texture *prev = SDL_GetRenderTarget(ui->ren);
+  if (SDL_SetRenderTarget(ui->ren, ui->bar_tex) != 0) return 0;
+
+  trace_begin("build_controls");
+  SDL_SetRenderDrawColor(ui->ren, 0, 0, 0, 0);
+  SDL_RenderClear(ui->ren);
+  ui_draw_bar_static(ui, l, -l->bar.x, -l->bar.y, paused, muted,
+                     SDL_BLENDMODE_NONE);
+  trace_end();
+
+  SDL_SetRenderTarget(ui->ren, prev);
+  ui->bar_paused = paused;
+  ui->bar_muted = muted;
+  return 1;
+}
+
+/* Fills rectangles of different colours in one draw call. */
+static void ui_fill_rects(SDL_Renderer *ren, const SDL_Rect *rects,
+                          const SDL_Color *colors, int count) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  SDL_Vertex verts[4 * 4];
+  int indices[6 * 4];
+  int nv = 0, ni = 0;
+  for (int i = 0; i < count && i < 4; ++i) {
+    const SDL_Rect *r = &rects[i];
+    if (r->w <= 0 || r->h <= 0) continue;
+
+    float x0 = (float)r->x, y0 = (float)r->y;
+    float x1 = (float)(r->x + r->w), y1 = (float)(r->y + r->h);
+    SDL_Vertex v = {{x0, y0}, colors[i], {0.0f, 0.0f}};
+    verts[nv + 0] = v;
+    v.position.x = x1;
+    verts[nv + 1] = v;
+    v.position.x = x0;
+    v.position.y = y1;
+    verts[nv + 2] = v;
+    v.position.x = x1;
+    verts[nv + 3] = v;
+
+    static const int quad[6] = {0, 1, 2, 2, 1, 3};
+    for (int k = 0; k < 6; ++k) indices[ni++] = nv + quad[k];
+    nv += 4;
+  }
+  if (nv > 0) SDL_RenderGeometry(ren, NULL, verts, nv, indices, ni);
+#else
+  for (int i = 0; i < count; ++i) {
+    SDL_Color c = colors[i];
+    SDL_SetRenderDrawColor(ren, c.r, c.g, c.b, c.a);
+    SDL_RenderFillRect(ren, &rects[i]);
+  }
+#endif
+}
+
+/* The time label changes once a second; keep its texture until then. */
+static void ui_draw_time_label(UiContext *ui, const char *text, int x,
+                               int y) {
+  if (!ui->time_tex || strcmp(ui->time_str, text) != 0) {
+    if (ui->time_tex) SDL_DestroyTexture(ui->time_tex);
+    ui->time_tex = NULL;
+
+    SDL_Surface *s =
+        TTF_RenderUTF8_Blended(ui->font_small, text, ui->pal->text_primary);
+    if (!s) return;
+    ui->time_tex = SDL_CreateTextureFromSurface(ui->ren, s);
+    ui->time_w = s->w;
+    ui->time_h = s->h;
+    SDL_FreeSurface(s);
+    if (!ui->time_tex) return;
+    snprintf(ui->time_str, sizeof(ui->time_str), "%s", text);
+  }
+
+  SDL_Rect r = {x, y, ui->time_w, ui->time_h};
+  SDL_RenderCopy(ui->ren, ui->time_tex, NULL, &r);
+}
+
+void ui_draw_player_controls(UiContext *ui, const UiPlayerLayout *l,
+                             const VideoState *vid, int paused, int muted) {
+  trace_begin("draw_controls");
+  const UiPalette *p = ui->pal;
+
+  double vol = video_get_volume(vid);
+  if (vol < 0.0) vol = 0.0;
+  if (vol > 1.0) vol = 1.0;
+  int muted_icon = muted || vol <= 0.001;
+
+  if (!ui->bar_valid || ui->bar_paused != paused ||
+      ui->bar_muted != muted_icon) {
+    ui->bar_valid = ui_build_bar_cache(ui, l, paused, muted_icon);
+  }
+
+  SDL_SetRenderDrawBlendMode(ui->ren, SDL_BLENDMODE_BLEND);
+  if (ui->bar_valid) {
+    SDL_RenderCopy(ui->ren, ui->bar_tex, NULL, &l->bar);
+  } else {
+    ui_draw_bar_static(ui, l, 0, 0, paused, muted_icon, SDL_BLENDMODE_BLEND);
+  }
+
+  int64_t dur = video_get_duration_ms(vid);
+  int64_t pos = video_get_position_ms(vid);
+  double r = 0.0;
+  if (dur > 0) {
+    r = (double)pos / (double)dur;
+    if (r < 0.0) r = 0.0;
+    if (r > 1.0) r = 1.0;
+  }
+
+  SDL_Rect fills[2] = {l->progress_bg, l->vol_bar};
+  fills[0].w = (int)(l->progress_bg.w * r);
+  fills[1].w = (int)(l->vol_bar.w * vol);
+  SDL_Color colors[2] = {p->row_selected_accent, p->scrollbar_handle};
+  colors[0].a = 255;
+  colors[1].a = 255;
+  ui_fill_rects(ui->ren, fills, colors, 2);
 
   if (ui->font_small && dur > 0) {
     char buf[64];
@@ -281,23 +446,56 @@ void ui_draw_player_controls(const UiContext *ui, const UiPlayerLayout *l,
     format_time_ms(pos, cur_str, sizeof(cur_str));
     format_time_ms(dur, dur_str, sizeof(dur_str));
 
-    snprintf(buf, sizeof(buf), "%s / %s", cur_str, dur_str);
-
-    SDL_Color col = p->text_primary;
-    SDL_Surface *s = TTF_RenderUTF8_Blended(ui->font_small, buf, col);
-    if (s) {
-      SDL_Texture *t = SDL_CreateTextureFromSurface(ui->ren, s);
-      SDL_Rect r = {l->progress_bg.x, l->bar.y + 6, s->w, s->h};
-      SDL_RenderCopy(ui->ren, t, NULL, &r);
-      SDL_DestroyTexture(t);
-      SDL_FreeSurface(s);
+    int rate = video_get_rate(vid);
+    if (rate != 1) {
+      snprintf(buf, sizeof(buf), "%s / %s  %+dx", cur_str, dur_str, rate);
+    } else {
+      snprintf(buf, sizeof(buf), "%s / %s", cur_str, dur_str);
     }
+    ui_draw_time_label(ui, buf, l->progress_bg.x, l->bar.y + 6);
   }
+  trace_end();
+}
+
+void ui_draw_loading(const UiContext *ui, const char *path,
+                     Uint32 elapsed_ms) {
+  if (!ui->font_regular) return;
+
+  const char *name = path ? strrchr(path, '/') : NULL;
+  name = name ? name + 1 : (path ? path : "");
+
+  /* A dot every 400 ms, so a stalled open still looks alive. */
+  static const char *const dots[] = {"", ".", "..", "..."};
+  char buf[512];
+  snprintf(buf, sizeof(buf), "Loading %s%s", name,
+           dots[(elapsed_ms / 400) % 4]);
+
+  SDL_Surface *s =
+      TTF_RenderUTF8_Blended(ui->font_regular, buf, ui->pal->text_primary);
+  if (!s) return;
+
+  int ww, wh;
+  SDL_GetRendererOutputSize(ui->ren, &ww, &wh);
+
+  SDL_Rect box = {(ww - s->w) / 2 - 20, (wh - s->h) / 2 - 12, s->w + 40,
+                  s->h + 24};
+  SDL_Color c = ui->pal->panel;
+  SDL_SetRenderDrawBlendMode(ui->ren, SDL_BLENDMODE_BLEND);
+  SDL_SetRenderDrawColor(ui->ren, c.r, c.g, c.b, c.a);
+  SDL_RenderFillRect(ui->ren, &box);
+
+  SDL_Texture *t = SDL_CreateTextureFromSurface(ui->ren, s);
+  SDL_Rect r = {box.x + 20, box.y + 12, s->w, s->h};
+  SDL_RenderCopy(ui->ren, t, NULL, &r);
+  SDL_DestroyTexture(t);
+  SDL_FreeSurface(s);
 }
 
 void ui_draw_browser(const UiContext *ui, const FileBrowser *b) {
   if (!b) return;
 
+  trace_begin("draw_browser");
+
   int ww, wh;
   SDL_GetRendererOutputSize(ui->ren, &ww, &wh);
 
@@ -463,23 +661,32 @@ void ui_draw_browser(const UiContext *ui, const FileBrowser *b) {
     }
   }
 
+  trace_end();
+
+  trace_begin("present");
   SDL_RenderPresent(ui->ren);
+  trace_end();
 }
 
 int ui_hit_test_rect(const SDL_Rect *r, int mx, int my) {
   return (mx >= r->x && mx < r->x + r->w && my >= r->y && my < r->y + r->h);
 }
 
+double ui_progress_ratio(const UiPlayerLayout *l, int mx) {
+  SDL_Rect bg = l->progress_bg;
+  double r = (double)(mx - bg.x) / (double)bg.w;
+  if (r < 0.0) r = 0.0;
+  if (r > 1.0) r = 1.0;
+  return r;
+}
+
 int ui_progress_hit_test(const UiPlayerLayout *l, int mx, int my,
                          double *ratio) {
   SDL_Rect bg = l->progress_bg;
   if (mx < bg.x || mx >= bg.x + bg.w || my < bg.y - 4 || my >= bg.y + bg.h + 4)
     return 0;
 
-  double r = (double)(mx - bg.x) / (double)bg.w;
-  if (r < 0.0) r = 0.0;
-  if (r > 1.0) r = 1.0;
-  if (ratio) *ratio = r;
+  if (ratio) *ratio = ui_progress_ratio(l, mx);
   return 1;
 }
 
@@ -10,117 +10,616 @@
 #include <string.h>
 
 #include "common.h"
+#include "config.h"
+#include "depth.h"
+#include "fileio.h"
+#include "framepool.h"
+#include "framesink.h"
+#include "gopcache.h"
+#include "probecache.h"
+#include "scrub.h"
+#include "trace.h"
 #include "video.h"
 
+/* Frames decoded unseen per video_step() while catching up to a seek,
+ * step or background resync target; the rest waits for the next calls so
+ * a long GOP never holds up the render thread for longer than a few
+ * frames' decode time. */
+#define VIDEO_RESYNC_FRAMES 8
+
+static void video_destroy_textures(VideoState *v) {
+  for (int i = 0; i < VIDEO_TEX_RING; ++i) {
+    if (v->tex_ring[i]) SDL_DestroyTexture(v->tex_ring[i]);
+    v->tex_ring[i] = NULL;
+  }
+  v->tex = NULL;
+}
+
+/* Drops everything tied to the current file. Decoders, converters, textures
+ * and the audio device are kept so the next file can reuse them. */
+static void video_release_input(VideoState *v) {
+  if (v->fmt && v->vdec) {
+    FramePoolStats ps;
+    framepool_get_stats(&ps);
+    fprintf(stderr,
+            "framepool: %llu hits, %llu misses for this file; %.1f MiB "
+            "resident in %d pools for the process\n",
+            (unsigned long long)(ps.hits - v->pool_hits),
+            (unsigned long long)(ps.misses - v->pool_misses),
+            (double)ps.resident_bytes / (1024.0 * 1024.0), ps.pools);
+  }
+  if (v->seeks > 0) {
+    fprintf(stderr,
+            "video: %d seeks, seek-to-display avg %.1f ms max %.1f ms\n",
+            v->seeks, v->seek_total_ms / v->seeks, v->seek_max_ms);
+  }
+  if (v->degrade.changes > 0) {
+    Uint32 ms[DEGRADE_MAX_LEVEL + 1];
+    degrade_totals(&v->degrade, SDL_GetTicks(), ms);
+    fprintf(stderr, "video: %d quality changes, seconds per level:",
+            v->degrade.changes);
+    for (int i = 0; i <= DEGRADE_MAX_LEVEL; ++i) {
+      fprintf(stderr, " %d:%.1f", i, ms[i] / 1000.0);
+    }
+    fprintf(stderr, "\n");
+  }
+  if (v->bg_skipped > 0) {
+    fprintf(stderr, "video: %llu packets skipped in the background\n",
+            (unsigned long long)v->bg_skipped);
+  }
+  v->degrade.changes = 0;
+  v->bg_skipped = 0;
+  v->background = 0;
+  v->seeks = 0;
+  v->seek_total_ms = 0.0;
+  v->seek_max_ms = 0.0;
+  v->seek_start = 0;
+  gopcache_close(v->gop);
+  v->gop = NULL;
+  v->stepped = 0;
+  scrub_close(v->scrub);
+  v->scrub = NULL;
+  v->scrubbing = 0;
+  if (v->fmt) avformat_close_input(&v->fmt);
+  if (v->io) fileio_close(v->io);
+  v->io = NULL;
+  free(v->path);
+  v->path = NULL;
+  if (v->pkt) av_packet_unref(v->pkt);
+  if (v->vframe) av_frame_unref(v->vframe);
+  v->vst = NULL;
+  v->ast = NULL;
+  v->v_stream_index = -1;
+  v->a_stream_index = -1;
+}
+
+static void video_free_audio(VideoState *v) {
+  if (v->swr) swr_free(&v->swr);
+  if (v->adec) avcodec_free_context(&v->adec);
+  if (v->apar) avcodec_parameters_free(&v->apar);
+  if (v->aframe) av_frame_free(&v->aframe);
+}
+
 static void video_internal_close(VideoState *v) {
   if (!v) return;
 
-  if (v->tex) SDL_DestroyTexture(v->tex);
-  if (v->sws) sws_freeContext(v->sws);
-  if (v->swr) swr_free(&v->swr);
+  video_release_input(v);
+  video_destroy_textures(v);
+  scaler_free(&v->scaler);
+  video_free_audio(v);
   if (v->vdec) avcodec_free_context(&v->vdec);
-  if (v->adec) avcodec_free_context(&v->adec);
-  if (v->fmt) avformat_close_input(&v->fmt);
+  if (v->vpar) avcodec_parameters_free(&v->vpar);
   if (v->vframe) av_frame_free(&v->vframe);
+  if (v->step_frame) av_frame_free(&v->step_frame);
+  if (v->depth_frame) av_frame_free(&v->depth_frame);
   if (v->yuv) av_frame_free(&v->yuv);
   if (v->yuv_buf) av_free(v->yuv_buf);
-  if (v->aframe) av_frame_free(&v->aframe);
   if (v->pkt) av_packet_free(&v->pkt);
-  if (v->audio_dev) SDL_CloseAudioDevice(v->audio_dev);
+  audio_out_clear(v->audio);
 
   memset(v, 0, sizeof(*v));
 }
 
 void video_close(VideoState *v) { video_internal_close(v); }
 
-int video_open(VideoState *v, SDL_Renderer *ren, const char *path) {
-  video_internal_close(v);
-  memset(v, 0, sizeof(*v));
-  v->v_stream_index = -1;
-  v->a_stream_index = -1;
-  v->volume = 1.0;
+static void video_fit_size(int src_w, int src_h, int max_w, int max_h,
+                           int *out_w, int *out_h) {
+  *out_w = src_w;
+  *out_h = src_h;
+  if (max_w <= 0 || max_h <= 0) return;
+  if (src_w <= max_w && src_h <= max_h) return;
 
-  if (avformat_open_input(&v->fmt, path, NULL, NULL) < 0) {
-    fprintf(stderr, "video: cannot open '%s'\n", path);
+  double sx = (double)max_w / src_w;
+  double sy = (double)max_h / src_h;
+  double sc = sx < sy ? sx : sy;
+  *out_w = (int)(src_w * sc) & ~1;
+  *out_h = (int)(src_h * sc) & ~1;
+  if (*out_w < 2) *out_w = 2;
+  if (*out_h < 2) *out_h = 2;
+}
+
+int video_pick_lowres(const AVCodec *codec, int w, int h, int min_w,
+                      int min_h) {
+  if (codec->max_lowres <= 0 || w <= 0 || h <= 0) return 0;
+
+  int lowres = 0;
+  while (lowres < codec->max_lowres && (w >> (lowres + 1)) >= min_w &&
+         (h >> (lowres + 1)) >= min_h) {
+    lowres++;
+  }
+  return lowres;
+}
+
+/* Never decode below what the screen could show in fullscreen. */
+static int video_screen_lowres(const AVCodec *codec, int w, int h) {
+  SDL_DisplayMode mode;
+  if (SDL_GetDesktopDisplayMode(0, &mode) != 0) return 0;
+  return video_pick_lowres(codec, w, h, mode.w, mode.h);
+}
+
+/* Native-endian packed formats, so both sides agree on the byte order. */
+static int video_av_format_for(Uint32 sdl_fmt) {
+  switch (sdl_fmt) {
+    case SDL_PIXELFORMAT_ARGB8888:
+      return AV_PIX_FMT_RGB32;
+    case SDL_PIXELFORMAT_RGB888:
+      return AV_PIX_FMT_0RGB32;
+    case SDL_PIXELFORMAT_ABGR8888:
+      return AV_PIX_FMT_BGR32;
+    case SDL_PIXELFORMAT_BGR888:
+      return AV_PIX_FMT_0BGR32;
+    case SDL_PIXELFORMAT_RGB565:
+      return AV_PIX_FMT_RGB565;
+    default:
+      return AV_PIX_FMT_NONE;
+  }
+}
+
+static void video_pick_output_format(VideoState *v, SDL_Renderer *ren) {
+  v->software = 0;
+  v->tex_format = SDL_PIXELFORMAT_YV12;
+  v->dst_fmt = AV_PIX_FMT_YUV420P;
+
+  SDL_RendererInfo info;
+  if (!player_config()->sw_fast_path || SDL_GetRendererInfo(ren, &info) != 0 ||
+      !(info.flags & SDL_RENDERER_SOFTWARE))
+    return;
+
+  Uint32 fmt = SDL_PIXELFORMAT_ARGB8888;
+  SDL_Window *win = SDL_RenderGetWindow(ren);
+  if (win && video_av_format_for(SDL_GetWindowPixelFormat(win)) !=
+                 AV_PIX_FMT_NONE) {
+    fmt = SDL_GetWindowPixelFormat(win);
+  }
+
+  v->software = 1;
+  v->tex_format = fmt;
+  v->dst_fmt = video_av_format_for(fmt);
+}
+
+/* The size ui_draw_video() shows a `src_w` x `src_h` frame at. */
+static void video_letterbox_size(int src_w, int src_h, int max_w, int max_h,
+                                 int *out_w, int *out_h) {
+  *out_w = src_w;
+  *out_h = src_h;
+  if (max_w <= 0 || max_h <= 0) return;
+
+  double sx = (double)max_w / src_w;
+  double sy = (double)max_h / src_h;
+  double sc = sx < sy ? sx : sy;
+  *out_w = (int)(src_w * sc);
+  *out_h = (int)(src_h * sc);
+  if (*out_w < 2) *out_w = 2;
+  if (*out_h < 2) *out_h = 2;
+}
+
+static int video_alloc_output(VideoState *v, SDL_Renderer *ren, int w,
+                              int h) {
+  SDL_Texture *ring[VIDEO_TEX_RING] = {NULL};
+  for (int i = 0; i < VIDEO_TEX_RING; ++i) {
+    ring[i] = SDL_CreateTexture(ren, v->tex_format,
+                                SDL_TEXTUREACCESS_STREAMING, w, h);
+    if (!ring[i]) {
+      fprintf(stderr, "video: SDL_CreateTexture failed: %s\n",
+              SDL_GetError());
+      for (int j = 0; j < i; ++j) SDL_DestroyTexture(ring[j]);
+      return 0;
+    }
+  }
+
+  int size = av_image_get_buffer_size(v->dst_fmt, w, h, 1);
+  uint8_t *buf = (uint8_t *)av_malloc(size);
+  if (!buf) {
+    for (int i = 0; i < VIDEO_TEX_RING; ++i) SDL_DestroyTexture(ring[i]);
     return 0;
   }
-  if (avformat_find_stream_info(v->fmt, NULL) < 0) {
-    fprintf(stderr, "video: cannot find stream info\n");
-    video_internal_close(v);
+
+  video_destroy_textures(v);
+  if (v->yuv_buf) av_free(v->yuv_buf);
+  memcpy(v->tex_ring, ring, sizeof(ring));
+  v->tex_index = 0;
+  v->tex = ring[0];
+  v->tex_w = w;
+  v->tex_h = h;
+  v->yuv_buf = buf;
+  v->yuv_buf_size = size;
+  av_image_fill_arrays(v->yuv->data, v->yuv->linesize, v->yuv_buf,
+                       v->dst_fmt, w, h, 1);
+  return 1;
+}
+
+/* Recreate the texture once the requested output size has been stable for
+ * VIDEO_RESIZE_DEBOUNCE_MS, so a window drag does not churn allocations. */
+static void video_apply_output_size(VideoState *v, SDL_Renderer *ren,
+                                    Uint32 now) {
+  if (v->out_w <= 0 || v->out_h <= 0) return;
+  if (v->out_w == v->tex_w && v->out_h == v->tex_h) return;
+  if ((int)(now - v->out_changed_ticks) < VIDEO_RESIZE_DEBOUNCE_MS) return;
+
+  if (!video_alloc_output(v, ren, v->out_w, v->out_h)) {
+    v->out_w = v->tex_w;
+    v->out_h = v->tex_h;
+  }
+}
+
+/* Whether a context opened for `a` can decode a stream described by `b`
+ * after a flush, without being reopened. */
+static int video_params_match(const AVCodecParameters *a,
+                              const AVCodecParameters *b) {
+  if (!a || !b) return 0;
+  if (a->codec_type != b->codec_type || a->codec_id != b->codec_id) return 0;
+  if (a->format != b->format || a->profile != b->profile) return 0;
+  if (a->width != b->width || a->height != b->height) return 0;
+  if (a->sample_rate != b->sample_rate || a->channels != b->channels ||
+      a->channel_layout != b->channel_layout ||
+      a->block_align != b->block_align ||
+      a->bits_per_coded_sample != b->bits_per_coded_sample)
     return 0;
+  if (a->extradata_size != b->extradata_size) return 0;
+  return a->extradata_size == 0 ||
+         memcmp(a->extradata, b->extradata, (size_t)a->extradata_size) == 0;
+}
+
+static int video_setup_decoder(VideoState *v) {
+  AVCodecParameters *par = v->vst->codecpar;
+
+  if (v->vdec && video_params_match(v->vpar, par)) {
+    avcodec_flush_buffers(v->vdec);
+    v->reused |= VIDEO_REUSED_DECODER;
+    return 1;
   }
 
-  int si = av_find_best_stream(v->fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-  if (si < 0) {
-    fprintf(stderr, "video: no video stream\n");
-    video_internal_close(v);
+  if (v->vdec) avcodec_free_context(&v->vdec);
+  if (!v->vpar) v->vpar = avcodec_parameters_alloc();
+  if (!v->vpar) return 0;
+
+  const AVCodec *codec = avcodec_find_decoder(par->codec_id);
+  if (!codec) {
+    fprintf(stderr, "video: decoder not found\n");
     return 0;
   }
-  v->vst = v->fmt->streams[si];
-  v->v_stream_index = si;
+  v->vdec = avcodec_alloc_context3(codec);
+  if (!v->vdec || avcodec_parameters_to_context(v->vdec, par) < 0) {
+    fprintf(stderr, "video: failed to open decoder\n");
+    return 0;
+  }
+  v->vdec->lowres = video_screen_lowres(codec, par->width, par->height);
+  framepool_attach(v->vdec, player_config()->huge_pages);
+  if (avcodec_open2(v->vdec, codec, NULL) < 0 ||
+      avcodec_parameters_copy(v->vpar, par) < 0) {
+    fprintf(stderr, "video: failed to open decoder\n");
+    return 0;
+  }
+  return 1;
+}
+
+/* Audio is optional: without an output device, or on any failure, the file
+ * plays silently. */
+static void video_setup_audio(VideoState *v) {
+  audio_out_clear(v->audio);
+
+  int ai = av_find_best_stream(v->fmt, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+  if (ai < 0 || !audio_out_is_open(v->audio)) {
+    video_free_audio(v);
+    return;
+  }
+  v->ast = v->fmt->streams[ai];
+  v->a_stream_index = ai;
+
+  AVCodecParameters *apar = v->ast->codecpar;
+  if (v->adec && v->swr && video_params_match(v->apar, apar) &&
+      swr_init(v->swr) >= 0) {
+    avcodec_flush_buffers(v->adec);
+    v->reused |= VIDEO_REUSED_AUDIO;
+    return;
+  }
+
+  video_free_audio(v);
+
+  const AVCodec *acodec = avcodec_find_decoder(apar->codec_id);
+  if (!acodec) return;
+
+  v->adec = avcodec_alloc_context3(acodec);
+  v->apar = avcodec_parameters_alloc();
+  if (!v->adec || !v->apar ||
+      avcodec_parameters_to_context(v->adec, apar) < 0 ||
+      avcodec_open2(v->adec, acodec, NULL) < 0 ||
+      avcodec_parameters_copy(v->apar, apar) < 0) {
+    video_free_audio(v);
+    return;
+  }
+
+  int64_t in_ch_layout = v->adec->channel_layout;
+  if (!in_ch_layout) {
+    in_ch_layout = av_get_default_channel_layout(v->adec->channels);
+  }
+  int64_t out_ch_layout =
+      (v->audio->channels == 1) ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO;
 
-  {
-    AVCodecParameters *par = v->vst->codecpar;
-    const AVCodec *codec = avcodec_find_decoder(par->codec_id);
-    if (!codec) {
-      fprintf(stderr, "video: decoder not found\n");
-      video_internal_close(v);
+  v->swr = swr_alloc_set_opts(NULL, out_ch_layout, AV_SAMPLE_FMT_S16,
+                              v->audio->sample_rate, in_ch_layout,
+                              v->adec->sample_fmt, v->adec->sample_rate, 0,
+                              NULL);
+  v->aframe = av_frame_alloc();
+  if (!v->swr || swr_init(v->swr) < 0 || !v->aframe) video_free_audio(v);
+}
+
+/* Whether probing filled in what the decoders and converters need. */
+static int video_streams_known(const AVFormatContext *fmt) {
+  for (unsigned i = 0; i < fmt->nb_streams; ++i) {
+    const AVCodecParameters *par = fmt->streams[i]->codecpar;
+    if (par->codec_id == AV_CODEC_ID_NONE) continue;
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+        (par->width <= 0 || par->height <= 0 || par->format < 0))
       return 0;
-    }
-    v->vdec = avcodec_alloc_context3(codec);
-    if (!v->vdec || avcodec_parameters_to_context(v->vdec, par) < 0 ||
-        avcodec_open2(v->vdec, codec, NULL) < 0) {
-      fprintf(stderr, "video: failed to open decoder\n");
-      video_internal_close(v);
+    if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+        (par->sample_rate <= 0 || par->channels <= 0 || par->format < 0))
+      return 0;
+  }
+  return 1;
+}
+
+static double video_elapsed_ms(Uint64 since) {
+  return (double)(SDL_GetPerformanceCounter() - since) * 1000.0 /
+         (double)SDL_GetPerformanceFrequency();
+}
+
+/* One open attempt. With `fast` set the demuxer probes less and a cached
+ * analysis of the same file is used when there is one. Returns 1 on
+ * success, -1 when fast probing left stream parameters unknown, 0 on
+ * error. */
+static int video_input_try(VideoInput *in, const char *path, int fast,
+                           int flags, int (*interrupt)(void *), void *opaque,
+                           double *header_ms, double *streams_ms,
+                           const char **how) {
+  const PlayerConfig *cfg = player_config();
+  IoMode mode = cfg->io_mode;
+  if ((flags & VIDEO_INPUT_NO_PREFETCH) && mode == IO_MODE_PREFETCH)
+    mode = IO_MODE_PREAD;
+  in->io = fileio_open(path, mode, (size_t)cfg->io_buffer_kb * 1024,
+                       (size_t)cfg->io_prefetch_mb * 1024 * 1024);
+  in->fmt = avformat_alloc_context();
+  if (!in->fmt) return 0;
+  if (in->io) {
+    in->fmt->pb = fileio_avio(in->io);
+    in->fmt->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+  in->fmt->interrupt_callback.callback = interrupt;
+  in->fmt->interrupt_callback.opaque = opaque;
+  if (fast) {
+    in->fmt->probesize = (int64_t)cfg->probe_kb * 1024;
+    in->fmt->max_analyze_duration =
+        (int64_t)cfg->analyze_ms * (AV_TIME_BASE / 1000);
+  }
+
+  Uint64 t = SDL_GetPerformanceCounter();
+  if (avformat_open_input(&in->fmt, path, NULL, NULL) < 0) {
+    fprintf(stderr, "video: cannot open '%s'\n", path);
+    return 0;
+  }
+  *header_ms += video_elapsed_ms(t);
+
+  t = SDL_GetPerformanceCounter();
+  if (fast && probecache_lookup(path, in->fmt)) {
+    *how = "cached";
+  } else {
+    if (avformat_find_stream_info(in->fmt, NULL) < 0) {
+      fprintf(stderr, "video: cannot find stream info\n");
       return 0;
     }
+    if (!video_streams_known(in->fmt)) {
+      if (fast) {
+        *streams_ms += video_elapsed_ms(t);
+        return -1;
+      }
+    } else if (cfg->fast_open) {
+      probecache_store(path, in->fmt);
+    }
   }
+  *streams_ms += video_elapsed_ms(t);
+  return 1;
+}
 
-  v->vframe = av_frame_alloc();
-  v->pkt = av_packet_alloc();
-  if (!v->vframe || !v->pkt) {
-    video_internal_close(v);
+int video_input_open(VideoInput *in, const char *path, int flags,
+                     int (*interrupt)(void *), void *opaque) {
+  memset(in, 0, sizeof(*in));
+  Uint64 start = SDL_GetPerformanceCounter();
+
+  int fast = player_config()->fast_open;
+  const char *how = fast ? "fast" : "full";
+  double header_ms = 0.0, streams_ms = 0.0;
+
+  int ret = video_input_try(in, path, fast, flags, interrupt, opaque,
+                            &header_ms, &streams_ms, &how);
+  if (ret < 0) {
+    video_input_close(in);
+    how = "fast, then full";
+    ret = video_input_try(in, path, 0, flags, interrupt, opaque, &header_ms,
+                          &streams_ms, &how);
+  }
+  if (ret <= 0) {
+    video_input_close(in);
+    return 0;
+  }
+
+  in->path = str_dupe(path);
+  if (!in->path) {
+    video_input_close(in);
     return 0;
   }
 
-  v->tex_w = v->vdec->width;
-  v->tex_h = v->vdec->height;
-  if (v->tex_w <= 0 || v->tex_h <= 0) {
-    v->tex_w = 640;
-    v->tex_h = 360;
+  /* The callback's owner may be gone by the time playback reads. */
+  in->fmt->interrupt_callback.callback = NULL;
+  in->fmt->interrupt_callback.opaque = NULL;
+  in->open_start = start;
+
+  fprintf(stderr,
+          "video: opened in %.1f ms (header %.1f ms, streams %.1f ms, %s)\n",
+          video_elapsed_ms(start), header_ms, streams_ms, how);
+  return 1;
+}
+
+void video_input_close(VideoInput *in) {
+  if (!in) return;
+  if (in->fmt) avformat_close_input(&in->fmt);
+  if (in->io) fileio_close(in->io);
+  free(in->path);
+  memset(in, 0, sizeof(*in));
+}
+
+AVCodecContext *video_open_worker_decoder(VideoInput *in, const char *path,
+                                          int stream_index, int lowres,
+                                          int flags, int (*interrupt)(void *),
+                                          void *opaque) {
+  if (!video_input_open(in, path, VIDEO_INPUT_NO_PREFETCH, interrupt, opaque))
+    return NULL;
+  if (stream_index >= (int)in->fmt->nb_streams) return NULL;
+
+  for (unsigned i = 0; i < in->fmt->nb_streams; ++i) {
+    if ((int)i != stream_index) in->fmt->streams[i]->discard = AVDISCARD_ALL;
+  }
+
+  AVCodecParameters *par = in->fmt->streams[stream_index]->codecpar;
+  const AVCodec *codec = avcodec_find_decoder(par->codec_id);
+  if (!codec) return NULL;
+
+  AVCodecContext *dec = avcodec_alloc_context3(codec);
+  if (!dec || avcodec_parameters_to_context(dec, par) < 0) {
+    avcodec_free_context(&dec);
+    return NULL;
+  }
+  dec->lowres = lowres;
+  dec->thread_count = 0;
+  if (flags & VIDEO_WORKER_KEYFRAMES) dec->skip_frame = AVDISCARD_NONKEY;
+  if (flags & VIDEO_WORKER_LOW_DELAY) dec->thread_type = FF_THREAD_SLICE;
+  framepool_attach(dec, player_config()->huge_pages);
+  if (avcodec_open2(dec, codec, NULL) < 0) {
+    avcodec_free_context(&dec);
+    return NULL;
+  }
+  return dec;
+}
+
+static enum AVDiscard video_level_skip_frame(int level) {
+  return level >= 4 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+static enum AVDiscard video_normal_skip_frame(const VideoState *v) {
+  return video_level_skip_frame(v->degrade.level);
+}
+
+int video_apply_quality_level(AVCodecContext *dec, int level,
+                              int set_skip_frame) {
+  dec->skip_loop_filter = level >= 2   ? AVDISCARD_ALL
+                          : level >= 1 ? AVDISCARD_NONREF
+                                       : AVDISCARD_DEFAULT;
+  dec->skip_idct = level >= 3 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+  if (set_skip_frame) dec->skip_frame = video_level_skip_frame(level);
+  return level >= 3 ? SWS_FAST_BILINEAR : SWS_BILINEAR;
+}
+
+/* Configures the decoder and converter for the current quality level. */
+static void video_apply_quality(VideoState *v) {
+  /* Other rates choose their own skip_frame. */
+  v->sws_flags =
+      video_apply_quality_level(v->vdec, v->degrade.level, v->rate == 1);
+}
+
+static int video_open_internal(VideoState *v, SDL_Renderer *ren,
+                               AudioOut *audio, VideoInput *in) {
+  video_release_input(v);
+  v->path = in->path;
+  v->io = in->io;
+  v->fmt = in->fmt;
+  v->open_start = in->open_start;
+  memset(in, 0, sizeof(*in));
+
+  v->audio = audio;
+  v->first_frame_pending = 1;
+  v->reused = 0;
+  v->volume = 1.0;
+
+  FramePoolStats ps;
+  framepool_get_stats(&ps);
+  v->pool_hits = ps.hits;
+  v->pool_misses = ps.misses;
+
+  int si = av_find_best_stream(v->fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (si < 0) {
+    fprintf(stderr, "video: no video stream\n");
+    video_internal_close(v);
+    return 0;
   }
+  v->vst = v->fmt->streams[si];
+  v->v_stream_index = si;
 
-  v->tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_YV12,
-                             SDL_TEXTUREACCESS_STREAMING, v->tex_w, v->tex_h);
-  if (!v->tex) {
-    fprintf(stderr, "video: SDL_CreateTexture failed: %s\n", SDL_GetError());
+  if (!video_setup_decoder(v)) {
     video_internal_close(v);
     return 0;
   }
 
-  v->sws = sws_getContext(v->vdec->width, v->vdec->height, v->vdec->pix_fmt,
-                          v->tex_w, v->tex_h, AV_PIX_FMT_YUV420P, SWS_BILINEAR,
-                          NULL, NULL, NULL);
-  if (!v->sws) {
-    fprintf(stderr, "video: sws_getContext failed\n");
+  if (!v->vframe) v->vframe = av_frame_alloc();
+  if (!v->pkt) v->pkt = av_packet_alloc();
+  if (!v->yuv) v->yuv = av_frame_alloc();
+  if (!v->vframe || !v->pkt || !v->yuv) {
     video_internal_close(v);
     return 0;
   }
 
-  v->yuv = av_frame_alloc();
-  if (!v->yuv) {
+  v->src_w = v->vdec->width;
+  v->src_h = v->vdec->height;
+  if (v->src_w <= 0 || v->src_h <= 0) {
+    v->src_w = 640;
+    v->src_h = 360;
+  }
+
+  int ww = 0, wh = 0;
+  SDL_GetRendererOutputSize(ren, &ww, &wh);
+  video_pick_output_format(v, ren);
+  if (v->software) {
+    video_letterbox_size(v->src_w, v->src_h, ww, wh, &v->out_w, &v->out_h);
+  } else {
+    video_fit_size(v->src_w, v->src_h, ww, wh, &v->out_w, &v->out_h);
+  }
+  v->out_changed_ticks = 0;
+
+  /* The texture ring only depends on the output size and format; its last
+   * frame stays on screen until the new file produces one. */
+  if (v->tex && v->ren == ren && v->tex_w == v->out_w &&
+      v->tex_h == v->out_h) {
+    v->reused |= VIDEO_REUSED_TEXTURES;
+  } else if (!video_alloc_output(v, ren, v->out_w, v->out_h)) {
     video_internal_close(v);
     return 0;
   }
-  v->yuv_buf_size =
-      av_image_get_buffer_size(AV_PIX_FMT_YUV420P, v->tex_w, v->tex_h, 1);
-  v->yuv_buf = (uint8_t *)av_malloc(v->yuv_buf_size);
-  if (!v->yuv_buf) {
+  v->ren = ren;
+
+  if (!scaler_configure(&v->scaler, v->src_w, v->src_h, v->vdec->pix_fmt,
+                        v->tex_w, v->tex_h, v->dst_fmt, SWS_BILINEAR, 0)) {
+    fprintf(stderr, "video: unsupported pixel format\n");
     video_internal_close(v);
     return 0;
   }
-  av_image_fill_arrays(v->yuv->data, v->yuv->linesize, v->yuv_buf,
-                       AV_PIX_FMT_YUV420P, v->tex_w, v->tex_h, 1);
 
   v->duration_ms = 0;
   if (v->fmt->duration > 0 && v->fmt->duration != AV_NOPTS_VALUE) {
@@ -136,77 +635,86 @@ int video_open(VideoState *v, SDL_Renderer *ren, const char *path) {
     v->frame_ms = 40;
   }
 
-  v->a_stream_index = -1;
-  v->audio_dev = 0;
-  v->swr = NULL;
-  v->aframe = NULL;
-
-  int ai = av_find_best_stream(v->fmt, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
-  if (ai >= 0) {
-    v->ast = v->fmt->streams[ai];
-    v->a_stream_index = ai;
-
-    AVCodecParameters *apar = v->ast->codecpar;
-    const AVCodec *acodec = avcodec_find_decoder(apar->codec_id);
-    if (acodec) {
-      v->adec = avcodec_alloc_context3(acodec);
-      if (v->adec && avcodec_parameters_to_context(v->adec, apar) >= 0 &&
-          avcodec_open2(v->adec, acodec, NULL) >= 0) {
-        SDL_AudioSpec want, have;
-        SDL_zero(want);
-        want.freq = v->adec->sample_rate > 0 ? v->adec->sample_rate : 44100;
-        want.format = AUDIO_S16SYS;
-        want.channels = 2;
-        want.samples = 4096;
-        want.callback = NULL;
-
-        v->audio_dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
-        if (v->audio_dev) {
-          SDL_PauseAudioDevice(v->audio_dev, 0);
-          v->audio_sample_rate = have.freq;
-          v->audio_channels = have.channels;
-          v->audio_bytes_per_sample = SDL_AUDIO_BITSIZE(have.format) / 8;
-
-          int64_t in_ch_layout = v->adec->channel_layout;
-          if (!in_ch_layout) {
-            in_ch_layout = av_get_default_channel_layout(v->adec->channels);
-          }
-          int64_t out_ch_layout =
-              (have.channels == 1) ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO;
-
-          v->swr = swr_alloc_set_opts(
-              NULL, out_ch_layout, AV_SAMPLE_FMT_S16, have.freq, in_ch_layout,
-              v->adec->sample_fmt, v->adec->sample_rate, 0, NULL);
-          if (v->swr && swr_init(v->swr) >= 0) {
-            v->aframe = av_frame_alloc();
-          } else {
-            if (v->swr) swr_free(&v->swr);
-            SDL_CloseAudioDevice(v->audio_dev);
-            v->audio_dev = 0;
-            avcodec_free_context(&v->adec);
-            v->adec = NULL;
-          }
-        } else {
-          avcodec_free_context(&v->adec);
-          v->adec = NULL;
-        }
-      }
-    }
-  }
+  video_setup_audio(v);
 
-  v->last_ticks = SDL_GetTicks();
+  /* Due immediately, so the first frame is not held back by frame_ms. */
+  v->last_ticks = SDL_GetTicks() - (Uint32)v->frame_ms;
   v->cur_pts_ms = 0;
+  v->cur_pts = AV_NOPTS_VALUE;
+  v->resync_pts = AV_NOPTS_VALUE;
+  v->audio_end_ms = AV_NOPTS_VALUE;
+  v->audio_skip_ms = AV_NOPTS_VALUE;
+  v->rate = 1;
+  v->trick_held = 0;
+  degrade_reset(&v->degrade, SDL_GetTicks());
+  v->work_ms = 0.0;
+  video_apply_quality(v);
   v->eof = 0;
 
   return 1;
 }
 
+int video_open_input(VideoState *v, SDL_Renderer *ren, AudioOut *audio,
+                     VideoInput *in) {
+  trace_begin("open_decoders");
+  int ok = video_open_internal(v, ren, audio, in);
+  trace_end();
+  return ok;
+}
+
+int video_open(VideoState *v, SDL_Renderer *ren, AudioOut *audio,
+               const char *path) {
+  trace_begin("open");
+  VideoInput in;
+  int ok = video_input_open(&in, path, 0, NULL, NULL);
+  if (ok) {
+    ok = video_open_input(v, ren, audio, &in);
+  } else {
+    video_internal_close(v);
+  }
+  trace_end();
+  return ok;
+}
+
+void video_apply_gain(int16_t *samples, int count, double volume) {
+  for (int i = 0; i < count; ++i) {
+    int s = samples[i];
+    s = (int)(s * volume);
+    if (s < -32768) s = -32768;
+    if (s > 32767) s = 32767;
+    samples[i] = (int16_t)s;
+  }
+}
+
+/* Returns 0 for a frame that ends mostly before audio_skip_ms, and
+ * otherwise records where it ends. */
+static int video_audio_due(VideoState *v) {
+  int64_t pts = v->aframe->best_effort_timestamp;
+  if (pts == AV_NOPTS_VALUE || v->adec->sample_rate <= 0) {
+    v->audio_skip_ms = AV_NOPTS_VALUE;
+    return 1;
+  }
+
+  int64_t start = av_rescale_q(pts, v->ast->time_base, (AVRational){1, 1000});
+  int64_t dur =
+      (int64_t)v->aframe->nb_samples * 1000 / v->adec->sample_rate;
+  if (v->audio_skip_ms != AV_NOPTS_VALUE) {
+    if (start + dur / 2 < v->audio_skip_ms) return 0;
+    v->audio_skip_ms = AV_NOPTS_VALUE;
+  }
+  v->audio_end_ms = start + dur;
+  return 1;
+}
+
 static void video_queue_audio(VideoState *v) {
-  if (!v->adec || !v->swr || !v->audio_dev || !v->aframe) return;
+  if (!v->adec || !v->swr || !v->aframe || !audio_out_is_open(v->audio))
+    return;
+  if (v->rate != 1 || !video_audio_due(v)) return;
+
+  trace_begin("audio_queue");
 
-  int out_channels = v->audio_channels > 0 ? v->audio_channels : 2;
-  int out_rate =
-      v->audio_sample_rate > 0 ? v->audio_sample_rate : v->adec->sample_rate;
+  int out_channels = v->audio->channels;
+  int out_rate = v->audio->sample_rate;
 
   int out_samples = (int)av_rescale_rnd(
       swr_get_delay(v->swr, v->adec->sample_rate) + v->aframe->nb_samples,
@@ -215,7 +723,10 @@ static void video_queue_audio(VideoState *v) {
   uint8_t *out_buf = NULL;
   int ret = av_samples_alloc(&out_buf, NULL, out_channels, out_samples,
                              AV_SAMPLE_FMT_S16, 0);
-  if (ret < 0) return;
+  if (ret < 0) {
+    trace_end();
+    return;
+  }
 
   int conv =
       swr_convert(v->swr, &out_buf, out_samples,
@@ -224,58 +735,395 @@ static void video_queue_audio(VideoState *v) {
     int data_size = av_samples_get_buffer_size(NULL, out_channels, conv,
                                                AV_SAMPLE_FMT_S16, 1);
     if (data_size > 0) {
-      int16_t *samples = (int16_t *)out_buf;
-      int total = data_size / (int)sizeof(int16_t);
-      double vol = v->volume;
-      for (int i = 0; i < total; ++i) {
-        int s = samples[i];
-        s = (int)(s * vol);
-        if (s < -32768) s = -32768;
-        if (s > 32767) s = 32767;
-        samples[i] = (int16_t)s;
-      }
-      SDL_QueueAudio(v->audio_dev, out_buf, (Uint32)data_size);
+      video_apply_gain((int16_t *)out_buf, data_size / (int)sizeof(int16_t),
+                       v->volume);
+      audio_out_queue(v->audio, out_buf, (Uint32)data_size);
     }
   }
 
   av_freep(&out_buf);
+  trace_end();
+}
+
+static void video_decode_audio_packet(VideoState *v) {
+  trace_begin("audio_decode");
+  int ret = avcodec_send_packet(v->adec, v->pkt);
+  av_packet_unref(v->pkt);
+  trace_end();
+  if (ret < 0) return;
+
+  while (avcodec_receive_frame(v->adec, v->aframe) >= 0) {
+    video_queue_audio(v);
+    av_frame_unref(v->aframe);
+  }
 }
 
 static int video_decode_next(VideoState *v) {
   for (;;) {
+    trace_begin("demux");
     int ret = av_read_frame(v->fmt, v->pkt);
+    trace_end();
     if (ret < 0) {
       v->eof = 1;
       return ret;
     }
 
     if (v->pkt->stream_index == v->v_stream_index) {
+      trace_begin("decode");
       ret = avcodec_send_packet(v->vdec, v->pkt);
       av_packet_unref(v->pkt);
-      if (ret < 0) continue;
+      if (ret >= 0) ret = avcodec_receive_frame(v->vdec, v->vframe);
+      trace_end();
 
-      while ((ret = avcodec_receive_frame(v->vdec, v->vframe)) >= 0) {
+      if (ret >= 0) {
+        v->frames_decoded++;
         return 0;
       }
     } else if (v->adec && v->pkt->stream_index == v->a_stream_index) {
-      ret = avcodec_send_packet(v->adec, v->pkt);
+      video_decode_audio_packet(v);
+    } else {
       av_packet_unref(v->pkt);
-      if (ret < 0) continue;
+    }
+  }
+}
 
-      while ((ret = avcodec_receive_frame(v->adec, v->aframe)) >= 0) {
-        video_queue_audio(v);
-        av_frame_unref(v->aframe);
+/* Background playback: keeps the audio queue filled and drops video
+ * packets without decoding them. */
+static void video_step_background(VideoState *v) {
+  if (!v->adec) return;
+
+  while (audio_out_wants_data(v->audio)) {
+    trace_begin("demux");
+    int ret = av_read_frame(v->fmt, v->pkt);
+    trace_end();
+    if (ret < 0) {
+      v->eof = 1;
+      return;
+    }
+
+    if (v->pkt->stream_index == v->v_stream_index) {
+      if (v->pkt->pts != AV_NOPTS_VALUE) {
+        v->bg_video_ms = av_rescale_q(v->pkt->pts, v->vst->time_base,
+                                      (AVRational){1, 1000});
       }
+      v->bg_skipped++;
+      av_packet_unref(v->pkt);
+    } else if (v->pkt->stream_index == v->a_stream_index) {
+      video_decode_audio_packet(v);
     } else {
       av_packet_unref(v->pkt);
     }
   }
+
+  if (v->audio_end_ms != AV_NOPTS_VALUE) {
+    v->cur_pts_ms =
+        v->audio_end_ms - (int64_t)audio_out_latency_ms(v->audio);
+  } else if (v->bg_skipped > 0) {
+    v->cur_pts_ms = v->bg_video_ms;
+  }
+}
+
+/* Maps the YV12 staging memory of a locked texture as YUV420P planes. */
+static void video_locked_planes(const VideoState *v, uint8_t *pixels,
+                                int pitch, uint8_t *planes[4],
+                                int strides[4]) {
+  if (v->software) {
+    planes[0] = pixels;
+    planes[1] = planes[2] = planes[3] = NULL;
+    strides[0] = pitch;
+    strides[1] = strides[2] = strides[3] = 0;
+    return;
+  }
+
+  int cpitch = (pitch + 1) / 2;
+  int ch = (v->tex_h + 1) / 2;
+  uint8_t *vp = pixels + (size_t)pitch * v->tex_h;
+
+  planes[0] = pixels;
+  planes[1] = vp + (size_t)cpitch * ch;
+  planes[2] = vp;
+  planes[3] = NULL;
+  strides[0] = pitch;
+  strides[1] = cpitch;
+  strides[2] = cpitch;
+  strides[3] = 0;
+}
+
+/* Returns `f` reduced to 8-bit YUV420P in depth_frame, or `f` itself if
+ * that buffer cannot be allocated. */
+static const AVFrame *video_reduce_depth(VideoState *v, const AVFrame *f) {
+  AVFrame *d = v->depth_frame;
+  if (d && (d->width != f->width || d->height != f->height)) {
+    av_frame_free(&v->depth_frame);
+    d = NULL;
+  }
+  if (!d) {
+    d = av_frame_alloc();
+    if (!d) return f;
+    d->format = AV_PIX_FMT_YUV420P;
+    d->width = f->width;
+    d->height = f->height;
+    if (av_frame_get_buffer(d, 32) < 0) {
+      av_frame_free(&d);
+      return f;
+    }
+    v->depth_frame = d;
+  }
+
+  trace_begin("depth");
+  depth_convert(f, d->data, d->linesize);
+  trace_end();
+  return d;
+}
+
+static void video_convert(VideoState *v, const AVFrame *f, int direct,
+                          uint8_t *const planes[], const int strides[]) {
+  trace_begin("convert");
+  if (direct) {
+    depth_convert(f, planes, strides);
+  } else {
+    scaler_scale(&v->scaler, f, planes, strides);
+  }
+  trace_end();
+}
+
+/* Converts `f` into the next texture of the ring and makes it current.
+ * The converter writes straight into the locked texture memory; textures
+ * that cannot be locked fall back to yuv_buf + SDL_UpdateYUVTexture. */
+static void video_show_frame(VideoState *v, const AVFrame *f) {
+  /* 10-bit sources are reduced to 8 bits by the depth kernel: straight
+   * into the texture when no scaling is needed, otherwise into depth_frame
+   * so the converter only has to scale 8-bit planes. */
+  int direct = 0;
+  if (player_config()->hbd_fast_path && depth_supported(f->format)) {
+    direct = v->dst_fmt == AV_PIX_FMT_YUV420P && f->width == v->tex_w &&
+             f->height == v->tex_h;
+    if (!direct) f = video_reduce_depth(v, f);
+  }
+
+  if (!direct &&
+      !scaler_configure(&v->scaler, f->width, f->height, f->format, v->tex_w,
+                        v->tex_h, v->dst_fmt, v->sws_flags, 0))
+    return;
+
+  int next = (v->tex_index + 1) % VIDEO_TEX_RING;
+  SDL_Texture *tex = v->tex_ring[next];
+
+  void *pixels = NULL;
+  int pitch = 0;
+  if (SDL_LockTexture(tex, NULL, &pixels, &pitch) == 0) {
+    uint8_t *planes[4];
+    int strides[4];
+    video_locked_planes(v, (uint8_t *)pixels, pitch, planes, strides);
+
+    video_convert(v, f, direct, planes, strides);
+
+    trace_begin("upload");
+    SDL_UnlockTexture(tex);
+    trace_end();
+  } else {
+    video_convert(v, f, direct, v->yuv->data, v->yuv->linesize);
+
+    trace_begin("upload");
+    if (v->software) {
+      SDL_UpdateTexture(tex, NULL, v->yuv->data[0], v->yuv->linesize[0]);
+    } else {
+      SDL_UpdateYUVTexture(tex, NULL, v->yuv->data[0], v->yuv->linesize[0],
+                           v->yuv->data[1], v->yuv->linesize[1],
+                           v->yuv->data[2], v->yuv->linesize[2]);
+    }
+    trace_end();
+  }
+
+  v->tex_index = next;
+  v->tex = tex;
+}
+
+/* Time-to-first-frame, split by whether the decoder was carried over from
+ * the previous file. */
+static int g_ttff_count[2];
+static double g_ttff_total_ms[2];
+
+static void video_report_first_frame(VideoState *v) {
+  v->first_frame_pending = 0;
+
+  double ms = video_elapsed_ms(v->open_start);
+  v->first_frame_ms = ms;
+  int warm = (v->reused & VIDEO_REUSED_DECODER) != 0;
+  g_ttff_count[warm]++;
+  g_ttff_total_ms[warm] += ms;
+
+  fprintf(stderr,
+          "video: first frame after %.1f ms (reused:%s%s%s%s), average %.1f "
+          "ms over %d %s opens\n",
+          ms, v->reused ? "" : " none",
+          (v->reused & VIDEO_REUSED_DECODER) ? " decoder" : "",
+          (v->reused & VIDEO_REUSED_TEXTURES) ? " textures" : "",
+          (v->reused & VIDEO_REUSED_AUDIO) ? " audio" : "",
+          g_ttff_total_ms[warm] / g_ttff_count[warm], g_ttff_count[warm],
+          warm ? "same-format" : "cold");
+}
+
+/* Called when a frame is shown; completes a pending seek measurement. */
+static void video_count_seek(VideoState *v) {
+  if (!v->seek_start) return;
+  double ms = video_elapsed_ms(v->seek_start);
+  v->seeks++;
+  v->seek_total_ms += ms;
+  if (ms > v->seek_max_ms) v->seek_max_ms = ms;
+  v->seek_start = 0;
+}
+
+/* Presents the frame in `vframe` and makes it the current position. */
+static void video_present(VideoState *v, SDL_Renderer *ren, Uint32 now) {
+  video_apply_output_size(v, ren, now);
+
+  video_show_frame(v, v->vframe);
+  v->frames_shown++;
+  if (v->first_frame_pending) video_report_first_frame(v);
+  video_count_seek(v);
+
+  if (v->vframe->best_effort_timestamp != AV_NOPTS_VALUE) {
+    int64_t pts = v->vframe->best_effort_timestamp;
+    AVRational tb = v->vst->time_base;
+    int64_t ms = av_rescale_q(pts, tb, (AVRational){1, 1000});
+    v->cur_pts_ms = ms;
+    v->cur_pts = pts;
+  }
+  framesink_submit(v->vframe, v->cur_pts_ms);
+
+  v->last_ticks = now;
+}
+
+static int64_t video_frame_ms(const VideoState *v, const AVFrame *f) {
+  if (f->best_effort_timestamp == AV_NOPTS_VALUE) return v->trick_ms;
+  return av_rescale_q(f->best_effort_timestamp, v->vst->time_base,
+                      (AVRational){1, 1000});
+}
+
+/* Repositions the demuxer on the keyframe at or before `ms`, leaving audio
+ * and the shown position alone. */
+static int video_trick_seek(VideoState *v, int64_t ms) {
+  int64_t ts = av_rescale_q(ms, (AVRational){1, 1000}, v->vst->time_base);
+  if (av_seek_frame(v->fmt, v->v_stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0)
+    return 0;
+  avcodec_flush_buffers(v->vdec);
+  v->trick_held = 0;
+  v->eof = 0;
+  return 1;
+}
+
+static void video_trick_forward(VideoState *v, SDL_Renderer *ren,
+                                Uint32 now) {
+  while (!v->trick_held) {
+    if (video_decode_next(v) < 0) return;
+    /* Already shown; happens after the decoder was repositioned. */
+    int64_t pts = v->vframe->best_effort_timestamp;
+    if (v->cur_pts != AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE &&
+        pts <= v->cur_pts)
+      continue;
+    v->trick_held = 1;
+  }
+
+  int64_t ms = video_frame_ms(v, v->vframe);
+  if (ms > v->trick_ms) return;
+
+  /* Decoding cannot keep up with the clock; rather than racing ahead of
+   * what can be shown, let the clock restart from this frame. */
+  if (v->trick_ms - ms > (int64_t)v->rate * 250) v->trick_ms = ms;
+
+  video_present(v, ren, now);
+  v->trick_held = 0;
+}
+
+static void video_trick_reverse(VideoState *v, SDL_Renderer *ren,
+                                Uint32 now) {
+  if (v->trick_ms < 0) v->trick_ms = 0;
+
+  /* The shown keyframe is still the latest one at or before the clock. */
+  if (v->cur_pts != AV_NOPTS_VALUE && v->cur_pts_ms <= v->trick_ms) {
+    if (v->trick_ms == 0) video_set_rate(v, 1);
+    return;
+  }
+
+  trace_begin("trick_seek");
+  int ok = video_trick_seek(v, v->trick_ms) && video_decode_next(v) >= 0;
+  trace_end();
+  if (!ok) {
+    v->eof = 0;
+    video_set_rate(v, 1);
+    return;
+  }
+
+  video_present(v, ren, now);
+
+  /* No keyframe before the clock: this is as far back as it goes. */
+  if (v->cur_pts_ms > v->trick_ms) video_set_rate(v, 1);
+}
+
+/* Feeds the controller with the work behind the frame just shown: its
+ * decode, the audio decoded alongside, and the conversion. Frames decoded
+ * while catching up to a seek target say nothing about steady load. */
+static void video_update_quality(VideoState *v, Uint32 now,
+                                 int catching_up) {
+  double work_ms = v->work_ms;
+  v->work_ms = 0.0;
+  if (!player_config()->degrade || catching_up) return;
+
+  int prev = v->degrade.level;
+  Uint32 prev_ms = now - v->degrade.level_since;
+  if (degrade_update(&v->degrade, work_ms, v->frame_ms, now) < 0) return;
+
+  video_apply_quality(v);
+  fprintf(stderr,
+          "video: decode quality level %d (%s) after %.1f s at level %d, "
+          "load %.2f\n",
+          v->degrade.level, degrade_level_name(v->degrade.level),
+          prev_ms / 1000.0, prev, v->degrade.load);
+}
+
+static void video_trick_step(VideoState *v, SDL_Renderer *ren) {
+  Uint32 now = SDL_GetTicks();
+
+  /* Capped so a pause does not turn into a jump on resume. */
+  Uint32 dt = now - v->trick_ticks;
+  if (dt > 100) dt = 100;
+  v->trick_ms += (int64_t)v->rate * dt;
+  v->trick_ticks = now;
+
+  /* Frames are still shown at most at the source frame rate. */
+  if ((int)(now - v->last_ticks) < v->frame_ms) return;
+
+  if (v->rate > 0) {
+    video_trick_forward(v, ren, now);
+  } else {
+    video_trick_reverse(v, ren, now);
+  }
 }
 
 void video_step(VideoState *v, SDL_Renderer *ren) {
-  (void)ren;
   if (!v || !v->fmt || !v->vdec || !v->tex || v->eof) return;
 
+  if (v->rate != 1) {
+    video_trick_step(v, ren);
+    return;
+  }
+  if (v->background) {
+    video_step_background(v);
+    return;
+  }
+
+  /* Frame stepping moved the picture without the main demuxer; continue
+   * from the stepped-to frame rather than from where playback left off. */
+  if (v->stepped) {
+    int64_t pts = v->cur_pts;
+    v->stepped = 0;
+    int64_t ms = v->cur_pts_ms;
+    video_seek_ms(v, ms);
+    v->resync_pts = pts;
+    v->audio_skip_ms = ms;
+  }
+
   Uint32 now = SDL_GetTicks();
 
   int need_decode = 0;
@@ -284,40 +1132,41 @@ void video_step(VideoState *v, SDL_Renderer *ren) {
     need_decode = 1;
   }
 
-  if (v->audio_dev && v->audio_sample_rate > 0 && v->audio_channels > 0 &&
-      v->audio_bytes_per_sample > 0) {
-    Uint32 queued = SDL_GetQueuedAudioSize(v->audio_dev);
-
-    Uint32 low_limit = (Uint32)(v->audio_sample_rate * v->audio_channels *
-                                v->audio_bytes_per_sample / 4);
-
-    if (queued < low_limit) {
-      need_decode = 1;
-    }
+  if (v->adec && audio_out_wants_data(v->audio)) {
+    need_decode = 1;
   }
 
-  if (!need_decode) return;
+  int catching_up = v->resync_pts != AV_NOPTS_VALUE;
+  if (!need_decode && !catching_up) return;
 
-  if (video_decode_next(v) < 0) return;
+  Uint64 work_start = SDL_GetPerformanceCounter();
 
-  if ((int)(now - v->last_ticks) >= v->frame_ms) {
-    sws_scale(v->sws, (const uint8_t *const *)v->vframe->data,
-              v->vframe->linesize, 0, v->vdec->height, v->yuv->data,
-              v->yuv->linesize);
-
-    SDL_UpdateYUVTexture(v->tex, NULL, v->yuv->data[0], v->yuv->linesize[0],
-                         v->yuv->data[1], v->yuv->linesize[1], v->yuv->data[2],
-                         v->yuv->linesize[2]);
-
-    if (v->vframe->best_effort_timestamp != AV_NOPTS_VALUE) {
-      int64_t pts = v->vframe->best_effort_timestamp;
-      AVRational tb = v->vst->time_base;
-      int64_t ms = av_rescale_q(pts, tb, (AVRational){1, 1000});
-      v->cur_pts_ms = ms;
+  for (int n = 0;; ++n) {
+    if (video_decode_next(v) < 0) return;
+    if (v->resync_pts == AV_NOPTS_VALUE) break;
+
+    int64_t pts = v->vframe->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE || pts >= v->resync_pts) {
+      v->resync_pts = AV_NOPTS_VALUE;
+      break;
+    }
+    /* The previous picture stays up until the target is reached. */
+    if (n + 1 >= VIDEO_RESYNC_FRAMES) {
+      v->work_ms += video_elapsed_ms(work_start);
+      return;
     }
+  }
 
-    v->last_ticks = now;
+  int shown = 0;
+  if ((int)(now - v->last_ticks) >= v->frame_ms) {
+    if ((int)(now - v->last_ticks) >= 2 * v->frame_ms && !v->seek_start)
+      v->frames_late++;
+    video_present(v, ren, now);
+    shown = 1;
   }
+
+  v->work_ms += video_elapsed_ms(work_start);
+  if (shown) video_update_quality(v, now, catching_up);
 }
 
 void video_seek_ms(VideoState *v, int64_t target_ms) {
@@ -332,13 +1181,224 @@ void video_seek_ms(VideoState *v, int64_t target_ms) {
   if (av_seek_frame(v->fmt, v->v_stream_index, ts, AVSEEK_FLAG_BACKWARD) >= 0) {
     avcodec_flush_buffers(v->vdec);
     if (v->adec) avcodec_flush_buffers(v->adec);
-    if (v->audio_dev) SDL_ClearQueuedAudio(v->audio_dev);
+    audio_out_clear(v->audio);
     v->cur_pts_ms = target_ms;
-    v->last_ticks = SDL_GetTicks();
+    v->cur_pts = ts;
+    v->resync_pts = AV_NOPTS_VALUE;
+    v->audio_end_ms = AV_NOPTS_VALUE;
+    v->audio_skip_ms = AV_NOPTS_VALUE;
+    v->stepped = 0;
+    v->last_ticks = SDL_GetTicks() - (Uint32)v->frame_ms;
+    v->seek_start = SDL_GetPerformanceCounter();
+    v->eof = 0;
+  }
+}
+
+void video_seek_exact_ms(VideoState *v, int64_t target_ms) {
+  video_seek_ms(v, target_ms);
+  if (v && v->seek_start) {
+    v->resync_pts = v->cur_pts;
+    v->audio_skip_ms = v->cur_pts_ms;
+  }
+}
+
+void video_set_background(VideoState *v, int on) {
+  if (!v || !v->fmt || !v->vst || !v->vdec) return;
+  on = on != 0;
+  if (on == v->background) return;
+
+  if (on) {
+    /* Leave trick-play or a frame step at a position audio can follow. */
+    video_set_rate(v, 1);
+    if (v->stepped) video_seek_ms(v, v->cur_pts_ms);
+    v->stepped = 0;
+    v->bg_video_ms = v->cur_pts_ms;
+    v->bg_mark = v->bg_skipped;
+    v->background = 1;
+    return;
+  }
+
+  v->background = 0;
+  /* Nothing was demuxed past the last shown frame. */
+  if (v->bg_skipped == v->bg_mark) return;
+
+  /* Video restarts from the keyframe before what is being heard and is
+   * decoded up to it unseen; the demuxer rereads audio that is already
+   * queued, which audio_skip_ms drops. */
+  int64_t ms = v->cur_pts_ms;
+  int64_t ts = av_rescale_q(ms, (AVRational){1, 1000}, v->vst->time_base);
+  if (av_seek_frame(v->fmt, v->v_stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0)
+    return;
+  avcodec_flush_buffers(v->vdec);
+  if (v->adec) avcodec_flush_buffers(v->adec);
+  v->cur_pts = ts;
+  v->resync_pts = ts;
+  v->audio_skip_ms = v->audio_end_ms;
+  v->last_ticks = SDL_GetTicks() - (Uint32)v->frame_ms;
+  v->eof = 0;
+}
+
+void video_scrub(VideoState *v, int64_t target_ms) {
+  if (!v || !v->fmt || !v->vst || !v->vdec || !v->path) return;
+
+  if (!v->scrubbing) {
+    video_set_rate(v, 1);
+    audio_out_clear(v->audio);
+    v->scrubbing = 1;
+  }
+  if (!v->scrub) {
+    v->scrub = scrub_open(v->path, v->v_stream_index, v->vdec->lowres);
+  }
+
+  if (target_ms < 0) target_ms = 0;
+  if (v->duration_ms > 0 && target_ms > v->duration_ms)
+    target_ms = v->duration_ms;
+  /* The bar follows the pointer; the picture follows the worker. */
+  v->cur_pts_ms = target_ms;
+  scrub_request(v->scrub, av_rescale_q(target_ms, (AVRational){1, 1000},
+                                       v->vst->time_base));
+}
+
+int video_scrub_update(VideoState *v, SDL_Renderer *ren) {
+  if (!v || !v->scrub || !v->tex) return 0;
+  if (!v->step_frame) v->step_frame = av_frame_alloc();
+  if (!v->step_frame || !scrub_take(v->scrub, v->step_frame)) return 0;
+
+  video_apply_output_size(v, ren, SDL_GetTicks());
+  video_show_frame(v, v->step_frame);
+  av_frame_unref(v->step_frame);
+  return 1;
+}
+
+void video_scrub_end(VideoState *v, int64_t target_ms) {
+  if (!v) return;
+  v->scrubbing = 0;
+  video_seek_exact_ms(v, target_ms);
+}
+
+int video_step_frame(VideoState *v, SDL_Renderer *ren, int dir) {
+  if (!v || !v->fmt || !v->vst || !v->tex || !v->path) return -1;
+
+  if (!v->gop) {
+    size_t budget = (size_t)player_config()->gop_cache_mb * 1024 * 1024;
+    v->gop = gopcache_open(v->path, v->v_stream_index, v->vdec->lowres,
+                           budget);
+    if (!v->gop) return -1;
+  }
+  if (!v->step_frame) v->step_frame = av_frame_alloc();
+  if (!v->step_frame) return -1;
+
+  int64_t at = v->cur_pts;
+  if (at == AV_NOPTS_VALUE) {
+    at = v->vst->start_time != AV_NOPTS_VALUE ? v->vst->start_time : 0;
+    dir = 0;
+  }
+
+  trace_begin("step_frame");
+  int ret = gopcache_find(v->gop, at, dir, v->step_frame);
+  if (ret == GOPCACHE_HIT) {
+    Uint32 now = SDL_GetTicks();
+    video_apply_output_size(v, ren, now);
+    video_show_frame(v, v->step_frame);
+    video_count_seek(v);
+
+    v->cur_pts = v->step_frame->pts;
+    v->cur_pts_ms =
+        av_rescale_q(v->cur_pts, v->vst->time_base, (AVRational){1, 1000});
+    framesink_submit(v->step_frame, v->cur_pts_ms);
+    v->last_ticks = now;
+    v->stepped = 1;
     v->eof = 0;
+    av_frame_unref(v->step_frame);
+  }
+  trace_end();
+
+  if (ret == GOPCACHE_HIT) return 1;
+  return ret == GOPCACHE_PENDING ? 0 : -1;
+}
+
+int video_step_reverse(VideoState *v, SDL_Renderer *ren) {
+  if (!v) return -1;
+  if ((int)(SDL_GetTicks() - v->last_ticks) < v->frame_ms) return 1;
+  return video_step_frame(v, ren, -1);
+}
+
+void video_set_rate(VideoState *v, int rate) {
+  if (!v || !v->vdec || !v->vst) return;
+  if (rate > -2 && rate < 2) rate = 1;
+  if (rate > VIDEO_RATE_MAX) rate = VIDEO_RATE_MAX;
+  if (rate < -VIDEO_RATE_MAX) rate = -VIDEO_RATE_MAX;
+  if (rate == v->rate) return;
+
+  int was_trick = v->rate != 1;
+  enum AVDiscard skip = v->vdec->skip_frame;
+  if ((rate > 0) != (v->rate > 0)) v->trick_held = 0;
+  v->rate = rate;
+
+  if (rate == 1) {
+    v->vdec->skip_frame = video_normal_skip_frame(v);
+    if (v->ast) v->ast->discard = AVDISCARD_DEFAULT;
+    v->trick_held = 0;
+    /* Frames the next ones reference were skipped; rebuild the decoder
+     * state the same way as after a frame step. */
+    if (v->cur_pts != AV_NOPTS_VALUE) v->stepped = 1;
+    return;
+  }
+
+  v->vdec->skip_frame = (rate < 0 || rate >= VIDEO_RATE_NONKEY)
+                            ? AVDISCARD_NONKEY
+                            : AVDISCARD_NONREF;
+  if (v->ast) v->ast->discard = AVDISCARD_ALL;
+
+  if (!was_trick) {
+    audio_out_clear(v->audio);
+    v->trick_ms = v->cur_pts_ms;
+    v->stepped = 0;
+  }
+  v->trick_ticks = SDL_GetTicks();
+
+  /* Decoding more frames than before: the newly decoded ones reference
+   * frames that were skipped, so restart from the keyframe before the shown
+   * frame instead. */
+  if (rate > 0 && v->vdec->skip_frame < skip) {
+    video_trick_seek(v, v->cur_pts_ms);
+  }
+}
+
+void video_get_stats(VideoState *v, VideoStats *out) {
+  memset(out, 0, sizeof(*out));
+  if (!v) return;
+
+  out->decoded = v->frames_decoded;
+  out->shown = v->frames_shown;
+  out->dropped = v->frames_decoded > v->frames_shown
+                     ? v->frames_decoded - v->frames_shown
+                     : 0;
+  out->late = v->frames_late;
+  out->first_frame_ms = v->first_frame_ms;
+  out->quality_level = v->degrade.level;
+
+  if (v->fmt && v->adec && v->rate == 1 && !v->background &&
+      v->audio_end_ms != AV_NOPTS_VALUE && v->cur_pts != AV_NOPTS_VALUE) {
+    double heard = (double)v->audio_end_ms - audio_out_latency_ms(v->audio);
+    out->has_drift = 1;
+    out->drift_ms = (double)v->cur_pts_ms - heard;
   }
 }
 
+int video_get_quality_level(const VideoState *v, Uint32 *active_ms) {
+  if (!v || !v->vdec) {
+    if (active_ms) *active_ms = 0;
+    return 0;
+  }
+  if (active_ms) *active_ms = SDL_GetTicks() - v->degrade.level_since;
+  return v->degrade.level;
+}
+
+int video_get_rate(const VideoState *v) {
+  return v && v->rate ? v->rate : 1;
+}
+
 void video_set_volume(VideoState *v, double volume) {
   if (!v) return;
   if (volume < 0.0) volume = 0.0;
@@ -358,6 +1418,30 @@ int64_t video_get_position_ms(const VideoState *v) {
 
 int video_is_eof(const VideoState *v) { return v ? v->eof : 0; }
 
+int video_has_frame(const VideoState *v) {
+  return v && v->fmt && !v->first_frame_pending;
+}
+
+void video_set_output_size(VideoState *v, int w, int h) {
+  if (!v || !v->tex) return;
+
+  /* The software path converts straight to the on-screen size, upscaling
+   * included, so the renderer only copies pixels. */
+  int tw = w, th = h;
+  if (!v->software) video_fit_size(v->src_w, v->src_h, w, h, &tw, &th);
+  if (tw < 2 || th < 2) return;
+  if (tw == v->out_w && th == v->out_h) return;
+
+  v->out_w = tw;
+  v->out_h = th;
+  v->out_changed_ticks = SDL_GetTicks();
+}
+
+void video_get_frame_size(const VideoState *v, int *w, int *h) {
+  if (w) *w = v ? v->src_w : 0;
+  if (h) *h = v ? v->src_h : 0;
+}
+
 SDL_Texture *video_get_texture(VideoState *v, int *w, int *h) {
   if (!v) return NULL;
   if (w) *w = v->tex_w;
@@ -0,0 +1,399 @@
+#include <SDL2/SDL.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "framepool.h"
+#include "trace.h"
+#include "wall.h"
+#include "workpool.h"
+
+/* A tile that fell behind decodes at most this many frames in one batch,
+ * showing only the last. */
+#define WALL_MAX_CATCHUP 4
+/* Further behind than this, a tile restarts its clock instead. */
+#define WALL_MAX_LAG_MS 1000
+
+typedef struct {
+  VideoWall *w;
+  const char *const *paths;
+} WallOpenJob;
+
+static double wall_elapsed_ms(Uint64 since) {
+  return (double)(SDL_GetPerformanceCounter() - since) * 1000.0 /
+         (double)SDL_GetPerformanceFrequency();
+}
+
+static void wall_apply_quality(WallTile *t) {
+  t->sws_flags = video_apply_quality_level(t->dec, t->degrade.level, 1);
+}
+
+/* (Re)opens the tile's decoder for cells of `cell_w` x `cell_h`. */
+static int wall_tile_open_decoder(WallTile *t, int cell_w, int cell_h) {
+  AVStream *st = t->in.fmt->streams[t->stream_index];
+  const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+  if (!codec) return 0;
+  avcodec_free_context(&t->dec);
+  t->dec = avcodec_alloc_context3(codec);
+  if (!t->dec || avcodec_parameters_to_context(t->dec, st->codecpar) < 0)
+    return 0;
+
+  t->dec->lowres = video_pick_lowres(codec, st->codecpar->width,
+                                     st->codecpar->height, cell_w, cell_h);
+  /* Parallelism comes from decoding tiles side by side on the WorkPool. */
+  t->dec->thread_count = 1;
+  framepool_attach(t->dec, player_config()->huge_pages);
+  return avcodec_open2(t->dec, codec, NULL) >= 0;
+}
+
+static int wall_tile_open(WallTile *t, const char *path, int cell_w,
+                          int cell_h) {
+  /* Sixteen read-ahead threads and buffers would only compete for the
+   * disk; a tile reads little per frame at its lowres. */
+  if (!video_input_open(&t->in, path, VIDEO_INPUT_NO_PREFETCH, NULL, NULL))
+    return 0;
+
+  AVFormatContext *fmt = t->in.fmt;
+  int si = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (si < 0) return 0;
+  t->stream_index = si;
+  for (unsigned i = 0; i < fmt->nb_streams; ++i) {
+    if ((int)i != si) fmt->streams[i]->discard = AVDISCARD_ALL;
+  }
+  if (!wall_tile_open_decoder(t, cell_w, cell_h)) return 0;
+
+  t->pkt = av_packet_alloc();
+  t->frame = av_frame_alloc();
+  t->pic = av_frame_alloc();
+  if (!t->pkt || !t->frame || !t->pic) return 0;
+
+  AVRational fr = fmt->streams[si]->avg_frame_rate;
+  double fps = fr.num > 0 && fr.den > 0 ? av_q2d(fr) : 25.0;
+  if (fps <= 0 || fps > 120.0) fps = 25.0;
+  t->frame_ms = (int)(1000.0 / fps);
+  return 1;
+}
+
+static void wall_open_job(void *arg, int index) {
+  WallOpenJob *job = (WallOpenJob *)arg;
+  WallTile *t = &job->w->tiles[index];
+  trace_begin("wall_open");
+  if (!wall_tile_open(t, job->paths[index], job->w->cell_w,
+                      job->w->cell_h)) {
+    fprintf(stderr, "wall: cannot play '%s'\n", job->paths[index]);
+    t->failed = 1;
+  }
+  trace_end();
+}
+
+/* The cell's aspect-preserving fit of the decoded size, kept even for
+ * 4:2:0 output. */
+static void wall_tile_fit(VideoWall *w, WallTile *t) {
+  int sw = t->dec ? t->dec->width : 0;
+  int sh = t->dec ? t->dec->height : 0;
+  if (sw <= 0 || sh <= 0 || w->cell_w <= 0 || w->cell_h <= 0) return;
+
+  double sx = (double)w->cell_w / sw;
+  double sy = (double)w->cell_h / sh;
+  double sc = sx < sy ? sx : sy;
+  if (sc > 1.0) sc = 1.0;
+  t->out_w = ((int)(sw * sc) + 1) & ~1;
+  t->out_h = ((int)(sh * sc) + 1) & ~1;
+  if (t->out_w < 2) t->out_w = 2;
+  if (t->out_h < 2) t->out_h = 2;
+}
+
+/* Cells grew past what the tile's lowres decodes: reopens the decoder at a
+ * larger size and seeks back to the frame it last decoded. */
+static void wall_regrow_job(void *arg, int index) {
+  VideoWall *w = (VideoWall *)arg;
+  WallTile *t = &w->tiles[index];
+  if (t->failed || !t->dec) return;
+
+  AVCodecParameters *par = t->in.fmt->streams[t->stream_index]->codecpar;
+  int lowres = video_pick_lowres(t->dec->codec, par->width, par->height,
+                                 w->cell_w, w->cell_h);
+  if (lowres >= t->dec->lowres) return;
+
+  trace_begin("wall_regrow");
+  int64_t pts = t->frame->best_effort_timestamp;
+  if (!wall_tile_open_decoder(t, w->cell_w, w->cell_h)) {
+    fprintf(stderr, "wall: tile %d stopped\n", index);
+    t->failed = 1;
+  } else {
+    wall_apply_quality(t);
+    if (pts != AV_NOPTS_VALUE) {
+      av_seek_frame(t->in.fmt, t->stream_index, pts, AVSEEK_FLAG_BACKWARD);
+    }
+  }
+  trace_end();
+}
+
+void wall_set_size(VideoWall *w, int width, int height) {
+  if (w->count <= 0) return;
+
+  int cols = 1;
+  while (cols * cols < w->count) cols++;
+  int rows = (w->count + cols - 1) / cols;
+  int cell_w = (width - (cols - 1) * WALL_GAP) / cols;
+  int cell_h = (height - (rows - 1) * WALL_GAP) / rows;
+  if (cell_w == w->cell_w && cell_h == w->cell_h && cols == w->cols) return;
+
+  int grew = cell_w > w->cell_w || cell_h > w->cell_h;
+  w->cols = cols;
+  w->rows = rows;
+  w->cell_w = cell_w > 2 ? cell_w : 2;
+  w->cell_h = cell_h > 2 ? cell_h : 2;
+  /* Smaller cells keep their decode size; only growth needs more pixels. */
+  if (grew) workpool_run(workpool_shared(), w->count, wall_regrow_job, w);
+  for (int i = 0; i < w->count; ++i) wall_tile_fit(w, &w->tiles[i]);
+}
+
+void wall_restart_clock(VideoWall *w, Uint32 now) {
+  for (int i = 0; i < w->count; ++i) w->tiles[i].due_ticks = now;
+}
+
+int wall_open(VideoWall *w, const char *const *paths, int count, int width,
+              int height) {
+  memset(w, 0, sizeof(*w));
+  if (count > WALL_MAX_TILES) count = WALL_MAX_TILES;
+  if (count <= 0) return 0;
+
+  w->count = count;
+  w->degrade_on = player_config()->degrade;
+  wall_set_size(w, width, height);
+
+  Uint64 start = SDL_GetPerformanceCounter();
+  WallOpenJob job = {w, paths};
+  workpool_run(workpool_shared(), count, wall_open_job, &job);
+
+  Uint32 now = SDL_GetTicks();
+  int opened = 0;
+  for (int i = 0; i < count; ++i) {
+    WallTile *t = &w->tiles[i];
+    degrade_reset(&t->degrade, now);
+    if (t->failed) continue;
+    wall_apply_quality(t);
+    wall_tile_fit(w, t);
+    t->due_ticks = now;
+    opened++;
+  }
+  fprintf(stderr, "wall: %d of %d files opened in %.1f ms, %d x %d cells\n",
+          opened, count, wall_elapsed_ms(start), w->cell_w, w->cell_h);
+
+  if (!opened) wall_close(w);
+  return opened > 0;
+}
+
+/* Next frame into t->frame; the file starts over when it ends. */
+static int wall_tile_decode(WallTile *t) {
+  int restarted = 0;
+  for (;;) {
+    int ret = avcodec_receive_frame(t->dec, t->frame);
+    if (ret >= 0) return 1;
+
+    if (ret == AVERROR_EOF) {
+      AVStream *st = t->in.fmt->streams[t->stream_index];
+      int64_t ts = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+      if (restarted ||
+          av_seek_frame(t->in.fmt, t->stream_index, ts,
+                        AVSEEK_FLAG_BACKWARD) < 0) {
+        return 0;
+      }
+      avcodec_flush_buffers(t->dec);
+      restarted = 1;
+      t->loops++;
+      continue;
+    }
+    if (ret != AVERROR(EAGAIN)) return 0;
+
+    ret = av_read_frame(t->in.fmt, t->pkt);
+    if (ret < 0) {
+      avcodec_send_packet(t->dec, NULL);
+      continue;
+    }
+    if (t->pkt->stream_index == t->stream_index) {
+      avcodec_send_packet(t->dec, t->pkt);
+    }
+    av_packet_unref(t->pkt);
+  }
+}
+
+static int wall_tile_convert(WallTile *t) {
+  AVFrame *f = t->frame;
+  AVFrame *p = t->pic;
+  if (p->width != t->out_w || p->height != t->out_h) {
+    av_frame_unref(p);
+    p->format = AV_PIX_FMT_YUV420P;
+    p->width = t->out_w;
+    p->height = t->out_h;
+    if (av_frame_get_buffer(p, 32) < 0) {
+      av_frame_unref(p);
+      return 0;
+    }
+  }
+  /* One thread per tile; the other cores are busy with other tiles. */
+  if (!scaler_configure(&t->scaler, f->width, f->height, f->format,
+                        t->out_w, t->out_h, AV_PIX_FMT_YUV420P,
+                        t->sws_flags, 1)) {
+    return 0;
+  }
+  return scaler_scale(&t->scaler, f, p->data, p->linesize);
+}
+
+static void wall_tile_job(void *arg, int index) {
+  VideoWall *w = (VideoWall *)arg;
+  WallTile *t = &w->tiles[w->due[index]];
+  Uint64 start = SDL_GetPerformanceCounter();
+  trace_begin("wall_tile");
+
+  for (int n = 0; n < WALL_MAX_CATCHUP; ++n) {
+    if (!wall_tile_decode(t)) {
+      fprintf(stderr, "wall: tile %d stopped\n", w->due[index]);
+      t->failed = 1;
+      break;
+    }
+    t->decoded++;
+    t->due_ticks += (Uint32)t->frame_ms;
+    if ((int)(w->now - t->due_ticks) > WALL_MAX_LAG_MS) t->due_ticks = w->now;
+
+    /* Still a whole frame behind: this one is only decoded as a
+     * reference. */
+    if ((int)(w->now - t->due_ticks) < t->frame_ms) {
+      if (wall_tile_convert(t)) t->pic_ready = 1;
+      break;
+    }
+    t->dropped++;
+  }
+
+  trace_end();
+  t->decode_ms += wall_elapsed_ms(start);
+}
+
+static void wall_update_quality(VideoWall *w, WallTile *t, int index,
+                                double batch_ms) {
+  int prev = t->degrade.level;
+  Uint32 prev_ms = w->now - t->degrade.level_since;
+  if (degrade_update(&t->degrade, batch_ms, t->frame_ms, w->now) < 0) return;
+
+  wall_apply_quality(t);
+  fprintf(stderr,
+          "wall: tile %d quality level %d (%s) after %.1f s at level %d, "
+          "load %.2f\n",
+          index, t->degrade.level, degrade_level_name(t->degrade.level),
+          prev_ms / 1000.0, prev, t->degrade.load);
+}
+
+int wall_decode(VideoWall *w, Uint32 now) {
+  w->ndue = 0;
+  for (int i = 0; i < w->count; ++i) {
+    WallTile *t = &w->tiles[i];
+    if (t->failed || (int)(now - t->due_ticks) < 0) continue;
+
+    /* Insertion by lateness, most overdue first. */
+    int j = w->ndue++;
+    while (j > 0 &&
+           (int)(w->tiles[w->due[j - 1]].due_ticks - t->due_ticks) > 0) {
+      w->due[j] = w->due[j - 1];
+      j--;
+    }
+    w->due[j] = i;
+  }
+  if (!w->ndue) return 0;
+
+  w->now = now;
+  Uint64 start = SDL_GetPerformanceCounter();
+  trace_begin("wall_decode");
+  workpool_run(workpool_shared(), w->ndue, wall_tile_job, w);
+  trace_end();
+  double ms = wall_elapsed_ms(start);
+
+  w->batches++;
+  w->batch_total_ms += ms;
+  if (ms > w->batch_max_ms) w->batch_max_ms = ms;
+
+  int ready = 0;
+  for (int i = 0; i < w->ndue; ++i) {
+    WallTile *t = &w->tiles[w->due[i]];
+    if (w->degrade_on && !t->failed) wall_update_quality(w, t, w->due[i], ms);
+    ready += t->pic_ready;
+  }
+  return ready;
+}
+
+void wall_upload(VideoWall *w, SDL_Renderer *ren) {
+  for (int i = 0; i < w->count; ++i) {
+    WallTile *t = &w->tiles[i];
+    if (!t->pic_ready) continue;
+    t->pic_ready = 0;
+
+    AVFrame *p = t->pic;
+    if (!t->tex || t->tex_w != p->width || t->tex_h != p->height) {
+      if (t->tex) SDL_DestroyTexture(t->tex);
+      t->tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_IYUV,
+                                 SDL_TEXTUREACCESS_STREAMING, p->width,
+                                 p->height);
+      t->tex_w = p->width;
+      t->tex_h = p->height;
+      if (!t->tex) continue;
+    }
+    SDL_UpdateYUVTexture(t->tex, NULL, p->data[0], p->linesize[0],
+                         p->data[1], p->linesize[1], p->data[2],
+                         p->linesize[2]);
+    t->shown++;
+  }
+}
+
+void wall_draw(const VideoWall *w, SDL_Renderer *ren) {
+  for (int i = 0; i < w->count; ++i) {
+    const WallTile *t = &w->tiles[i];
+    if (!t->tex) continue;
+
+    int cx = (i % w->cols) * (w->cell_w + WALL_GAP);
+    int cy = (i / w->cols) * (w->cell_h + WALL_GAP);
+    double sx = (double)w->cell_w / t->tex_w;
+    double sy = (double)w->cell_h / t->tex_h;
+    double sc = sx < sy ? sx : sy;
+    SDL_Rect dst;
+    dst.w = (int)(t->tex_w * sc);
+    dst.h = (int)(t->tex_h * sc);
+    dst.x = cx + (w->cell_w - dst.w) / 2;
+    dst.y = cy + (w->cell_h - dst.h) / 2;
+    SDL_RenderCopy(ren, t->tex, NULL, &dst);
+  }
+}
+
+void wall_close(VideoWall *w) {
+  if (w->batches > 0) {
+    fprintf(stderr,
+            "wall: %d tiles on %d threads, %llu batches, avg %.1f ms max "
+            "%.1f ms\n",
+            w->count, workpool_size(workpool_shared()),
+            (unsigned long long)w->batches,
+            w->batch_total_ms / (double)w->batches, w->batch_max_ms);
+  }
+
+  for (int i = 0; i < w->count; ++i) {
+    WallTile *t = &w->tiles[i];
+    if (t->decoded > 0) {
+      fprintf(stderr,
+              "wall: tile %d %s: %llu decoded, %llu shown, %llu dropped, "
+              "%llu loops, decode avg %.1f ms, quality level %d\n",
+              i, t->in.path ? t->in.path : "?",
+              (unsigned long long)t->decoded, (unsigned long long)t->shown,
+              (unsigned long long)t->dropped, (unsigned long long)t->loops,
+              t->decode_ms / (double)t->decoded, t->degrade.level);
+    }
+    if (t->tex) SDL_DestroyTexture(t->tex);
+    scaler_free(&t->scaler);
+    av_frame_free(&t->pic);
+    av_frame_free(&t->frame);
+    av_packet_free(&t->pkt);
+    avcodec_free_context(&t->dec);
+    video_input_close(&t->in);
+  }
+  memset(w, 0, sizeof(*w));
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "workpool.h"
+
+struct WorkPool {
+  pthread_t *threads;
+  int nthreads;
+
+  pthread_mutex_t run_lock;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+
+  WorkFn fn;
+  void *arg;
+  int count;
+  int next;
+  int remaining;
+  unsigned generation;
+  int quit;
+};
+
+static _Thread_local int t_in_pool;
+
+static pthread_mutex_t g_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static WorkPool *g_shared;
+
+int workpool_cpu_count(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+/* Claims and runs jobs of the current batch until none are left. Called
+ * with p->lock held; returns with it held. */
+static void workpool_drain(WorkPool *p) {
+  while (p->next < p->count) {
+    int idx = p->next++;
+    WorkFn fn = p->fn;
+    void *arg = p->arg;
+
+    pthread_mutex_unlock(&p->lock);
+    fn(arg, idx);
+    pthread_mutex_lock(&p->lock);
+
+    if (--p->remaining == 0) pthread_cond_broadcast(&p->done);
+  }
+}
+
+static void *workpool_thread(void *opaque) {
+  WorkPool *p = (WorkPool *)opaque;
+  t_in_pool = 1;
+  trace_set_thread_name("workpool");
+
+  pthread_mutex_lock(&p->lock);
+  unsigned seen = p->generation;
+  for (;;) {
+    while (!p->quit && p->generation == seen) {
+      pthread_cond_wait(&p->wake, &p->lock);
+    }
+    if (p->quit) break;
+    seen = p->generation;
+    workpool_drain(p);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+WorkPool *workpool_create(int threads) {
+  if (threads <= 0) threads = workpool_cpu_count();
+
+  WorkPool *p = (WorkPool *)calloc(1, sizeof(WorkPool));
+  if (!p) return NULL;
+
+  pthread_mutex_init(&p->run_lock, NULL);
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  pthread_cond_init(&p->done, NULL);
+
+  /* The caller of workpool_run() is one of the workers. */
+  int extra = threads - 1;
+  if (extra > 0) {
+    p->threads = (pthread_t *)calloc((size_t)extra, sizeof(pthread_t));
+    if (!p->threads) {
+      workpool_destroy(p);
+      return NULL;
+    }
+    for (int i = 0; i < extra; ++i) {
+      if (pthread_create(&p->threads[i], NULL, workpool_thread, p) != 0) {
+        fprintf(stderr, "workpool: started %d of %d threads\n", i + 1,
+                threads);
+        break;
+      }
+      p->nthreads++;
+    }
+  }
+  return p;
+}
+
+void workpool_destroy(WorkPool *p) {
+  if (!p) return;
+
+  pthread_mutex_lock(&p->lock);
+  p->quit = 1;
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->nthreads; ++i) pthread_join(p->threads[i], NULL);
+  free(p->threads);
+
+  pthread_cond_destroy(&p->done);
+  pthread_cond_destroy(&p->wake);
+  pthread_mutex_destroy(&p->lock);
+  pthread_mutex_destroy(&p->run_lock);
+  free(p);
+}
+
+WorkPool *workpool_shared(void) {
+  pthread_mutex_lock(&g_shared_lock);
+  if (!g_shared) g_shared = workpool_create(0);
+  WorkPool *p = g_shared;
+  pthread_mutex_unlock(&g_shared_lock);
+  return p;
+}
+
+void workpool_shared_shutdown(void) {
+  pthread_mutex_lock(&g_shared_lock);
+  WorkPool *p = g_shared;
+  g_shared = NULL;
+  pthread_mutex_unlock(&g_shared_lock);
+  workpool_destroy(p);
+}
+
+int workpool_size(const WorkPool *p) { return p ? p->nthreads + 1 : 1; }
+
+void workpool_run(WorkPool *p, int count, WorkFn fn, void *arg) {
+  if (count <= 0) return;
+
+  if (!p || p->nthreads == 0 || count == 1 || t_in_pool) {
+    for (int i = 0; i < count; ++i) fn(arg, i);
+    return;
+  }
+
+  pthread_mutex_lock(&p->run_lock);
+  pthread_mutex_lock(&p->lock);
+
+  p->fn = fn;
+  p->arg = arg;
+  p->count = count;
+  p->next = 0;
+  p->remaining = count;
+  p->generation++;
+  pthread_cond_broadcast(&p->wake);
+
+  t_in_pool = 1;
+  workpool_drain(p);
+  t_in_pool = 0;
+
+  while (p->remaining > 0) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+
+  p->fn = NULL;
+  p->arg = NULL;
+  p->count = 0;
+  pthread_mutex_unlock(&p->lock);
+  pthread_mutex_unlock(&p->run_lock);
+}
\ No newline at end of file
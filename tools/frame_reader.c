@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "framesink.h"
+
+/* Follows the frames a player exports with PLAYER_FRAME_EXPORT and prints,
+ * once a second, how many it read and the mean luma of the last one. The
+ * pixels are used where they are in the shared ring, never copied. */
+
+#define READER_POLL_NS 2000000L
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--frames N] /shm-name\n"
+          "  Reads frames exported by a player run with "
+          "PLAYER_FRAME_EXPORT=/shm-name.\n"
+          "  --frames N  exit after N frames\n",
+          argv0);
+}
+
+/* Maps the ring once the player has finished setting it up. */
+static const unsigned char *map_ring(const char *name, size_t *size) {
+  for (;;) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 &&
+        (size_t)st.st_size >= sizeof(FrameSinkHeader)) {
+      void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if (p == MAP_FAILED) return NULL;
+
+      const FrameSinkHeader *hdr = (const FrameSinkHeader *)p;
+      uint32_t magic = hdr->magic;
+      atomic_thread_fence(memory_order_acquire);
+      if (magic == FRAMESINK_MAGIC && hdr->version == FRAMESINK_VERSION) {
+        *size = (size_t)st.st_size;
+        return (const unsigned char *)p;
+      }
+      munmap(p, (size_t)st.st_size);
+    } else if (fd >= 0) {
+      close(fd);
+    }
+
+    struct timespec ts = {0, 100 * 1000000L};
+    nanosleep(&ts, NULL);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *name = NULL;
+  long limit = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      limit = strtol(argv[++i], NULL, 10);
+    } else if (argv[i][0] == '/' && !name) {
+      name = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!name) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  size_t size = 0;
+  const unsigned char *map = map_ring(name, &size);
+  if (!map) {
+    fprintf(stderr, "frame_reader: cannot map %s\n", name);
+    return 1;
+  }
+  FrameSinkHeader *hdr = (FrameSinkHeader *)map;
+  fprintf(stderr, "frame_reader: %s, %u slots, up to %ux%u\n", name,
+          hdr->slot_count, hdr->max_width, hdr->max_height);
+
+  uint64_t seen = 0;
+  long read = 0, missed = 0, torn = 0, total = 0;
+  double mean = 0.0;
+  int64_t pts_ms = 0;
+  uint32_t w = 0, h = 0;
+  double report = now_ms();
+
+  while (!limit || total < limit) {
+    uint64_t n = atomic_load_explicit(&hdr->published, memory_order_acquire);
+    if (n == 0 || n == seen) {
+      struct timespec ts = {0, READER_POLL_NS};
+      nanosleep(&ts, NULL);
+    } else {
+      const unsigned char *base = map + hdr->header_size +
+                                  ((n - 1) % hdr->slot_count) * hdr->slot_size;
+      FrameSinkSlot *slot = (FrameSinkSlot *)base;
+      uint64_t s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+      if (s1 == 2 * n) {
+        uint32_t fw = slot->width, fh = slot->height, pitch = slot->pitch[0];
+        const unsigned char *y = base + slot->offset[0];
+        uint64_t sum = 0;
+        for (uint32_t r = 0; r < fh; ++r) {
+          for (uint32_t c = 0; c < fw; ++c) sum += y[(size_t)r * pitch + c];
+        }
+        int64_t pts = slot->pts_ms;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == s1) {
+          if (seen && n > seen + 1) missed += (long)(n - seen - 1);
+          seen = n;
+          read++;
+          total++;
+          mean = fw && fh ? (double)sum / ((double)fw * fh) : 0.0;
+          pts_ms = pts;
+          w = fw;
+          h = fh;
+        } else {
+          torn++;
+        }
+      }
+    }
+
+    double t = now_ms();
+    if (t - report >= 1000.0) {
+      printf("%ld frames/s, %ld skipped, %ld overwritten while reading, "
+             "last %ux%u at %lld ms, mean luma %.1f\n",
+             read, missed, torn, w, h, (long long)pts_ms, mean);
+      fflush(stdout);
+      read = missed = torn = 0;
+      report = t;
+    }
+  }
+
+  munmap((void *)map, size);
+  return 0;
+}
\ No newline at end of file